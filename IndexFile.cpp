@@ -0,0 +1,141 @@
+/**
+ *  @file    IndexFile.cpp
+ *
+ *  @brief Index file implementation
+ *
+ *  @section DESCRIPTION
+ *
+ *  The file is mapped with mmap() as private and read-only, so the kernel
+ *  reads its pages on demand and may drop them under memory pressure.
+ *
+ */
+
+#include "IndexFile.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::~MappedFile(){
+    if(m_data != NULL)
+        munmap(const_cast<char*>(m_data), m_size);
+}
+
+bool MappedFile::open(const string& path){
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat status;
+    if(fstat(fd, &status) != 0 || static_cast<unsigned long>(status.st_size) < sizeof(IndexFileHeader)){
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);    // the mapping keeps the file open
+    if(data == MAP_FAILED)
+        return false;
+
+    m_data = static_cast<const char*>(data);
+    m_size = status.st_size;
+
+    const IndexFileHeader& header = this->header();
+    bool valid = memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == INDEX_FILE_VERSION &&
+                 header.byteOrder == INDEX_FILE_BYTE_ORDER &&
+                 header.longSize == sizeof(unsigned long);
+
+    for(unsigned int section = 0; section < INDEX_SECTIONS && valid; section++){
+        const IndexFileSection& location = header.sections[section];
+        if(location.size > 0 && array<char>(location.offset, location.size) == NULL)
+            valid = false;
+    }
+    return valid;
+}
+
+IndexFileWriter::IndexFileWriter():
+    m_offset(0),
+    m_section(-1){
+    memset(m_sections, 0, sizeof(m_sections));
+}
+
+bool IndexFileWriter::open(const string& path){
+    m_file.open(path.c_str(), ios::out | ios::binary | ios::trunc);
+    if(!m_file.is_open())
+        return false;
+
+    IndexFileHeader header;
+    memset(&header, 0, sizeof(header));
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_offset = sizeof(header);
+    return m_file.good();
+}
+
+void IndexFileWriter::align(){
+    static const char padding[INDEX_FILE_ALIGNMENT] = {0};
+
+    if(m_offset % INDEX_FILE_ALIGNMENT != 0){
+        unsigned long long size = INDEX_FILE_ALIGNMENT - m_offset % INDEX_FILE_ALIGNMENT;
+        m_file.write(padding, size);
+        m_offset += size;
+    }
+}
+
+void IndexFileWriter::beginSection(INDEX_SECTION section){
+    align();
+    m_section = section;
+    m_sections[section].offset = m_offset;
+    m_sections[section].size = 0;
+}
+
+unsigned long long IndexFileWriter::write(const void* data, unsigned long long size){
+    align();
+    unsigned long long offset = m_offset;
+
+    if(size > 0)
+        m_file.write(static_cast<const char*>(data), size);
+    m_offset += size;
+
+    if(m_section >= 0)
+        m_sections[m_section].size = m_offset - m_sections[m_section].offset;
+    return offset;
+}
+
+unsigned long long IndexFileWriter::append(const string& path, unsigned long long offset, unsigned long long size){
+    ifstream file(path.c_str(), ios::in | ios::binary);
+    if(!file.is_open() || !file.seekg(offset))
+        return 0;
+
+    align();
+    unsigned long long start = m_offset;
+    char buffer[65536];
+    while(size > 0 && file.read(buffer, min(size, static_cast<unsigned long long>(sizeof(buffer))))){
+        m_file.write(buffer, file.gcount());
+        m_offset += file.gcount();
+        size -= file.gcount();
+    }
+    if(size > 0)
+        return 0;   // the file is shorter
+
+    if(m_section >= 0)
+        m_sections[m_section].size = m_offset - m_sections[m_section].offset;
+    return start;
+}
+
+bool IndexFileWriter::close(IndexFileHeader& header){
+    align();
+
+    memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+    header.version = INDEX_FILE_VERSION;
+    header.byteOrder = INDEX_FILE_BYTE_ORDER;
+    header.longSize = sizeof(unsigned long);
+    memcpy(header.sections, m_sections, sizeof(m_sections));
+
+    m_file.seekp(0);
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_file.close();
+    return !m_file.fail();
+}
@@ -0,0 +1,273 @@
+/**
+ *  @file    IndexFile.h
+ *
+ *  @brief On-disk format of the search engine index
+ *
+ *  @section DESCRIPTION
+ *
+ *  The index is stored in a single file: a fixed header followed by sections
+ *  (term dictionary, per-term data, posting lists, document metadata), each
+ *  aligned to INDEX_FILE_ALIGNMENT bytes. Arrays are stored exactly as they
+ *  are kept in memory (native byte order), so that a loaded index reads them
+ *  straight from the memory-mapped file: pages are faulted in when a query
+ *  first touches them, and nothing is deserialized up-front. The header
+ *  records the format version, byte order and word size, and files written
+ *  with a different version or by a different platform are rejected.
+ *
+ */
+
+#ifndef _INDEX_FILE_H
+#define _INDEX_FILE_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define INDEX_FILE_NAME         "index.bin"     // name of the index file in the index directory
+#define INDEX_FILE_MAGIC        "SEINDEX"       // first 8 bytes of the file (including the terminating zero)
+#define INDEX_FILE_VERSION      1               // incremented whenever the format changes
+#define INDEX_FILE_BYTE_ORDER   0x01020304      // stored natively, reads differently on the other byte order
+#define INDEX_FILE_ALIGNMENT    8               // sections and arrays start at offsets divisible by this
+
+typedef enum{
+    INDEX_SECTION_TERM_TEXT = 0,    // term strings, concatenated in term ID order
+    INDEX_SECTION_TERM_OFFSETS,     // offset of each term in the text, and the end of the text (unsigned int)
+    INDEX_SECTION_TERM_ORDER,       // term IDs sorted by their terms (unsigned int)
+    INDEX_SECTION_DF,               // document frequency of each term (unsigned long)
+    INDEX_SECTION_IDF,              // inverse document frequency of each term (double)
+    INDEX_SECTION_LISTS,            // PostingListEntry of each term, followed by those of the indexed pairs
+    INDEX_SECTION_PAIRS,            // term IDs of each indexed pair (two unsigned ints)
+    INDEX_SECTION_DOC_DATA,         // docID/tf blocks of all posting lists
+    INDEX_SECTION_POSITION_DATA,    // positions of all posting lists
+    INDEX_SECTION_SKIPS,            // skip pointers of all posting lists
+    INDEX_SECTION_IMPACTS,          // impacts of all posting lists
+    INDEX_SECTION_LENGTH_CODES,     // quantized length of each document, indexed by docID (unsigned char)
+    INDEX_SECTION_LENGTH_NORMS,     // BM25 length norm of each length code (double)
+    INDEX_SECTION_DOCUMENTS,        // docIDs of the collection documents, in the order they were added (unsigned long)
+    INDEX_SECTIONS
+}INDEX_SECTION;
+
+/**
+ *  @brief Location of a section in the index file
+ */
+class IndexFileSection{
+public:
+    unsigned long long offset;  // from the beginning of the file, in bytes
+    unsigned long long size;    // in bytes
+};
+
+/**
+ *  @brief Header at the beginning of the index file
+ */
+class IndexFileHeader{
+public:
+    char               magic[8];            // INDEX_FILE_MAGIC
+    unsigned int       version;             // INDEX_FILE_VERSION
+    unsigned int       byteOrder;           // INDEX_FILE_BYTE_ORDER
+    unsigned int       longSize;            // sizeof(unsigned long) of the writer
+    unsigned int       rankingModel;        // RANKING_MODEL the index was built with
+    unsigned long long termsCount;
+    unsigned long long pairsCount;          // number of indexed pairs (see Index::setPairIndex())
+    unsigned long long collectionPairsCount;// number of distinct adjacent pairs in the collection
+    double             minLengthNorm;
+    double             impactScale;
+    IndexFileSection   sections[INDEX_SECTIONS];
+};
+
+/**
+ *  @brief Location of a posting list (see CompactPostingList) in the index file. Offsets
+ *         are in bytes, from the beginning of the file.
+ */
+class PostingListEntry{
+public:
+    unsigned long long size;                // number of postings
+    unsigned long long positionsCount;
+    unsigned long long docDataOffset;
+    unsigned long long docDataSize;
+    unsigned long long positionDataOffset;
+    unsigned long long positionDataSize;
+    unsigned long long skipsOffset;
+    unsigned long long skipsCount;
+    unsigned long long impactsOffset;
+    unsigned long long impactsCount;
+    unsigned int       maxTf;
+    unsigned int       reserved;
+};
+
+/**
+ *  @brief Array which either owns its elements, or reads them from a memory-mapped
+ *         index file (see MappedFile). Arrays are built in owned storage, and are copied
+ *         to it when a mapped array is modified.
+ */
+template<class T>
+class MappedArray{
+public:
+    MappedArray():
+        m_mapped(NULL),
+        m_mappedSize(0){}
+
+    const T* data() const {return m_mapped != NULL ? m_mapped : (m_owned.empty() ? NULL : &m_owned[0]);}
+    unsigned long size() const {return m_mapped != NULL ? m_mappedSize : m_owned.size();}
+    bool empty() const {return size() == 0;}
+    const T& operator[](unsigned long i) const {return data()[i];}
+    const T& back() const {return data()[size() - 1];}
+    bool mapped() const {return m_mapped != NULL;}
+
+/**
+ *   @brief  provides storage owned by the array for modification, copying elements of a mapped array into it
+ *
+ *   @return owned elements
+ */
+    vector<T>& owned(){
+        if(m_mapped != NULL){
+            m_owned.assign(m_mapped, m_mapped + m_mappedSize);
+            m_mapped = NULL;
+            m_mappedSize = 0;
+        }
+        return m_owned;
+    }
+
+/**
+ *   @brief  makes the array read elements from mapped memory, releasing owned storage
+ *
+ *   @param  data first element, must stay mapped for the lifetime of the array
+ *   @param  size number of elements
+ *   @return void
+ */
+    void map(const T* data, unsigned long size){
+        vector<T>().swap(m_owned);
+        m_mapped = size > 0 ? data : NULL;
+        m_mappedSize = size;
+    }
+
+private:
+    vector<T>     m_owned;
+    const T*      m_mapped;
+    unsigned long m_mappedSize;
+};
+
+/**
+ *  @brief Index file mapped into memory read-only
+ */
+class MappedFile{
+public:
+    MappedFile():
+        m_data(NULL),
+        m_size(0){}
+    ~MappedFile();
+
+/**
+ *   @brief  maps the index file and validates its header and section bounds
+ *
+ *   @param  path path to the file
+ *   @return true on success, false if the file can't be opened or isn't a valid index file
+ *           of this version and platform
+ */
+    bool open(const string& path);
+
+    const IndexFileHeader& header() const {return *reinterpret_cast<const IndexFileHeader*>(m_data);}
+    unsigned long size() const {return m_size;}
+
+/**
+ *   @brief  locates array in the file
+ *
+ *   @param  offset offset of the array in bytes
+ *   @param  count number of elements
+ *   @return first element, NULL if the array isn't aligned or is out of the file
+ */
+    template<class T>
+    const T* array(unsigned long long offset, unsigned long long count) const{
+        if(offset % INDEX_FILE_ALIGNMENT != 0 || offset > m_size || count > (m_size - offset) / sizeof(T))
+            return NULL;
+        return reinterpret_cast<const T*>(m_data + offset);
+    }
+
+/**
+ *   @brief  locates section of the file holding an array
+ *
+ *   @param  section the section
+ *   @param  count receives number of elements of the section
+ *   @return first element, NULL for an empty section
+ */
+    template<class T>
+    const T* section(INDEX_SECTION section, unsigned long& count) const{
+        const IndexFileSection& location = header().sections[section];
+        count = location.size / sizeof(T);
+        return count > 0 ? array<T>(location.offset, count) : NULL;
+    }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char*   m_data;
+    unsigned long m_size;
+};
+
+/**
+ *  @brief Writes the index file section by section. Sections (and arrays within them)
+ *         are padded to INDEX_FILE_ALIGNMENT, and the header is written by close().
+ */
+class IndexFileWriter{
+public:
+    IndexFileWriter();
+
+/**
+ *   @brief  creates the file and reserves room for the header
+ *
+ *   @param  path path to the file
+ *   @return true on success
+ */
+    bool open(const string& path);
+
+/**
+ *   @brief  starts a section, which then holds everything written until the next one
+ *
+ *   @param  section the section
+ *   @return void
+ */
+    void beginSection(INDEX_SECTION section);
+
+/**
+ *   @brief  appends an array to the current section
+ *
+ *   @param  data the array
+ *   @param  size size of the array in bytes
+ *   @return offset of the array in the file
+ */
+    unsigned long long write(const void* data, unsigned long long size);
+
+/** 
+ *   @brief  appends contents of another file to the current section, e.g. a stream written to a file 
+ *           of its own while the index file holds other sections
+ *  
+ *   @param  path path to the file
+ *   @param  offset offset in the file the copied contents start at
+ *   @param  size size of the copied contents in bytes
+ *   @return offset of the copied contents in the index file, 0 if the file can't be read
+ */
+    unsigned long long append(const string& path, unsigned long long offset, unsigned long long size);
+
+    // size of the file written so far
+    unsigned long long offset() const {return m_offset;}
+
+/**
+ *   @brief  finishes the file by writing the header, with locations of the sections filled in
+ *
+ *   @param  header header to write
+ *   @return true if the file was written successfully
+ */
+    bool close(IndexFileHeader& header);
+
+private:
+    void align();
+
+    ofstream           m_file;
+    unsigned long long m_offset;
+    int                m_section;       // current section, -1 before the first one
+    IndexFileSection   m_sections[INDEX_SECTIONS];
+};
+
+#endif /*_INDEX_FILE_H*/
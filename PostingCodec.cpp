@@ -0,0 +1,181 @@
+/** 
+ *  @file    PostingCodec.cpp
+ *  
+ *  @brief Integer compression routines used by the posting lists
+ *  
+ */
+
+#include "PostingCodec.h"
+
+void vbyteEncode(unsigned int value, vector<unsigned char>& out){
+    while(value >= 0x80){
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+void streamVByteEncode(const unsigned int* in, unsigned int count, vector<unsigned char>& out){
+    unsigned long controlOffset = out.size();
+
+    out.resize(out.size() + (count + 3) / 4, 0);    // control bytes
+
+    for(unsigned int i = 0; i < count; i++){
+        unsigned int value = in[i];
+        unsigned int code = 0;  // number of bytes - 1
+
+        out.push_back(static_cast<unsigned char>(value));
+        while(value >= 0x100){
+            value >>= 8;
+            out.push_back(static_cast<unsigned char>(value));
+            code++;
+        }
+        out[controlOffset + i / 4] |= code << ((i % 4) * 2);
+    }
+}
+
+/** 
+ *   @brief  scalar Stream VByte decoding of integers [from, count) of a block 
+ *  
+ *   @param  control control bytes of the block
+ *   @param  data data bytes of integer 'from'
+ *   @return pointer to the byte following the last decoded integer
+ */
+static const unsigned char* decodeScalar(const unsigned char* control, const unsigned char* data,
+                                         unsigned int from, unsigned int count, unsigned int* out){
+    for(unsigned int i = from; i < count; i++){
+        unsigned int code = (control[i / 4] >> ((i % 4) * 2)) & 3;
+        unsigned int value = data[0];
+
+        if(code > 0)
+            value |= data[1] << 8;
+        if(code > 1)
+            value |= data[2] << 16;
+        if(code > 2)
+            value |= data[3] << 24;
+
+        out[i] = value;
+        data += code + 1;
+    }
+    return data;
+}
+
+static void prefixSumScalar(unsigned int* values, unsigned int count, unsigned int base){
+    for(unsigned int i = 0; i < count; i++){
+        base += values[i];
+        values[i] = base;
+    }
+}
+
+static const unsigned char* streamVByteDecodeScalar(const unsigned char* in, unsigned int count, unsigned int* out){
+    return decodeScalar(in, in + (count + 3) / 4, 0, count, out);
+}
+
+static const unsigned char* streamVByteDecodeDeltaScalar(const unsigned char* in, unsigned int count, unsigned int* out, unsigned int base){
+    const unsigned char* end = decodeScalar(in, in + (count + 3) / 4, 0, count, out);
+    prefixSumScalar(out, count, base);
+    return end;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STREAM_VBYTE_SSSE3
+#include <immintrin.h>
+
+static unsigned char s_lengthTable[256];        // number of data bytes taken by 4 integers described by control byte
+static unsigned char s_shuffleTable[256][16];   // moves data bytes of 4 integers into 4 32-bit lanes
+
+static void initTables(){
+    for(unsigned int control = 0; control < 256; control++){
+        unsigned int byte = 0;
+
+        for(unsigned int lane = 0; lane < 4; lane++){
+            unsigned int length = ((control >> (lane * 2)) & 3) + 1;
+
+            for(unsigned int k = 0; k < 4; k++)
+                s_shuffleTable[control][lane * 4 + k] = k < length ? byte + k : 0x80; // 0x80 zeroes the byte
+            byte += length;
+        }
+        s_lengthTable[control] = byte;
+    }
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i decodeQuad(const unsigned char*& data, unsigned int control){
+    __m128i encoded = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s_shuffleTable[control]));
+
+    data += s_lengthTable[control];
+    return _mm_shuffle_epi8(encoded, shuffle);
+}
+
+__attribute__((target("ssse3")))
+static const unsigned char* streamVByteDecodeSSSE3(const unsigned char* in, unsigned int count, unsigned int* out){
+    const unsigned char* control = in;
+    const unsigned char* data = in + (count + 3) / 4;
+    unsigned int i = 0;
+
+    for(; i + 4 <= count; i += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), decodeQuad(data, control[i / 4]));
+
+    return decodeScalar(control, data, i, count, out);  // up to 3 remaining integers
+}
+
+__attribute__((target("ssse3")))
+static const unsigned char* streamVByteDecodeDeltaSSSE3(const unsigned char* in, unsigned int count, unsigned int* out, unsigned int base){
+    const unsigned char* control = in;
+    const unsigned char* data = in + (count + 3) / 4;
+    __m128i prev = _mm_set1_epi32(base);
+    unsigned int i = 0;
+
+    for(; i + 4 <= count; i += 4){
+        __m128i v = decodeQuad(data, control[i / 4]);
+
+        // in-register prefix sum of 4 lanes, then add the last value of the previous group
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi32(v, prev);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+        prev = _mm_shuffle_epi32(v, 0xFF);
+    }
+
+    data = decodeScalar(control, data, i, count, out);  // up to 3 remaining integers
+    prefixSumScalar(out + i, count - i, _mm_cvtsi128_si32(prev));
+    return data;
+}
+#endif
+
+static bool useSSSE3(){
+#ifdef STREAM_VBYTE_SSSE3
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("ssse3")){
+        initTables();
+        return true;
+    }
+#endif
+    return false;
+}
+
+typedef const unsigned char* (*DECODE_FUNC)(const unsigned char* in, unsigned int count, unsigned int* out);
+typedef const unsigned char* (*DECODE_DELTA_FUNC)(const unsigned char* in, unsigned int count, unsigned int* out, unsigned int base);
+
+static bool s_useSSSE3 = useSSSE3();    // CPUID check, done once at startup
+
+#ifdef STREAM_VBYTE_SSSE3
+static DECODE_FUNC s_decode = s_useSSSE3 ? streamVByteDecodeSSSE3 : streamVByteDecodeScalar;
+static DECODE_DELTA_FUNC s_decodeDelta = s_useSSSE3 ? streamVByteDecodeDeltaSSSE3 : streamVByteDecodeDeltaScalar;
+#else
+static DECODE_FUNC s_decode = streamVByteDecodeScalar;
+static DECODE_DELTA_FUNC s_decodeDelta = streamVByteDecodeDeltaScalar;
+#endif
+
+const unsigned char* streamVByteDecode(const unsigned char* in, unsigned int count, unsigned int* out){
+    return s_decode(in, count, out);
+}
+
+const unsigned char* streamVByteDecodeDelta(const unsigned char* in, unsigned int count, unsigned int* out, unsigned int base){
+    return s_decodeDelta(in, count, out, base);
+}
+
+const char* streamVByteDecoderName(){
+    return s_useSSSE3 ? "ssse3" : "scalar";
+}
@@ -0,0 +1,114 @@
+/** 
+ *  @file    PostingCodec.h
+ *  
+ *  @brief Integer compression routines used by the posting lists
+ *
+ *  @section DESCRIPTION
+ *  
+ *  Variable-byte (VByte) coding: each integer is stored in 7-bit groups,
+ *  least significant group first, and the high bit of a byte is set when
+ *  more bytes of the same integer follow. Small integers (such as d-gaps
+ *  between docIDs or positions) take a single byte.
+ *
+ *  Stream VByte coding: used for blocks of integers. Byte lengths (1-4) of 
+ *  all integers in a block are stored first as 2-bit codes (one control byte 
+ *  per 4 integers), followed by the data bytes. Since lengths are known
+ *  up-front, 4 integers are decoded at once with a single SSSE3 shuffle.
+ *  The SSSE3 decoder is selected at runtime (CPUID), with a scalar fallback
+ *  for CPUs and compilers that don't support it.
+ *  
+ */
+
+#ifndef _POSTING_CODEC_H
+#define _POSTING_CODEC_H
+
+#include <vector>
+
+using namespace std;
+
+#define POSTING_BLOCK_SIZE      128     // number of integers coded together in Stream VByte blocks
+#define STREAM_VBYTE_PADDING    16      // decoders may read up to this many bytes past the end of encoded data
+
+/** 
+ *   @brief  appends VByte encoded integer to the buffer 
+ *  
+ *   @param  value integer to encode
+ *   @param  out buffer to append to
+ *   @return void
+ */
+void vbyteEncode(unsigned int value, vector<unsigned char>& out);
+
+/** 
+ *   @brief  decodes single VByte encoded integer 
+ *  
+ *   @param  in pointer to encoded data
+ *   @param  value will hold decoded integer
+ *   @return pointer to the byte following the decoded integer
+ */
+inline const unsigned char* vbyteDecode(const unsigned char* in, unsigned int& value){
+    unsigned int byte = *in++;
+    value = byte & 0x7F;
+
+    for(unsigned int shift = 7; byte & 0x80; shift += 7){
+        byte = *in++;
+        value |= (byte & 0x7F) << shift;
+    }
+    return in;
+}
+
+/** 
+ *   @brief  skips over VByte encoded integers without decoding them 
+ *  
+ *   @param  in pointer to encoded data
+ *   @param  count number of integers to skip
+ *   @return pointer to the byte following the last skipped integer
+ */
+inline const unsigned char* vbyteSkip(const unsigned char* in, unsigned long count){
+    while(count > 0){
+        if((*in++ & 0x80) == 0)
+            count--;    // last byte of an integer
+    }
+    return in;
+}
+
+/** 
+ *   @brief  appends block of integers encoded with Stream VByte to the buffer 
+ *  
+ *   @param  in integers to encode
+ *   @param  count number of integers to encode
+ *   @param  out buffer to append to
+ *   @return void
+ */
+void streamVByteEncode(const unsigned int* in, unsigned int count, vector<unsigned char>& out);
+
+/** 
+ *   @brief  decodes block of integers encoded with Stream VByte. Buffer holding the 
+ *           encoded block must have at least STREAM_VBYTE_PADDING readable bytes after it.
+ *  
+ *   @param  in pointer to encoded block
+ *   @param  count number of integers in the block
+ *   @param  out array to decode the integers into, must fit 'count' integers
+ *   @return pointer to the byte following the encoded block
+ */
+const unsigned char* streamVByteDecode(const unsigned char* in, unsigned int count, unsigned int* out);
+
+/** 
+ *   @brief  decodes block of d-gaps encoded with Stream VByte and turns them into absolute values.
+ *           Buffer holding the encoded block must have at least STREAM_VBYTE_PADDING readable bytes after it.
+ *  
+ *   @param  in pointer to encoded block
+ *   @param  count number of integers in the block
+ *   @param  out array to decode the integers into, must fit 'count' integers
+ *   @param  base value preceding the first gap
+ *   @return pointer to the byte following the encoded block
+ */
+const unsigned char* streamVByteDecodeDelta(const unsigned char* in, unsigned int count, unsigned int* out, unsigned int base);
+
+/** 
+ *   @brief  name of the Stream VByte decoder selected for this CPU
+ *  
+ *   @return "ssse3" or "scalar"
+ */
+const char* streamVByteDecoderName();
+
+#endif /*_POSTING_CODEC_H*/
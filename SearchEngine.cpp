@@ -15,8 +15,17 @@
 
 #include "SearchEngine.h"
 #include <math.h>
-
-KrovetzStemmer Tokenizer::m_stemmer;
+#include <time.h>
+#include <float.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#if defined(__SSE2__) && __SIZEOF_LONG__ == 8
+#define PROXIMITY_SSE2  // positions (unsigned long) are compared as 64-bit lanes
+#include <emmintrin.h>
+#endif
 
 Tokenizer& Tokenizer::singleton(){
 
@@ -59,10 +68,6 @@ vector<string> Tokenizer::tokenize(string& text){
     return tokens;
 }
 
-Tokenizer::Tokenizer(){
-
-}
-
 void Tokenizer::stemTerm(string& term){       
     if(term.length() <= KrovetzStemmer::MAX_WORD_LENGTH){
         char thestem[80];
@@ -100,14 +105,240 @@ vector<string>& Query::terms(){
     return m_terms;
 }
 
+vector<unsigned int>& Query::termIDs(){
+    return m_termIDs;
+}
+
+void Query::resolveTerms(const Index& index){
+    m_termIDs.resize(m_terms.size());
 
-ProximityQuery::ProximityQuery(string& queryText, unsigned long proximityWnd): 
+    for(unsigned int i = 0; i < m_terms.size(); i++)
+        m_termIDs[i] = index.getTermID(m_terms[i]);
+}
+
+
+ProximityQuery::ProximityQuery(string& queryText, unsigned long proximityWnd, bool ordered, bool phrase): 
                         Query(queryText),
-                        m_proximityWnd(proximityWnd)
+                        m_proximityWnd(proximityWnd),
+                        m_ordered(ordered),
+                        m_phrase(phrase),
+                        m_candidateDocs(0),
+                        m_verifiedDocs(0),
+                        m_pairLists(0)
 {
 
 }
 
+QueryNode::QueryNode(QUERY_NODE_TYPE nodeType):
+    type(nodeType),
+    termID(INVALID_TERM_ID),
+    proxQuery(NULL),
+    algorithm(INTERSECTION_GALLOP),
+    estimatedDocs(0),
+    estimatedCost(0),
+    probeCost(0),
+    evaluated(false),
+    actualDocs(0),
+    actualCost(0){
+
+}
+
+QueryNode::~QueryNode(){
+    delete proxQuery;
+    for(unsigned long i=0; i < children.size(); i++)
+        delete children[i];
+}
+
+/**
+ *  @brief combines two operands with a boolean operator
+ *
+ *  @param  type QUERY_NODE_AND or QUERY_NODE_OR
+ *  @param  left first operand, may be NULL
+ *  @param  right second operand, may be NULL
+ *  @return node of the operator, or the other operand if one of them is NULL
+ */
+static QueryNode* combineNodes(QUERY_NODE_TYPE type, QueryNode* left, QueryNode* right){
+    if(left == NULL)
+        return right;
+    if(right == NULL)
+        return left;
+
+    QueryNode* node = new QueryNode(type);
+    node->children.push_back(left);
+    node->children.push_back(right);
+    return node;
+}
+
+QueryParser::QueryParser(const string& query):
+    m_next(0){
+
+    tokenize(query);
+}
+
+void QueryParser::tokenize(const string& query){
+    string word;
+
+    for(unsigned long i=0; i <= query.length(); i++){
+        unsigned long digitsEnd = i;
+        while(digitsEnd < query.length() && isdigit(query[digitsEnd]))
+            digitsEnd++;
+
+        bool proximity = digitsEnd > i && digitsEnd < query.length() && (query[digitsEnd] == '(' || query[digitsEnd] == '[');
+        bool boundary = i == query.length() || isspace(query[i]) || query[i] == '"' || query[i] == '(' || query[i] == ')' || proximity;
+
+        if(!boundary){
+            word += query[i];
+            continue;
+        }
+
+        if(word == "AND")
+            m_tokens.push_back(Token(QUERY_TOKEN_AND, word));
+        else if(word == "OR")
+            m_tokens.push_back(Token(QUERY_TOKEN_OR, word));
+        else if(word == "NOT")
+            m_tokens.push_back(Token(QUERY_TOKEN_NOT, word));
+        else if(word != "")
+            m_tokens.push_back(Token(QUERY_TOKEN_WORD, word));
+        word = "";
+
+        if(i == query.length())
+            break;
+
+        if(query[i] == '"'){
+            // phrase, up to the closing quote (or the end of the query)
+            string::size_type phraseEnd = query.find('"', i + 1);
+            if(phraseEnd == string::npos)
+                phraseEnd = query.length();
+
+            m_tokens.push_back(Token(QUERY_TOKEN_PHRASE, query.substr(i + 1, phraseEnd - i - 1)));
+            i = phraseEnd;
+        }
+        else if(proximity){
+            // proximity query, ordered with '(' and unordered with '[', up to the closing bracket
+            string::size_type proximityEnd = query.find_first_of(")]", digitsEnd + 1);
+            if(proximityEnd == string::npos)
+                proximityEnd = query.length();
+
+            m_tokens.push_back(Token(QUERY_TOKEN_PROXIMITY, query.substr(digitsEnd + 1, proximityEnd - digitsEnd - 1),
+                                     strtoul(query.substr(i, digitsEnd - i).c_str(), NULL, 10), query[digitsEnd] == '('));
+            i = proximityEnd;
+        }
+        else if(query[i] == '('){
+            m_tokens.push_back(Token(QUERY_TOKEN_OPEN, "("));
+        }
+        else if(query[i] == ')'){
+            m_tokens.push_back(Token(QUERY_TOKEN_CLOSE, ")"));
+        }
+    }
+}
+
+QueryNode* QueryParser::parse(){
+    QueryNode* root = parseOr();
+
+    while(m_next < m_tokens.size()){
+        m_next++;   // unmatched closing parenthesis
+        root = combineNodes(QUERY_NODE_AND, root, parseOr());
+    }
+    return root;
+}
+
+QueryNode* QueryParser::parseOr(){
+    QueryNode* node = parseAnd();
+
+    while(m_next < m_tokens.size() && m_tokens[m_next].type == QUERY_TOKEN_OR){
+        m_next++;
+        node = combineNodes(QUERY_NODE_OR, node, parseAnd());
+    }
+    return node;
+}
+
+QueryNode* QueryParser::parseAnd(){
+    QueryNode* node = NULL;
+
+    while(m_next < m_tokens.size()){
+        if(m_tokens[m_next].type == QUERY_TOKEN_AND)
+            m_next++;
+        else if(atOperand())
+            node = combineNodes(QUERY_NODE_AND, node, parseUnary());
+        else
+            break;
+    }
+    return node;
+}
+
+QueryNode* QueryParser::parseUnary(){
+    if(m_next < m_tokens.size() && m_tokens[m_next].type == QUERY_TOKEN_NOT){
+        m_next++;
+
+        QueryNode* operand = parseUnary();
+        if(operand == NULL)
+            return NULL;
+
+        QueryNode* node = new QueryNode(QUERY_NODE_NOT);
+        node->children.push_back(operand);
+        return node;
+    }
+    return parsePrimary();
+}
+
+QueryNode* QueryParser::parsePrimary(){
+    if(!atOperand())
+        return NULL;
+
+    const Token& token = m_tokens[m_next++];
+    if(token.type != QUERY_TOKEN_OPEN)
+        return operandNode(token);
+
+    QueryNode* node = parseOr();
+    if(m_next < m_tokens.size() && m_tokens[m_next].type == QUERY_TOKEN_CLOSE)
+        m_next++;
+    return node;
+}
+
+bool QueryParser::atOperand() const{
+    if(m_next >= m_tokens.size())
+        return false;
+
+    QUERY_TOKEN_TYPE type = m_tokens[m_next].type;
+    return type == QUERY_TOKEN_WORD || type == QUERY_TOKEN_PHRASE || type == QUERY_TOKEN_PROXIMITY || 
+           type == QUERY_TOKEN_NOT || type == QUERY_TOKEN_OPEN;
+}
+
+QueryNode* QueryParser::operandNode(const Token& token){
+    string text = token.text;
+
+    if(token.type == QUERY_TOKEN_WORD){
+        // a word may break into several terms (e.g. "wi-fi"), all of them must match
+        Query word(text);
+        QueryNode* node = NULL;
+
+        for(unsigned long i=0; i < word.terms().size(); i++){
+            QueryNode* term = new QueryNode(QUERY_NODE_TERM);
+            term->text = word.terms()[i];
+            node = combineNodes(QUERY_NODE_AND, node, term);
+        }
+        return node;
+    }
+
+    bool phrase = token.type == QUERY_TOKEN_PHRASE;
+    ProximityQuery* proxQuery = new ProximityQuery(text, phrase ? 0 : token.proximityWnd, token.ordered, phrase);
+    if(proxQuery->terms().empty()){
+        delete proxQuery;
+        return NULL;
+    }
+
+    stringstream nodeText;
+    if(phrase)
+        nodeText << "\"" << text << "\"";
+    else
+        nodeText << token.proximityWnd << (token.ordered ? "(" : "[") << text << (token.ordered ? ")" : "]");
+
+    QueryNode* node = new QueryNode(QUERY_NODE_PROXIMITY);
+    node->text = nodeText.str();
+    node->proxQuery = proxQuery;
+    return node;
+}
+
 void Posting::print(){
     cout << "[" << docID << "," << tf << ": ";
 
@@ -124,578 +355,4742 @@ void Posting::print(){
     cout << "]";
 }
 
-void TermInfo::print(bool includePostings){
-    cout << "[" << term << ": " << postings.size() << "]";
 
-    if(includePostings){
-        unsigned int index = 0;
-        cout << "->";
-        for(POSTING_LIST::iterator pit = postings.begin(); pit != postings.end(); pit++){
-            Posting& posting = (*pit).second;
-            posting.print();
-            if(index++ < postings.size() - 1)
-                cout << ",";
-        }
-    }
-    cout << endl;
+void CompactPostingList::build(const POSTING_LIST& postings){
+    PostingListBuilder builder(*this);
+    for(POSTING_LIST::const_iterator it = postings.begin(); it != postings.end(); it++)
+        builder.add(it->first, it->second.tf, it->second.positions);
+    builder.finish();
 }
 
-void Index::addTerm(string& term, unsigned long& docID, unsigned long& pos){
-    // check if this token already exists
-    TERMS_LIST::iterator it = m_terms.find(term);
-    TermInfo * pTermInfo = NULL;
+PostingListBuilder::PostingListBuilder(CompactPostingList& list):
+    m_list(list),
+    m_prevDocID(0),
+    m_positionOffset(0),
+    m_blockSize(0),
+    m_blockMaxTf(0){
+    m_list.m_size = 0;
+    m_list.m_positionsCount = 0;
+    m_list.m_maxTf = 0;
+    m_list.m_parts.clear();
+    m_list.m_docData.owned().clear();
+    m_list.m_positionData.owned().clear();
+    m_list.m_skips.owned().clear();
+}
 
-    if(it != m_terms.end()){
-        pTermInfo = &(*it).second;
+void PostingListBuilder::add(unsigned int docID, unsigned int tf, const POSITIONS_LIST& positions){
+    if(m_blockSize == 0)
+        m_positionOffset = m_list.m_positionData.size(); // first posting of a block
+
+    m_docGaps[m_blockSize] = docID - m_prevDocID;
+    m_tfs[m_blockSize] = tf;
+    m_prevDocID = docID;
+    if(m_blockMaxTf < tf)
+        m_blockMaxTf = tf;
+    m_list.m_size++;
+
+    if(++m_blockSize == POSTING_BLOCK_SIZE){
+        m_list.addBlock(m_docGaps, m_tfs, m_blockSize, m_prevDocID, m_blockMaxTf, m_positionOffset);
+        if(m_list.m_maxTf < m_blockMaxTf)
+            m_list.m_maxTf = m_blockMaxTf;
+        m_blockSize = 0;
+        m_blockMaxTf = 0;
     }
-    else{
-        TermInfo termInfo;
-        m_terms[term] = termInfo;  // insert new list
-        pTermInfo = &m_terms[term];
 
+    // positions are normally added in increasing order, but documents from different
+    // files may share the same docID, so sort them to be able to encode gaps
+    m_positions = positions;
+    sort(m_positions.begin(), m_positions.end());
+
+    unsigned long prevPos = 0;
+    for(unsigned long i = 0; i < m_positions.size(); i++){
+        vbyteEncode(m_positions[i] - prevPos, m_list.m_positionData.owned());
+        prevPos = m_positions[i];
     }
+    m_list.m_positionsCount += m_positions.size();
+}
+
+void PostingListBuilder::finish(){
+    if(m_blockSize > 0){
+        // last, partially filled block
+        m_list.addBlock(m_docGaps, m_tfs, m_blockSize, m_prevDocID, m_blockMaxTf, m_positionOffset);
+        if(m_list.m_maxTf < m_blockMaxTf)
+            m_list.m_maxTf = m_blockMaxTf;
+    }
+    m_list.m_docData.owned().resize(m_list.m_docData.size() + STREAM_VBYTE_PADDING, 0);
 
-    assert(pTermInfo);
-    pTermInfo->term = term;
-    pTermInfo->postings[docID].docID = docID;
-    pTermInfo->postings[docID].positions.push_back(pos);
-    pTermInfo->postings[docID].tf++;
-    pTermInfo->df = pTermInfo->postings.size(); // update df
+    // release unused capacity, the list won't change until next build
+    vector<unsigned char>(m_list.m_docData.owned()).swap(m_list.m_docData.owned());
+    vector<unsigned char>(m_list.m_positionData.owned()).swap(m_list.m_positionData.owned());
+    vector<SkipEntry>(m_list.m_skips.owned()).swap(m_list.m_skips.owned());
 }
 
-void Index::addText(string& text, unsigned long& docID, unsigned long& pos){
-    vector<string> tokens = Tokenizer::singleton().tokenize(text);
- 
-    for( unsigned int i = 0; i < tokens.size(); i++){
-        addTerm(tokens[i], docID, pos);
+void CompactPostingList::addBlock(const unsigned int* docGaps, const unsigned int* tfs, unsigned int count, 
+                                  unsigned int lastDocID, unsigned int maxTf, unsigned long positionOffset){
+    SkipEntry skip;
+    skip.lastDocID = lastDocID;
+    skip.docOffset = m_docData.size();
+    skip.positionOffset = positionOffset;
+    skip.maxTf = maxTf;
+    m_skips.owned().push_back(skip);
 
-        if(i > 0)
-            pos++; // increment position for each new token
-    }
+    streamVByteEncode(docGaps, count, m_docData.owned());
+    streamVByteEncode(tfs, count, m_docData.owned());
 }
 
-void Index::print(bool includePostings){
- //   cout << "Index contents: " << endl;
+bool DeletedDocs::add(unsigned int docID){
+    if(contains(docID))
+        return false;
 
-    for(TERMS_LIST::iterator it = m_terms.begin(); it != m_terms.end(); it++){
-        TermInfo& termInfo = (*it).second;
-        termInfo.print(includePostings);
-    }
+    if(docID / 64 >= m_bits.size())
+        m_bits.resize(docID / 64 + 1, 0);
+    m_bits[docID / 64] |= 1ULL << (docID % 64);
+    m_count++;
+    return true;
 }
 
-const POSTING_LIST* Index::getPostings(string term){
-    TERMS_LIST::iterator it = m_terms.find(term);
- 
-    if(it != m_terms.end()){
-        return &((*it).second.postings);
+void CompactPostingList::decode(POSTING_LIST& postings, const DeletedDocs* deletedDocs) const{
+    for(PostingCursor cursor(this, deletedDocs); cursor.valid(); cursor.next()){
+        const POSITIONS_LIST& positions = cursor.positions();
+        Posting& posting = postings[cursor.docID()];
+
+        posting.docID = cursor.docID();
+        posting.tf += cursor.tf();
+        posting.positions.insert(posting.positions.end(), positions.begin(), positions.end());
     }
-    else{
-        return NULL;
+}
+
+unsigned int CompactPostingList::lastDocID() const{
+    unsigned int lastDocID = m_skips.empty() ? 0 : m_skips.back().lastDocID;
+
+    for(unsigned long i = 0; i < m_parts.size(); i++){
+        if(m_parts[i]->lastDocID() > lastDocID)
+            lastDocID = m_parts[i]->lastDocID();
     }
+    return lastDocID;
 }
 
-const TermInfo* Index::getTermInfo(string term){
-    TERMS_LIST::iterator it = m_terms.find(term);
- 
-    if(it != m_terms.end()){
-        return &((*it).second);
+void CompactPostingList::setParts(const vector<const CompactPostingList*>& parts){
+    m_docData.owned().clear();
+    m_positionData.owned().clear();
+    m_skips.owned().clear();
+    m_impacts.owned().clear();
+    m_parts = parts;
+
+    m_size = 0;
+    m_positionsCount = 0;
+    m_maxTf = 0;
+    for(unsigned long i = 0; i < parts.size(); i++)
+        m_positionsCount += parts[i]->positionsCount();
+    for(PostingCursor cursor(this); cursor.valid(); cursor.next()){
+        m_size++;
+        if(cursor.tf() > m_maxTf)
+            m_maxTf = cursor.tf();
     }
-    else{
-        return NULL;
+}
+
+unsigned long CompactPostingList::memoryUsage() const{
+    unsigned long memoryUsage = 0;
+    for(unsigned long i = 0; i < m_parts.size(); i++)
+        memoryUsage += m_parts[i]->memoryUsage();
+
+    return memoryUsage + m_docData.size() + m_positionData.size() + m_skips.size() * sizeof(SkipEntry);
+}
+
+unsigned long CompactPostingList::uncompressedSize() const{
+    return (2 * m_size + m_positionsCount) * sizeof(unsigned long);
+}
+
+void CompactPostingList::save(IndexFileWriter& writer, INDEX_SECTION section, PostingListEntry& entry) const{
+    switch(section){
+    case INDEX_SECTION_DOC_DATA:
+        entry.size = m_size;
+        entry.positionsCount = m_positionsCount;
+        entry.maxTf = m_maxTf;
+        entry.reserved = 0;
+        entry.docDataSize = m_docData.size();
+        entry.docDataOffset = writer.write(m_docData.data(), m_docData.size());
+        break;
+    case INDEX_SECTION_POSITION_DATA:
+        entry.positionDataSize = m_positionData.size();
+        entry.positionDataOffset = writer.write(m_positionData.data(), m_positionData.size());
+        break;
+    case INDEX_SECTION_SKIPS:
+        entry.skipsCount = m_skips.size();
+        entry.skipsOffset = writer.write(m_skips.data(), m_skips.size() * sizeof(SkipEntry));
+        break;
+    case INDEX_SECTION_IMPACTS:
+        entry.impactsCount = m_impacts.size();
+        entry.impactsOffset = writer.write(m_impacts.data(), m_impacts.size() * sizeof(IMPACT));
+        break;
+    default:
+        break;
     }
 }
 
+bool CompactPostingList::load(const MappedFile& file, const PostingListEntry& entry){
+    const unsigned char* docData = file.array<unsigned char>(entry.docDataOffset, entry.docDataSize);
+    const unsigned char* positionData = file.array<unsigned char>(entry.positionDataOffset, entry.positionDataSize);
+    const SkipEntry* skips = file.array<SkipEntry>(entry.skipsOffset, entry.skipsCount);
+    const IMPACT* impacts = file.array<IMPACT>(entry.impactsOffset, entry.impactsCount);
 
-void SearchEngine::printIndex(bool includePostings){
-    m_index.print(includePostings);
+    if(docData == NULL || positionData == NULL || skips == NULL || impacts == NULL)
+        return false;
+
+    m_size = entry.size;
+    m_positionsCount = entry.positionsCount;
+    m_maxTf = entry.maxTf;
+    m_docData.map(docData, entry.docDataSize);
+    m_positionData.map(positionData, entry.positionDataSize);
+    m_skips.map(skips, entry.skipsCount);
+    m_impacts.map(impacts, entry.impactsCount);
+    return true;
 }
 
-void SearchEngine::buildFromFile(string xmlFilePath){
-    ifstream inFile;
-    string token;
-    unsigned long docID = 0;
-    unsigned long termPos = 0;
-    TextDocument* pTextDoc = NULL;
-    string space = SPACE_STR;
-    string closing_bracket;
+/**
+ *  @brief orders postings (impact, docID) by decreasing impact and then by docID
+ */
+static bool impactOrderLess(const pair<IMPACT, unsigned int>& p1, const pair<IMPACT, unsigned int>& p2){
+    if(p1.first != p2.first)
+        return p1.first > p2.first;
+    return p1.second < p2.second;
+}
 
-    inFile.open(xmlFilePath.c_str());
-    if (!inFile) {
-        cout << "Unable to open file";
-        exit(1); // terminate with error
+void ImpactOrderedList::build(const CompactPostingList& postings){
+    vector< pair<IMPACT, unsigned int> > entries;
+
+    for(PostingCursor cursor(&postings); cursor.valid(); cursor.next()){
+        if(cursor.docID() >= FIRST_DOC_ID)
+            entries.push_back(pair<IMPACT, unsigned int>(cursor.impact(), cursor.docID()));
     }
-    
-    while (inFile >> token) {
-    
-        if(token == XML_TAG_DOC_OPEN){
-            inFile >> docID;
-            assert(docID != 0);
-  
-            inFile >> closing_bracket;
-            assert (closing_bracket == ">");
+    sort(entries.begin(), entries.end(), impactOrderLess);
 
-            pTextDoc = new TextDocument(docID);
-        }
-        else if( token == XML_TAG_DOC_CLOSE){
-            m_collectionDocIDs.push_back(docID);
-            m_collection.push_back(pTextDoc);
+    m_segments.clear();
+    m_data.clear();
 
-            docID = 0; // clear the ID to ensure next document will properly contain an ID.
-            pTextDoc = NULL;
-            termPos = 0;
+    unsigned int docGaps[POSTING_BLOCK_SIZE];
+    unsigned int blockSize = 0;
+    unsigned int prevDocID = 0;
+
+    for(unsigned long i=0; i < entries.size(); i++){
+        if(i == 0 || entries[i].first != entries[i-1].first){
+            // first posting of a new segment
+            ImpactSegment segment;
+            segment.impact = entries[i].first;
+            segment.count = 0;
+            segment.offset = m_data.size();
+            m_segments.push_back(segment);
+            prevDocID = 0;
         }
-        else if (docID != 0){
-            termPos++; // increment by one to get position of this new term
-            // we are reading in the document, token by token
-            pTextDoc->appendToBody(token);
-            pTextDoc->appendToBody(space);
-            m_index.addText(token, docID, termPos);
+
+        docGaps[blockSize++] = entries[i].second - prevDocID;
+        prevDocID = entries[i].second;
+        m_segments.back().count++;
+
+        if(blockSize == POSTING_BLOCK_SIZE || i + 1 == entries.size() || entries[i+1].first != entries[i].first){
+            streamVByteEncode(docGaps, blockSize, m_data);
+            blockSize = 0;
         }
     }
-    
-    inFile.close();  
+    m_data.resize(m_data.size() + STREAM_VBYTE_PADDING, 0);
+
+    // release unused capacity, the list won't change until next build
+    vector<unsigned char>(m_data).swap(m_data);
+    vector<ImpactSegment>(m_segments).swap(m_segments);
 }
 
-void SearchEngine::buildFromSquadData(string jsonFilePath, bool tokenizeCollection){
-    ifstream inFile;
-    string token;
-    unsigned long docID = 0;
-    unsigned long termPos = 0;
-    TextDocument* pTextDoc = NULL;
-    string closing_bracket;
-    size_t docBegin = 0, pos;
-    unsigned long biggestDocSize = 0;
-    string space = SPACE_STR;
-    ofstream tokenizedDocsFile;
-    bool processingQuestion = false, processingAnswer =false;
-    unsigned long posUnused = 0;
-    unsigned long fakeDocID = 0;
+unsigned int ImpactOrderedList::decodeSegment(unsigned int segment, unsigned int maxCount, unsigned int* docIDs) const{
+    const ImpactSegment& entry = m_segments[segment];
+    const unsigned char* data = m_data.data() + entry.offset;
+    unsigned int count = maxCount < entry.count ? maxCount : entry.count;
+    unsigned int lastDocID = 0;
 
-    if(tokenizeCollection)
-    {
-        string tokenizedDocPath = jsonFilePath + "tokenized";
-        tokenizedDocsFile.open(tokenizedDocPath);
-    
-        if (!tokenizedDocsFile) {
-            cout << "Unable to open file: " + tokenizedDocPath;
-            exit(1); // terminate with error
-        }
-    }
+    for(unsigned int decoded = 0; decoded < count; decoded += POSTING_BLOCK_SIZE){
+        unsigned int blockSize = entry.count - decoded < POSTING_BLOCK_SIZE ? entry.count - decoded : POSTING_BLOCK_SIZE;
 
-    inFile.open(jsonFilePath.c_str());
-    if (!inFile) {
-        cout << "Unable to open file";
-        exit(1); // terminate with error
+        data = streamVByteDecodeDelta(data, blockSize, docIDs + decoded, lastDocID);
+        lastDocID = docIDs[decoded + blockSize - 1];
     }
-    
-    string line;
-    vector<string> tokens;
+    return count;
+}
 
-    while( getline(inFile, line) ) {
+PostingCursor::PostingCursor(const CompactPostingList* list):
+    m_list(list),
+    m_docData(NULL),
+    m_positionData(NULL),
+    m_index(0),
+    m_size(0),
+    m_block(0),
+    m_shallowBlock(0),
+    m_blockPos(0),
+    m_blockSize(0),
+    m_positionsToSkip(0),
+    m_positionsDecoded(false),
+    m_deletedDocs(NULL){
+    init(list ? list->m_deletedDocs : NULL);
+}
 
-        stringstream singleLineText( line );
+PostingCursor::PostingCursor(const CompactPostingList* list, const DeletedDocs* deletedDocs):
+    m_list(list),
+    m_docData(NULL),
+    m_positionData(NULL),
+    m_index(0),
+    m_size(0),
+    m_block(0),
+    m_shallowBlock(0),
+    m_blockPos(0),
+    m_blockSize(0),
+    m_positionsToSkip(0),
+    m_positionsDecoded(false),
+    m_deletedDocs(NULL){
+    init(deletedDocs);
+}
 
-        while (singleLineText >> token) {
+void PostingCursor::init(const DeletedDocs* deletedDocs){
+    const CompactPostingList* list = m_list;
 
-#if 0
-            pos = token.find("unives");
-            if(pos != std::string::npos)
-            {
-                int x = 0;
-                x = 9;
-            }
-#endif
+    if(list && !list->m_parts.empty()){
+        // view of several lists: the number of combined postings passed by seek() isn't known, 
+        // so the cursor is valid until combineParts() finds all the lists passed
+        for(unsigned long i = 0; i < list->m_parts.size(); i++)
+            m_partCursors.push_back(PostingCursor(list->m_parts[i]));
+        m_size = ~0UL;
 
-            docBegin = token.find(JSON_TAG_DOC_OPEN);
-            if(docBegin == 0 || docBegin == 1){
-                docID++;
-    
-                pTextDoc = new TextDocument(docID);
+        for(unsigned int i = 0; i < m_partCursors.size(); i++)
+            pushPart(i);
+        combineParts();
+    }
+    else if(list && list->m_size > 0){
+        m_docData = list->m_docData.data();
+        m_positionData = list->m_positionData.data();
+        m_size = list->m_size;
 
-                if(tokenizeCollection)
-                    tokenizedDocsFile << token << " \"";
-            }
-            else if( pTextDoc && token.length() >= 2 &&
-                    token.rfind(JSON_TAG_DOC_CLOSE) == token.length()-2 &&
-                    token[token.length()-3] != '\\'){
-                
-                termPos++; // increment by one to get position of this new term
-                // we are reading in the document, token by token
-                pTextDoc->appendToBody(token);
-                pTextDoc->appendToBody(space);
-                m_index.addText(token, docID, termPos);
-                
-                m_collectionDocIDs.push_back(docID);
-                m_collection.push_back(pTextDoc);
+        decodeBlock(0);
 
-                if(biggestDocSize < pTextDoc->length())
-                    biggestDocSize = pTextDoc->length();
+        // lists of segments without deletions are read with no extra check per posting
+        if(deletedDocs != NULL && deletedDocs->count() > 0){
+            m_deletedDocs = deletedDocs;
+            skipDeleted();
+        }
+    }
+}
 
-                pTextDoc = NULL;
-                termPos = 0;
+void PostingCursor::skipDeleted(){
+    while(m_index < m_size && m_deletedDocs->contains(m_docIDs[m_blockPos]))
+        nextPosting();
+}
 
-                if(tokenizeCollection){
-                    tokens = Tokenizer::singleton().tokenize(token);
-                    for(int i = 0; i < tokens.size(); i++)
-                        tokenizedDocsFile << tokens[i] << " ";  
+/**
+ *  @brief orders lists of a view by the docIDs of their cursors, the list with the lowest docID 
+ *         on top of the heap (and of lists at the same document, the first one)
+ */
+class PartGreater{
+public:
+    explicit PartGreater(const vector<PostingCursor>& cursors): m_cursors(cursors){}
 
-                    if(token.find(".") != std::string::npos)
-                        tokenizedDocsFile << ".";
-                    tokenizedDocsFile << JSON_TAG_DOC_CLOSE << " ";
-                }
-            }
-            else if (pTextDoc){
+    bool operator()(unsigned int part1, unsigned int part2) const{
+        unsigned int docID1 = m_cursors[part1].docID(), docID2 = m_cursors[part2].docID();
+        return docID1 > docID2 || (docID1 == docID2 && part1 > part2);
+    }
+
+private:
+    const vector<PostingCursor>& m_cursors;
+};
+
+void PostingCursor::pushPart(unsigned int part){
+    if(m_partCursors[part].valid()){
+        m_partHeap.push_back(part);
+        push_heap(m_partHeap.begin(), m_partHeap.end(), PartGreater(m_partCursors));
+    }
+}
+
+void PostingCursor::combineParts(){
+    m_currentParts.clear();
+    if(m_partHeap.empty()){
+        m_index = m_size;
+        return;
+    }
+
+    // lists at the lowest docID are taken off the heap until the cursor moves past it
+    unsigned int docID = m_partCursors[m_partHeap.front()].docID();
+    unsigned int tf = 0;
+    while(!m_partHeap.empty() && m_partCursors[m_partHeap.front()].docID() == docID){
+        pop_heap(m_partHeap.begin(), m_partHeap.end(), PartGreater(m_partCursors));
+        m_currentParts.push_back(m_partHeap.back());
+        m_partHeap.pop_back();
+        tf += m_partCursors[m_currentParts.back()].tf();
+    }
+    m_docIDs[0] = docID;
+    m_tfs[0] = tf;
+    m_blockSize = 1;
+    m_blockPos = 0;
+    m_positionsDecoded = false;
+}
+
+unsigned int PostingCursor::partsBlockLastDocID() const{
+    // postings of every list up to the end of the nearest block are within the lists' current blocks
+    unsigned int lastDocID = MAX_DOC_ID;
+    for(unsigned long i = 0; i < m_partCursors.size(); i++){
+        if(m_partCursors[i].blockLastDocID() < lastDocID)
+            lastDocID = m_partCursors[i].blockLastDocID();
+    }
+    return lastDocID;
+}
+
+unsigned int PostingCursor::partsBlockMaxTf() const{
+    unsigned int maxTf = 0;
+    for(unsigned long i = 0; i < m_partCursors.size(); i++)
+        maxTf += m_partCursors[i].blockMaxTf();
+    return maxTf;
+}
+
+unsigned int PostingCursor::partsImpact() const{
+    unsigned int impact = 0;
+    for(unsigned long i = 0; i < m_currentParts.size(); i++)
+        impact += m_partCursors[m_currentParts[i]].impact();
+    return impact;
+}
+
+const POSITIONS_LIST& PostingCursor::partsPositions(){
+    if(!m_positionsDecoded){
+        m_positions.clear();
+        for(unsigned long i = 0; i < m_currentParts.size(); i++){
+            const POSITIONS_LIST& positions = m_partCursors[m_currentParts[i]].positions();
+            m_positions.insert(m_positions.end(), positions.begin(), positions.end());
+        }
+        if(m_currentParts.size() > 1)
+            sort(m_positions.begin(), m_positions.end());
+        m_positionsDecoded = true;
+    }
+    return m_positions;
+}
+
+void PostingCursor::decodeBlock(unsigned int lastDocID){
+    if(!m_partCursors.empty()){
+        // lists of a view at the previous document move past it
+        for(unsigned long i = 0; i < m_currentParts.size(); i++){
+            m_partCursors[m_currentParts[i]].next();
+            pushPart(m_currentParts[i]);
+        }
+        combineParts();
+        return;
+    }
+
+    m_blockSize = m_size - m_index < POSTING_BLOCK_SIZE ? m_size - m_index : POSTING_BLOCK_SIZE;
+    m_blockPos = 0;
+
+    m_docData = streamVByteDecodeDelta(m_docData, m_blockSize, m_docIDs, lastDocID);
+    m_docData = streamVByteDecode(m_docData, m_blockSize, m_tfs);
+}
+
+/**
+ *  @brief orders skip entries by docID
+ */
+static bool skipLess(const SkipEntry& skip, unsigned int docID){
+    return skip.lastDocID < docID;
+}
+
+unsigned long PostingCursor::findBlock(unsigned long from, unsigned int target) const{
+    const SkipEntry* skips = m_list->m_skips.data();
+    unsigned long blocksCount = m_list->m_skips.size();
+    unsigned long low = from;
+    unsigned long probe = low;
+    unsigned long step = 1;
+
+    while(probe < blocksCount && skips[probe].lastDocID < target){
+        low = probe + 1;
+        probe += step;
+        step *= 2;
+    }
+    unsigned long high = probe < blocksCount ? probe + 1 : blocksCount;
+    return lower_bound(skips + low, skips + high, target, skipLess) - skips;
+}
+
+void PostingCursor::shallowAdvance(unsigned int target){
+    if(!m_partCursors.empty()){
+        for(unsigned long i = 0; i < m_partCursors.size(); i++)
+            m_partCursors[i].shallowAdvance(target);
+        return;
+    }
+
+    if(m_shallowBlock < m_block)
+        m_shallowBlock = m_block;
+
+    if(m_shallowBlock < m_list->m_skips.size() && m_list->m_skips[m_shallowBlock].lastDocID < target)
+        m_shallowBlock = findBlock(m_shallowBlock + 1, target);
+}
+
+void PostingCursor::seek(unsigned int target){
+    if(!m_partCursors.empty()){
+        // only the lists behind the target move
+        for(unsigned long i = 0; i < m_currentParts.size(); i++){
+            m_partCursors[m_currentParts[i]].advance(target);
+            pushPart(m_currentParts[i]);
+        }
+        while(!m_partHeap.empty() && m_partCursors[m_partHeap.front()].docID() < target){
+            pop_heap(m_partHeap.begin(), m_partHeap.end(), PartGreater(m_partCursors));
+            unsigned int part = m_partHeap.back();
+            m_partHeap.pop_back();
+            m_partCursors[part].advance(target);
+            pushPart(part);
+        }
+        combineParts();
+        return;
+    }
+
+    const MappedArray<SkipEntry>& skips = m_list->m_skips;
+
+    if(skips[m_block].lastDocID < target){
+        // target is past the current block - find the first block which may contain it
+        unsigned long block = findBlock(m_block + 1, target);
+
+        if(block == skips.size()){
+            m_index = m_size; // all documents are smaller than the target
+            return;
+        }
+
+        m_block = block;
+        m_index = block * POSTING_BLOCK_SIZE;
+        m_docData = m_list->m_docData.data() + skips[block].docOffset;
+        m_positionData = m_list->m_positionData.data() + skips[block].positionOffset;
+        m_positionsToSkip = 0;
+        m_positionsDecoded = false;
+        decodeBlock(skips[block - 1].lastDocID); // block > 0 here
+    }
+
+    // target is in the decoded block
+    unsigned int pos = lower_bound(m_docIDs + m_blockPos, m_docIDs + m_blockSize, target) - m_docIDs;
+
+    if(pos > m_blockPos){
+        // positions of the passed postings will have to be skipped
+        if(m_positionsDecoded)
+            m_positionsDecoded = false;
+        else
+            m_positionsToSkip += m_tfs[m_blockPos];
+
+        for(unsigned int i = m_blockPos + 1; i < pos; i++)
+            m_positionsToSkip += m_tfs[i];
+
+        m_index += pos - m_blockPos;
+        m_blockPos = pos;
+    }
+
+    if(m_deletedDocs != NULL)
+        skipDeleted();
+}
+
+const POSITIONS_LIST& PostingCursor::positions(){
+    if(!m_partCursors.empty())
+        return partsPositions();
+
+    if(!m_positionsDecoded){
+        m_positionData = vbyteSkip(m_positionData, m_positionsToSkip);
+        m_positionsToSkip = 0;
+
+        unsigned int tf = m_tfs[m_blockPos];
+        m_positions.resize(tf);
+        unsigned int gap;
+        unsigned long pos = 0;
+        for(unsigned int i = 0; i < tf; i++){
+            m_positionData = vbyteDecode(m_positionData, gap);
+            pos += gap;
+            m_positions[i] = pos;
+        }
+        m_positionsDecoded = true;
+    }
+    return m_positions;
+}
+
+void DocumentBatch::addDocument(unsigned long docID, const vector<string>& tokens){
+    m_docIDs.push_back(docID);
+    m_tokens.push_back(tokens);
+}
+
+void DocumentBatch::invert(Tokenizer& tokenizer){
+    string space = SPACE_STR;
+
+    for(unsigned long i = 0; i < m_docIDs.size(); i++){
+        unsigned long docID = m_docIDs[i];
+        unsigned long termPos = 0;
+        TextDocument* pTextDoc = new TextDocument(docID);
+
+        for(unsigned long k = 0; k < m_tokens[i].size(); k++){
+            string& token = m_tokens[i][k];
+
+            termPos++; // increment by one to get position of this new term
+            pTextDoc->appendToBody(token);
+            pTextDoc->appendToBody(space);
+
+            // terms of the token are positioned as Index::addText() positions them
+            vector<string> terms = tokenizer.tokenize(token);
+            for(unsigned int t = 0; t < terms.size(); t++){
+                unsigned int termID = m_dictionary.insert(terms[t]);
+                if(termID == m_postings.size())
+                    m_postings.push_back(POSTING_LIST());
+
+                POSTING_LIST& postings = m_postings[termID];
+                POSTING_LIST::iterator it = postings.end();
+                if(postings.empty() || (--it)->first != docID)
+                    it = postings.insert(postings.end(), POSTING_LIST::value_type(docID, Posting()));
+
+                Posting& posting = it->second;
+                posting.docID = docID;
+                posting.positions.push_back(termPos);
+                posting.tf++;
+
+                if(t > 0)
+                    termPos++;
+            }
+        }
+
+        m_documents.push_back(pTextDoc);
+        vector<string>().swap(m_tokens[i]);
+    }
+}
+
+void DocumentBatch::setTermIDs(const vector<unsigned int>& termIDs){
+    m_termIDs.resize(termIDs.size());
+    for(unsigned int i = 0; i < termIDs.size(); i++)
+        m_termIDs[i] = make_pair(termIDs[i], i);
+    sort(m_termIDs.begin(), m_termIDs.end());
+}
+
+unsigned long DocumentBatch::findTerm(unsigned int termID) const{
+    return lower_bound(m_termIDs.begin(), m_termIDs.end(), make_pair(termID, 0U)) - m_termIDs.begin();
+}
+
+void IndexSegment::build(vector<POSTING_LIST>& postings){
+    m_termIDs.clear();
+    for(unsigned int termID = 0; termID < postings.size(); termID++){
+        if(!postings[termID].empty())
+            m_termIDs.push_back(termID);
+    }
+
+    // lists are built in place, copying them would copy their data
+    m_lists.assign(m_termIDs.size(), CompactPostingList());
+    m_postingsCount = 0;
+    for(unsigned long i = 0; i < m_termIDs.size(); i++){
+        POSTING_LIST& termPostings = postings[m_termIDs[i]];
+        extendDocRange(termPostings.begin()->first, termPostings.rbegin()->first);
+        m_lists[i].build(termPostings);
+        m_lists[i].setDeletedDocs(&m_deletedDocs);
+        m_postingsCount += m_lists[i].size();
+
+        POSTING_LIST().swap(termPostings); // uncompressed postings are no longer needed
+    }
+}
+
+/**
+ *  @brief State of the parallel IndexSegment::build() shared by its threads
+ */
+class SegmentBuild{
+public:
+    SegmentBuild(IndexSegment* segment, const vector<DocumentBatch*>& batches):
+        segment(segment),
+        batches(batches),
+        nextTerm(0),
+        postingsCount(0){
+        pthread_mutex_init(&mutex, NULL);
+    }
+    ~SegmentBuild(){
+        pthread_mutex_destroy(&mutex);
+    }
+
+    IndexSegment*                 segment;
+    const vector<DocumentBatch*>& batches;
+    unsigned long                 nextTerm;         // index of the first term not taken by any thread yet
+    unsigned long                 postingsCount;    // postings of the lists built by the threads which are done
+    pthread_mutex_t               mutex;            // guards nextTerm and postingsCount
+};
+
+void IndexSegment::build(const vector<DocumentBatch*>& batches, unsigned int threadsCount){
+    m_termIDs.clear();
+    for(unsigned long b = 0; b < batches.size(); b++){
+        for(unsigned long i = 0; i < batches[b]->termsCount(); i++)
+            m_termIDs.push_back(batches[b]->termID(i));
+
+        const vector<unsigned long>& docIDs = batches[b]->docIDs();
+        for(unsigned long i = 0; i < docIDs.size(); i++)
+            extendDocRange(docIDs[i], docIDs[i]);
+    }
+    sort(m_termIDs.begin(), m_termIDs.end());
+    m_termIDs.erase(unique(m_termIDs.begin(), m_termIDs.end()), m_termIDs.end());
+
+    m_lists.assign(m_termIDs.size(), CompactPostingList());
+
+    // the calling thread builds lists too, and builds all of them if no thread can be started
+    SegmentBuild build(this, batches);
+    vector<pthread_t> threads(threadsCount > 1 ? threadsCount - 1 : 0);
+    unsigned long started = 0;
+    while(started < threads.size() && pthread_create(&threads[started], NULL, buildThread, &build) == 0)
+        started++;
+    buildThread(&build);
+    for(unsigned long i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    m_postingsCount = build.postingsCount;
+}
+
+void* IndexSegment::buildThread(void* build){
+    SegmentBuild* pBuild = static_cast<SegmentBuild*>(build);
+    IndexSegment* segment = pBuild->segment;
+    const vector<DocumentBatch*>& batches = pBuild->batches;
+    unsigned long postingsCount = 0;
+    vector<unsigned long> positions(batches.size());
+    POSTING_LIST postings;
+
+    for(;;){
+        pthread_mutex_lock(&pBuild->mutex);
+        unsigned long from = pBuild->nextTerm;
+        if(from < segment->m_termIDs.size())
+            pBuild->nextTerm += INDEX_MERGE_CHUNK;
+        pthread_mutex_unlock(&pBuild->mutex);
+
+        if(from >= segment->m_termIDs.size())
+            break;
+        unsigned long to = min(from + INDEX_MERGE_CHUNK, static_cast<unsigned long>(segment->m_termIDs.size()));
+
+        // terms of the batches are ordered by index term IDs, as those of the segment
+        for(unsigned long b = 0; b < batches.size(); b++)
+            positions[b] = batches[b]->findTerm(segment->m_termIDs[from]);
+
+        for(unsigned long i = from; i < to; i++){
+            unsigned int termID = segment->m_termIDs[i];
+
+            postings.clear();
+            for(unsigned long b = 0; b < batches.size(); b++){
+                if(positions[b] == batches[b]->termsCount() || batches[b]->termID(positions[b]) != termID)
+                    continue;
+
+                POSTING_LIST& batchPostings = batches[b]->postings(positions[b]++);
+                if(postings.empty()){
+                    postings.swap(batchPostings);
+                    continue;
+                }
+
+                // posting of a document already present gets tf and positions added, as in Index::addTerm()
+                for(POSTING_LIST::iterator it = batchPostings.begin(); it != batchPostings.end(); it++){
+                    Posting& posting = postings.insert(postings.end(), POSTING_LIST::value_type(it->first, Posting()))->second;
+                    posting.docID = it->first;
+                    posting.tf += it->second.tf;
+                    posting.positions.insert(posting.positions.end(), it->second.positions.begin(), it->second.positions.end());
+                }
+                POSTING_LIST().swap(batchPostings);
+            }
+
+            segment->m_lists[i].build(postings);
+            segment->m_lists[i].setDeletedDocs(&segment->m_deletedDocs);
+            postingsCount += segment->m_lists[i].size();
+        }
+    }
+
+    pthread_mutex_lock(&pBuild->mutex);
+    pBuild->postingsCount += postingsCount;
+    pthread_mutex_unlock(&pBuild->mutex);
+    return NULL;
+}
+
+void IndexSegment::merge(const vector<IndexSegment*>& segments){
+    m_termIDs.clear();
+    for(unsigned long k = 0; k < segments.size(); k++){
+        m_termIDs.insert(m_termIDs.end(), segments[k]->m_termIDs.begin(), segments[k]->m_termIDs.end());
+        extendDocRange(segments[k]->m_firstDocID, segments[k]->m_lastDocID);
+    }
+    sort(m_termIDs.begin(), m_termIDs.end());
+    m_termIDs.erase(unique(m_termIDs.begin(), m_termIDs.end()), m_termIDs.end());
+
+    m_lists.assign(m_termIDs.size(), CompactPostingList());
+    m_postingsCount = 0;
+    POSTING_LIST postings;
+    for(unsigned long i = 0; i < m_termIDs.size(); i++){
+        postings.clear();
+        for(unsigned long k = 0; k < segments.size(); k++){
+            const CompactPostingList* list = segments[k]->find(m_termIDs[i]);
+            if(list != NULL)
+                list->decode(postings, &segments[k]->m_purgedDocs);
+        }
+        m_lists[i].build(postings);
+        m_lists[i].setDeletedDocs(&m_deletedDocs);
+        m_postingsCount += m_lists[i].size();
+    }
+}
+
+bool IndexSegment::load(const MappedFile& file, const PostingListEntry* entries, unsigned long termsCount){
+    bool valid = true;
+
+    // finding the range would read the lists of all the terms, instead of those the queries touch
+    extendDocRange(0, MAX_DOC_ID);
+    m_termIDs.resize(termsCount);
+    m_lists.assign(termsCount, CompactPostingList());
+    m_postingsCount = 0;
+    for(unsigned long termID = 0; termID < termsCount; termID++){
+        m_termIDs[termID] = termID;
+        valid = m_lists[termID].load(file, entries[termID]) && valid;
+        m_lists[termID].setDeletedDocs(&m_deletedDocs);
+        m_postingsCount += m_lists[termID].size();
+    }
+    return valid;
+}
+
+CompactPostingList* IndexSegment::find(unsigned int termID){
+    vector<unsigned int>::iterator it = lower_bound(m_termIDs.begin(), m_termIDs.end(), termID);
+    if(it == m_termIDs.end() || *it != termID || m_lists[it - m_termIDs.begin()].size() == 0)
+        return NULL;
+    return &m_lists[it - m_termIDs.begin()];
+}
+
+unsigned long IndexSegment::documentTerms(unsigned int docID, vector<unsigned int>& termIDs) const{
+    unsigned long length = 0;
+    for(unsigned long i = 0; i < m_lists.size(); i++){
+        if(m_lists[i].size() == 0 || m_lists[i].lastDocID() < docID)
+            continue;
+
+        PostingCursor cursor(&m_lists[i]);
+        cursor.advance(docID);
+        if(cursor.valid() && cursor.docID() == docID){
+            termIDs.push_back(m_termIDs[i]);
+            length += cursor.tf();
+        }
+    }
+    return length;
+}
+
+unsigned long IndexSegment::memoryUsage() const{
+    unsigned long memoryUsage = 0;
+    for(unsigned long i = 0; i < m_lists.size(); i++)
+        memoryUsage += m_lists[i].memoryUsage();
+    return memoryUsage;
+}
+
+Index::~Index(){
+    stopMerges();
+
+    for(unsigned long i = 0; i < m_completedMerges.size(); i++)
+        delete m_completedMerges[i].second;
+    for(unsigned long i = 0; i < m_segments.size(); i++)
+        delete m_segments[i];
+    pthread_cond_destroy(&m_segmentsChanged);
+    pthread_mutex_destroy(&m_segmentsMutex);
+    delete m_file;
+}
+
+void Index::addTerm(string& term, unsigned long& docID, unsigned long& pos){
+    // single dictionary lookup, inserts the term if this is its first occurrence
+    unsigned int termID = m_dictionary.insert(term);
+
+    if(termID == m_postings.size()){
+        // new term, grow per-term arrays
+        m_postings.push_back(POSTING_LIST());
+        m_df.owned().push_back(0);
+    }
+
+    if(m_memoryBudget > 0){
+        if(termID >= m_runBuffers.size())
+            m_runBuffers.resize(termID + 1);
+
+        vector<unsigned char>& buffer = m_runBuffers[termID];
+        unsigned long capacity = buffer.capacity();
+        vbyteEncode(docID, buffer);
+        vbyteEncode(pos, buffer);
+        m_runMemory += buffer.capacity() - capacity;
+
+        // occurrences of a term in a row are recorded once, others may repeat it
+        vector<unsigned int>& termIDs = bufferedTerms(docID);
+        if(termIDs.empty() || termIDs.back() != termID){
+            capacity = termIDs.capacity();
+            termIDs.push_back(termID);
+            m_runMemory += (termIDs.capacity() - capacity) * sizeof(unsigned int);
+        }
+        return;
+    }
+
+    POSTING_LIST& postings = m_postings[termID];
+    POSTING_LIST::iterator it = postings.end();
+
+    // documents are indexed one after another, so the posting is normally the last one in the list
+    if(postings.empty() || (--it)->first != docID){
+        it = postings.insert(postings.end(), POSTING_LIST::value_type(docID, Posting()));
+        m_bufferedPostings++;
+        bufferedTerms(docID).push_back(termID);
+    }
+
+    Posting& posting = it->second;
+    posting.docID = docID;
+    posting.positions.push_back(pos);
+    posting.tf++;
+}
+
+vector<unsigned int>& Index::bufferedTerms(unsigned long docID){
+    // documents are indexed one after another, so the document is normally the last one
+    map<unsigned long, vector<unsigned int> >::iterator it = m_bufferedDocs.end();
+    if(m_bufferedDocs.empty() || (--it)->first != docID)
+        it = m_bufferedDocs.insert(m_bufferedDocs.end(), make_pair(docID, vector<unsigned int>()));
+    return it->second;
+}
+
+void Index::addText(string& text, unsigned long& docID, unsigned long& pos){
+    vector<string> tokens = Tokenizer::singleton().tokenize(text);
+ 
+    for( unsigned int i = 0; i < tokens.size(); i++){
+        addTerm(tokens[i], docID, pos);
+
+        if(i > 0)
+            pos++; // increment position for each new token
+    }
+}
+
+/**
+ *  @brief orders term IDs alphabetically by their terms
+ */
+class TermIDLess{
+public:
+    explicit TermIDLess(const TermDictionary& dictionary): m_dictionary(dictionary){}
+
+    bool operator()(unsigned int id1, unsigned int id2) const{
+        return m_dictionary.term(id1) < m_dictionary.term(id2);
+    }
+
+private:
+    const TermDictionary& m_dictionary;
+};
+
+void Index::print(bool includePostings){
+ //   cout << "Index contents: " << endl;
+
+    // print terms in alphabetical order
+    vector<unsigned int> termIDs(m_dictionary.size());
+    for(unsigned int i = 0; i < termIDs.size(); i++)
+        termIDs[i] = i;
+    sort(termIDs.begin(), termIDs.end(), TermIDLess(m_dictionary));
+
+    for(unsigned int i = 0; i < termIDs.size(); i++)
+        printTerm(termIDs[i], includePostings);
+}
+
+void Index::printTerm(unsigned int termID, bool includePostings){
+    const CompactPostingList& postings = *m_termPostings[termID];
+
+    cout << "[" << m_dictionary.term(termID) << ": " << m_df[termID] << "]";
+
+    if(includePostings){
+        unsigned int index = 0;
+        cout << "->";
+        for(PostingCursor cursor(&postings); cursor.valid(); cursor.next()){
+            Posting posting;
+            posting.docID = cursor.docID();
+            posting.tf = cursor.tf();
+            posting.positions = cursor.positions();
+            if(index++ > 0)
+                cout << ",";
+            posting.print();
+        }
+    }
+    cout << endl;
+}
+
+void Index::printStats(){
+    unsigned long postingsCount = 0, positionsCount = 0;
+    unsigned long uncompressedSize = 0, compressedSize = 0;
+
+    for(unsigned int termID = 0; termID < m_termPostings.size(); termID++){
+        const CompactPostingList& postings = *m_termPostings[termID];
+
+        postingsCount += postings.size();
+        positionsCount += postings.positionsCount();
+        uncompressedSize += postings.uncompressedSize();
+        compressedSize += postings.memoryUsage();
+    }
+
+    cout << "Terms: " << m_dictionary.size() << endl;
+    cout << "Postings: " << postingsCount << endl;
+    cout << "Positions: " << positionsCount << endl;
+    cout << "Postings size, uncompressed: " << uncompressedSize << " bytes" << endl;
+    cout << "Postings size, compressed: " << compressedSize << " bytes";
+    if(compressedSize > 0)
+        cout << " (" << static_cast<double>(uncompressedSize) / compressedSize << "x smaller)";
+    cout << endl;
+
+    // measure how fast docIDs and tfs are decoded by a full scan of all posting lists
+    unsigned long checksum = 0;
+    clock_t start = clock();
+    for(unsigned int termID = 0; termID < m_termPostings.size(); termID++){
+        for(PostingCursor cursor(m_termPostings[termID]); cursor.valid(); cursor.next())
+            checksum += cursor.docID() + cursor.tf();
+    }
+    double seconds = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+    cout << "Postings decoding (" << streamVByteDecoderName() << "): ";
+    if(seconds > 0)
+        cout << 2 * postingsCount / seconds / 1000000 << " million integers/s";
+    else
+        cout << "too fast to measure";
+    cout << " (checksum " << checksum << ")" << endl;
+
+    // measure precision loss of the impacts, relative to the exact weights
+    for(unsigned int termID = 0; termID < m_termPostings.size(); termID++)
+        updateTermWeights(termID);
+    double errorSum = 0.0, maxError = 0.0;
+    unsigned long weightsCount = 0;
+    for(unsigned int termID = 0; termID < m_termPostings.size() && m_impactScale > 0; termID++){
+        for(PostingCursor cursor(m_termPostings[termID]); cursor.valid(); cursor.next()){
+            double weight = this->weight(termID, cursor.tf(), cursor.docID());
+            if(weight <= 0)
+                continue;
+
+            double error = fabs(cursor.impact() / m_impactScale - weight) / weight;
+            errorSum += error;
+            if(error > maxError)
+                maxError = error;
+            weightsCount++;
+        }
+    }
+    cout << "Ranking model: " << (m_rankingModel == RANKING_MODEL_BM25 ? "BM25" : "TF.IDF");
+    if(m_rankingModel == RANKING_MODEL_BM25)
+        cout << ", document lengths: " << m_lengthCodes.size() << " bytes";
+    cout << endl;
+    cout << "Impacts: " << postingsCount * sizeof(IMPACT) << " bytes (" << 8 * sizeof(IMPACT) << " bits per posting), weight error " 
+         << (weightsCount > 0 ? 100.0 * errorSum / weightsCount : 0.0) << "% mean, " << 100.0 * maxError << "% max" << endl;
+
+    if(m_pairIndex){
+        unsigned long pairPostingsCount = 0, pairIndexSize = 0;
+        for(map<pair<unsigned int, unsigned int>, CompactPostingList>::iterator it = m_pairPostings.begin(); it != m_pairPostings.end(); it++){
+            pairPostingsCount += it->second.size();
+            pairIndexSize += it->second.memoryUsage();
+        }
+        cout << "Pair index: " << m_pairPostings.size() << " of " << m_pairsCount << " adjacent pairs, " 
+             << pairPostingsCount << " postings, " << pairIndexSize << " bytes";
+        if(m_pairMemoryBudget > 0)
+            cout << " (budget " << m_pairMemoryBudget << " bytes)";
+        cout << endl;
+    }
+
+    unsigned long mergingCount = 0, deletedCount = 0;
+    pthread_mutex_lock(&m_segmentsMutex);
+    for(unsigned long i = 0; i < m_segments.size(); i++){
+        if(m_segments[i]->merging())
+            mergingCount++;
+        deletedCount += m_segments[i]->deletedDocs().count();
+    }
+    pthread_mutex_unlock(&m_segmentsMutex);
+    cout << "Segments: " << m_segments.size() << " (" << mergingCount << " being merged), segment size " << m_segmentSize << " postings" << endl;
+    cout << "Deleted documents: " << deletedCount << " (postings kept until their segments are merged)" << endl;
+    if(m_memoryBudget > 0)
+        cout << "Memory budget: " << m_memoryBudget << " bytes, " << m_runsCount << " runs spilled into " << m_spillDir << endl;
+
+    if(m_impactOrdered){
+        unsigned long impactOrderedSize = 0, segmentsCount = 0;
+        for(unsigned int termID = 0; termID < m_impactOrderedPostings.size(); termID++){
+            impactOrderedSize += m_impactOrderedPostings[termID].memoryUsage();
+            segmentsCount += m_impactOrderedPostings[termID].segmentsCount();
+        }
+        cout << "Impact-ordered postings: " << segmentsCount << " segments, " << impactOrderedSize << " bytes" << endl;
+    }
+}
+
+unsigned int Index::getTermID(const string& term) const{
+    return m_dictionary.find(term);
+}
+
+const CompactPostingList* Index::getPostings(unsigned int termID) const{
+    if(termID < m_termPostings.size()){
+        return m_termPostings[termID];
+    }
+    else{
+        return NULL;
+    }
+}
+
+void Index::endDocument(){
+    if(m_memoryBudget > 0){
+        if(m_runMemory >= m_memoryBudget)
+            spill();
+        return;
+    }
+
+    // a collection indexed from scratch is flushed by freeze(), so that its terms aren't split among segments
+    if(m_segmentSize > 0 && m_bufferedPostings >= m_segmentSize && !m_segments.empty())
+        flush();
+}
+
+void Index::flush(){
+    if(m_bufferedPostings == 0)
+        return;
+
+    // documents added to a finalized index are counted into its running statistics (see update())
+    for(map<unsigned long, vector<unsigned int> >::iterator it = m_bufferedDocs.begin(); it != m_bufferedDocs.end() && m_impactScale > 0; it++){
+        m_changedDocs.push_back(it->first);
+        if(m_rankingModel != RANKING_MODEL_BM25)
+            continue;
+
+        vector<unsigned int>& termIDs = it->second;
+        sort(termIDs.begin(), termIDs.end());
+        termIDs.erase(unique(termIDs.begin(), termIDs.end()), termIDs.end());
+        unsigned long length = 0;
+        for(unsigned long i = 0; i < termIDs.size(); i++){
+            POSTING_LIST::iterator posting = m_postings[termIDs[i]].find(it->first);
+            if(posting != m_postings[termIDs[i]].end())
+                length += posting->second.tf;
+        }
+
+        vector<unsigned char>& lengthCodes = m_lengthCodes.owned();
+        if(it->first >= lengthCodes.size())
+            lengthCodes.resize(it->first + 1, 0);
+        lengthCodes[it->first] = static_cast<unsigned char>(lengthCode(length));
+        m_lengthSum += length;
+        if(length > 0 && lengthCodes[it->first] < m_minLengthCode)
+            m_minLengthCode = lengthCodes[it->first];
+    }
+
+    IndexSegment* segment = new IndexSegment();
+    segment->build(m_postings);
+    m_bufferedPostings = 0;
+    m_bufferedDocs.clear();
+    addSegment(segment);
+}
+
+void Index::addBatches(const vector<DocumentBatch*>& batches, unsigned int threadsCount){
+    flush();    // documents added before the batches come first
+
+    // batches are mapped in the order of their documents, so new terms get the IDs addTerm() would give them
+    for(unsigned long b = 0; b < batches.size(); b++){
+        vector<unsigned int> termIDs(batches[b]->termsCount());
+        for(unsigned int i = 0; i < termIDs.size(); i++){
+            termIDs[i] = m_dictionary.insert(batches[b]->term(i));
+            if(termIDs[i] == m_postings.size()){
+                m_postings.push_back(POSTING_LIST());
+                m_df.owned().push_back(0);
+            }
+        }
+        batches[b]->setTermIDs(termIDs);
+    }
+
+    IndexSegment* segment = new IndexSegment();
+    segment->build(batches, threadsCount);
+    addSegment(segment);
+}
+
+void Index::addSegment(IndexSegment* segment){
+    for(unsigned long i = 0; i < segment->termsCount(); i++)
+        m_changedTerms.push_back(segment->termID(i));
+
+    pthread_mutex_lock(&m_segmentsMutex);
+    m_segments.push_back(segment);
+    pthread_cond_broadcast(&m_segmentsChanged);
+    pthread_mutex_unlock(&m_segmentsMutex);
+
+    // without the thread (if it can't be started) segments are only merged by mergeSegments()
+    if(!m_mergeThreadRunning)
+        m_mergeThreadRunning = pthread_create(&m_mergeThread, NULL, mergeThread, this) == 0;
+}
+
+void Index::freeze(){
+    flush();
+    completeMerges();
+
+    m_termPostings.resize(m_df.size(), &m_emptyPostings);
+
+    sort(m_changedTerms.begin(), m_changedTerms.end());
+    m_changedTerms.erase(unique(m_changedTerms.begin(), m_changedTerms.end()), m_changedTerms.end());
+    for(unsigned long i = 0; i < m_changedTerms.size(); i++)
+        updateTermPostings(m_changedTerms[i]);
+    m_changedTerms.clear();
+}
+
+void Index::update(unsigned long collectionSize){
+    if(m_impactScale == 0){
+        freeze();
+        finalize(collectionSize);
+        return;
+    }
+
+    // occurrences buffered within a memory budget (none were spilled, see runsCount()) are flushed as a segment
+    for(unsigned int termID = 0; termID < m_runBuffers.size() && m_runMemory > 0; termID++){
+        vector<unsigned char>& buffer = m_runBuffers[termID];
+        if(buffer.empty())
+            continue;
+        decodeOccurrences(buffer, m_postings[termID]);
+        m_bufferedPostings += m_postings[termID].size();
+        vector<unsigned char>().swap(buffer);
+    }
+    m_runMemory = 0;
+    flush();
+    vector<unsigned int> changedTerms(m_changedTerms);
+    sort(changedTerms.begin(), changedTerms.end());
+    changedTerms.erase(unique(changedTerms.begin(), changedTerms.end()), changedTerms.end());
+    freeze();
+
+    m_collectionSize = collectionSize;
+    if(m_rankingModel == RANKING_MODEL_BM25)
+        updateLengthNorms();
+    vector<unsigned int> maxTfs(m_termPostings.size());
+    for(unsigned int termID = 0; termID < m_termPostings.size(); termID++)
+        maxTfs[termID] = m_termPostings[termID]->maxTf();
+    updateIdf(maxTfs);
+
+    // impacts of all the terms depend on N (and the average length), updateTermWeights() brings them up to date
+    m_statisticsVersion++;
+    m_termVersions.resize(m_df.size(), 0);
+    if(m_impactOrdered)
+        m_impactOrderedPostings.resize(m_termPostings.size());
+
+    if(m_pairIndex)
+        updatePairPostings(changedTerms);
+    m_changedDocs.clear();
+}
+
+void Index::updateTermWeights(unsigned int termID){
+    if(termID >= m_termVersions.size() || m_termVersions[termID] == m_statisticsVersion)
+        return;
+
+    updateImpacts(termID);
+    if(m_impactOrdered)
+        m_impactOrderedPostings[termID].build(*m_termPostings[termID]);
+    m_termVersions[termID] = m_statisticsVersion;
+}
+
+void Index::updatePairPostings(const vector<unsigned int>& changedTerms){
+    sort(m_changedDocs.begin(), m_changedDocs.end());
+    m_changedDocs.erase(unique(m_changedDocs.begin(), m_changedDocs.end()), m_changedDocs.end());
+
+    // only pairs of two changed terms may have a posting of a changed document
+    POSTING_LIST postings;
+    for(unsigned long i = 0; i < changedTerms.size(); i++){
+        map<pair<unsigned int, unsigned int>, CompactPostingList>::iterator it = m_pairPostings.lower_bound(make_pair(changedTerms[i], 0u));
+        for(; it != m_pairPostings.end() && it->first.first == changedTerms[i]; it++){
+            if(!binary_search(changedTerms.begin(), changedTerms.end(), it->first.second))
+                continue;
+
+            // postings of the changed documents are collected from the terms again, as buildPairIndex() collects them
+            postings.clear();
+            PostingCursor cursor1(m_termPostings[it->first.first]), cursor2(m_termPostings[it->first.second]);
+            for(unsigned long k = 0; k < m_changedDocs.size(); k++){
+                unsigned int docID = static_cast<unsigned int>(m_changedDocs[k]);
+                cursor1.advance(docID);
+                cursor2.advance(docID);
+                if(!cursor1.valid() || !cursor2.valid() || cursor1.docID() != docID || cursor2.docID() != docID)
+                    continue;
+
+                const POSITIONS_LIST& positions1 = cursor1.positions();
+                const POSITIONS_LIST& positions2 = cursor2.positions();
+                for(unsigned long p = 0; p < positions1.size(); p++){
+                    if(binary_search(positions2.begin(), positions2.end(), positions1[p] + 1)){
+                        Posting& posting = postings[docID];
+                        posting.docID = docID;
+                        posting.positions.push_back(positions1[p]);
+                        posting.tf++;
+                    }
+                }
+            }
+
+            // the list is only built again if a changed document is (or was) in it
+            bool changed = !postings.empty();
+            PostingCursor lookup(&it->second);
+            for(unsigned long k = 0; k < m_changedDocs.size() && !changed; k++){
+                lookup.advance(static_cast<unsigned int>(m_changedDocs[k]));
+                changed = lookup.valid() && lookup.docID() == m_changedDocs[k];
+            }
+            if(!changed)
+                continue;
+
+            for(PostingCursor cursor(&it->second); cursor.valid(); cursor.next()){
+                if(binary_search(m_changedDocs.begin(), m_changedDocs.end(), cursor.docID()))
+                    continue;
+                Posting& posting = postings[cursor.docID()];
+                posting.docID = cursor.docID();
+                posting.tf = cursor.tf();
+                posting.positions = cursor.positions();
+            }
+            it->second.build(postings);
+        }
+    }
+}
+
+void Index::deleteDocument(unsigned long docID){
+    // the in-memory segment isn't read by queries yet, so postings of the document are just dropped from it
+    map<unsigned long, vector<unsigned int> >::iterator buffered = m_bufferedDocs.find(docID);
+    if(buffered != m_bufferedDocs.end()){
+        const vector<unsigned int>& termIDs = buffered->second;
+        for(unsigned long i = 0; i < termIDs.size(); i++){
+            if(m_postings[termIDs[i]].erase(docID) > 0)
+                m_bufferedPostings--;
+        }
+
+        // and so are its occurrences buffered within a memory budget
+        for(unsigned long i = 0; i < termIDs.size() && m_memoryBudget > 0; i++){
+            vector<unsigned char>& buffer = m_runBuffers[termIDs[i]];
+            vector<unsigned char> kept;
+            for(const unsigned char* in = buffer.data(); in < buffer.data() + buffer.size(); ){
+                unsigned int occurrenceDocID, pos;
+                in = vbyteDecode(vbyteDecode(in, occurrenceDocID), pos);
+                if(occurrenceDocID != docID){
+                    vbyteEncode(occurrenceDocID, kept);
+                    vbyteEncode(pos, kept);
+                }
+            }
+            if(kept.size() < buffer.size()){
+                m_runMemory -= buffer.capacity() - kept.capacity();
+                buffer.swap(kept);
+            }
+        }
+        if(m_memoryBudget > 0)
+            m_runMemory -= termIDs.capacity() * sizeof(unsigned int);
+        m_bufferedDocs.erase(buffered);
+    }
+
+    // runs can't be changed, those spilled so far leave the document out when they are merged
+    if(!m_runFiles.empty())
+        m_deletedRunDocs[docID] = m_runFiles.size();
+
+    // lists of the immutable segments don't change, the segments containing the document mark it as deleted
+    vector<IndexSegment*> segments;
+    for(unsigned long i = 0; i < m_segments.size(); i++){
+        if(!m_segments[i]->mayContain(docID))
+            continue;
+
+        unsigned long changedTerms = m_changedTerms.size();
+        unsigned long length = m_segments[i]->documentTerms(docID, m_changedTerms);
+        if(m_changedTerms.size() > changedTerms)
+            segments.push_back(m_segments[i]);
+        if(m_impactScale > 0)
+            m_lengthSum -= length;  // see update()
+    }
+    if(!segments.empty() && m_impactScale > 0)
+        m_changedDocs.push_back(docID);
+
+    // the merge thread copies deleted documents of the segments it merges (see IndexSegment::startMerge())
+    pthread_mutex_lock(&m_segmentsMutex);
+    for(unsigned long i = 0; i < segments.size(); i++)
+        segments[i]->deleteDocument(docID);
+    pthread_mutex_unlock(&m_segmentsMutex);
+}
+
+void Index::updateTermPostings(unsigned int termID){
+    if(termID >= m_termPostings.size())
+        return;     // term added after the last freeze(), it is updated by the next one
+
+    vector<const CompactPostingList*> parts;
+    bool deletions = false;
+    for(unsigned long i = 0; i < m_segments.size(); i++){
+        const CompactPostingList* list = m_segments[i]->find(termID);
+        if(list != NULL){
+            parts.push_back(list);
+            deletions = deletions || m_segments[i]->deletedDocs().count() > 0;
+        }
+    }
+
+    m_termViews.erase(termID);
+    if(parts.empty())
+        m_termPostings[termID] = &m_emptyPostings;
+    else if(parts.size() == 1)
+        m_termPostings[termID] = parts[0];
+    else{
+        CompactPostingList& view = m_termViews[termID];
+        view.setParts(parts);
+        m_termPostings[termID] = &view;
+    }
+
+    // size of a view counts combined postings of the documents which aren't deleted, 
+    // and that of a segment's list all its postings
+    unsigned long df = m_termPostings[termID]->size();
+    if(parts.size() == 1 && deletions){
+        df = 0;
+        for(PostingCursor cursor(parts[0]); cursor.valid(); cursor.next())
+            df++;
+    }
+    m_df.owned()[termID] = df;
+}
+
+void Index::updateImpacts(unsigned int termID){
+    vector<CompactPostingList*> parts;
+    for(unsigned long i = 0; i < m_segments.size(); i++){
+        CompactPostingList* list = m_segments[i]->find(termID);
+        if(list != NULL)
+            parts.push_back(list);
+    }
+
+    // impacts are indexed by posting, so postings of deleted documents get one too (which is never read)
+    vector<vector<IMPACT> > impacts(parts.size());
+    if(parts.size() == 1){
+        for(PostingCursor cursor(parts[0], NULL); cursor.valid(); cursor.next())
+            impacts[0].push_back(impact(weight(termID, cursor.tf(), cursor.docID())));
+    }
+    else if(parts.size() > 1){
+        vector<PostingCursor> partCursors;
+        for(unsigned long k = 0; k < parts.size(); k++)
+            partCursors.push_back(PostingCursor(parts[k], NULL));
+
+        for(PostingCursor cursor(m_termPostings[termID]); cursor.valid(); cursor.next()){
+            // the first list containing the document carries impact of the combined posting (see PostingCursor::impact())
+            unsigned int value = impact(weight(termID, cursor.tf(), cursor.docID()));
+            for(unsigned long k = 0; k < parts.size(); k++){
+                for(; partCursors[k].valid() && partCursors[k].docID() < cursor.docID(); partCursors[k].next())
+                    impacts[k].push_back(0);   // deleted document
+
+                if(partCursors[k].valid() && partCursors[k].docID() == cursor.docID()){
+                    const DeletedDocs* deletedDocs = parts[k]->deletedDocs();
+                    if(deletedDocs != NULL && deletedDocs->contains(cursor.docID()))
+                        impacts[k].push_back(0);
+                    else{
+                        impacts[k].push_back(value);
+                        value = 0;
+                    }
+                    partCursors[k].next();
+                }
+            }
+        }
+        for(unsigned long k = 0; k < parts.size(); k++)
+            impacts[k].resize(parts[k]->size(), 0);
+    }
+
+    for(unsigned long k = 0; k < parts.size(); k++)
+        parts[k]->setImpacts(impacts[k]);
+}
+
+void Index::refresh(){
+    vector<pair<vector<IndexSegment*>, IndexSegment*> > merges;
+
+    pthread_mutex_lock(&m_segmentsMutex);
+    merges.swap(m_completedMerges);
+    pthread_mutex_unlock(&m_segmentsMutex);
+
+    // documents deleted while the segments were being merged are deleted from the merged segment, 
+    // which the merge thread doesn't see until it replaces them
+    for(unsigned long i = 0; i < merges.size(); i++){
+        for(unsigned long k = 0; k < merges[i].first.size(); k++){
+            const DeletedDocs& deletedDocs = merges[i].first[k]->deletedDocs();
+            const DeletedDocs& purgedDocs = merges[i].first[k]->purgedDocs();
+
+            for(unsigned int docID = 0; docID < deletedDocs.size() && deletedDocs.count() > purgedDocs.count(); docID++){
+                vector<unsigned int> termIDs;
+                if(deletedDocs.contains(docID) && !purgedDocs.contains(docID))
+                    merges[i].second->documentTerms(docID, termIDs);
+                if(!termIDs.empty())
+                    merges[i].second->deleteDocument(docID);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&m_segmentsMutex);
+    for(unsigned long i = 0; i < merges.size(); i++){
+        const vector<IndexSegment*>& sources = merges[i].first;
+        for(unsigned long k = 0; k < sources.size(); k++)
+            m_segments.erase(find(m_segments.begin(), m_segments.end(), sources[k]));
+        m_segments.push_back(merges[i].second);
+    }
+    if(!merges.empty())
+        pthread_cond_broadcast(&m_segmentsChanged);  // merged segments may be merged further
+    pthread_mutex_unlock(&m_segmentsMutex);
+
+    // the merged segments contain the same terms as the segments they replace
+    for(unsigned long i = 0; i < merges.size(); i++){
+        IndexSegment* merged = merges[i].second;
+        for(unsigned long k = 0; k < merged->termsCount(); k++){
+            updateTermPostings(merged->termID(k));
+            if(m_impactScale > 0 && merged->termID(k) < m_termPostings.size())
+                updateImpacts(merged->termID(k));
+        }
+    }
+    for(unsigned long i = 0; i < merges.size(); i++){
+        for(unsigned long k = 0; k < merges[i].first.size(); k++)
+            delete merges[i].first[k];
+    }
+}
+
+void Index::mergeSegments(){
+    stopMerges();
+    refresh();
+
+    // merging a single segment purges its deleted documents
+    if(m_segments.size() > 1 || (m_segments.size() == 1 && m_segments[0]->deletedDocs().count() > 0)){
+        for(unsigned long i = 0; i < m_segments.size(); i++)
+            m_segments[i]->startMerge();
+
+        IndexSegment* merged = new IndexSegment();
+        merged->merge(m_segments);
+
+        vector<IndexSegment*> sources(1, merged);
+        sources.swap(m_segments);   // no merge thread to guard against
+        for(unsigned int termID = 0; termID < m_termPostings.size(); termID++){
+            updateTermPostings(termID);
+            if(m_impactScale > 0)
+                updateImpacts(termID);
+        }
+
+        for(unsigned long i = 0; i < sources.size(); i++)
+            delete sources[i];
+    }
+}
+
+bool Index::selectMerge(vector<IndexSegment*>& segments){
+    // segments up to SEGMENT_MERGE_FACTOR times the segment size are in tier 0, 
+    // each next tier holds SEGMENT_MERGE_FACTOR times bigger segments
+    unsigned long segmentSize = m_segmentSize > 0 ? m_segmentSize : SEGMENT_SIZE;
+    map<unsigned int, vector<IndexSegment*> > tiers;
+
+    for(unsigned long i = 0; i < m_segments.size(); i++){
+        if(m_segments[i]->merging())
+            continue;
+
+        unsigned int tier = 0;
+        for(unsigned long size = segmentSize * SEGMENT_MERGE_FACTOR; m_segments[i]->postingsCount() >= size; size *= SEGMENT_MERGE_FACTOR)
+            tier++;
+        tiers[tier].push_back(m_segments[i]);
+    }
+
+    for(map<unsigned int, vector<IndexSegment*> >::iterator it = tiers.begin(); it != tiers.end(); it++){
+        if(it->second.size() >= SEGMENT_MERGE_FACTOR){
+            segments.assign(it->second.begin(), it->second.begin() + SEGMENT_MERGE_FACTOR);
+            for(unsigned long i = 0; i < segments.size(); i++)
+                segments[i]->startMerge();
+            return true;
+        }
+    }
+    return false;
+}
+
+void* Index::mergeThread(void* index){
+    Index* pIndex = static_cast<Index*>(index);
+    vector<IndexSegment*> segments;
+
+    pthread_mutex_lock(&pIndex->m_segmentsMutex);
+    while(!pIndex->m_stopMerging){
+        if(!pIndex->selectMerge(segments)){
+            pthread_cond_wait(&pIndex->m_segmentsChanged, &pIndex->m_segmentsMutex);
+            continue;
+        }
+        pthread_mutex_unlock(&pIndex->m_segmentsMutex);
+
+        // postings of the segments don't change, so they are read without the lock 
+        // (only impacts may be updated meanwhile, and merging doesn't read them)
+        IndexSegment* merged = new IndexSegment();
+        merged->merge(segments);
+
+        pthread_mutex_lock(&pIndex->m_segmentsMutex);
+        pIndex->m_completedMerges.push_back(make_pair(segments, merged));
+    }
+    pthread_mutex_unlock(&pIndex->m_segmentsMutex);
+    return NULL;
+}
+
+void Index::completeMerges(){
+    stopMerges();
+    refresh();
+
+    vector<IndexSegment*> segments;
+    for(;;){
+        pthread_mutex_lock(&m_segmentsMutex);
+        bool selected = selectMerge(segments);
+        pthread_mutex_unlock(&m_segmentsMutex);
+        if(!selected)
+            break;
+
+        IndexSegment* merged = new IndexSegment();
+        merged->merge(segments);
+
+        // the merged segment replaces the others the way those of the merge thread do
+        pthread_mutex_lock(&m_segmentsMutex);
+        m_completedMerges.push_back(make_pair(segments, merged));
+        pthread_mutex_unlock(&m_segmentsMutex);
+        refresh();
+    }
+}
+
+void Index::stopMerges(){
+    if(!m_mergeThreadRunning)
+        return;
+
+    pthread_mutex_lock(&m_segmentsMutex);
+    m_stopMerging = true;
+    pthread_cond_broadcast(&m_segmentsChanged);
+    pthread_mutex_unlock(&m_segmentsMutex);
+
+    pthread_join(m_mergeThread, NULL);
+    m_mergeThreadRunning = false;
+    m_stopMerging = false;
+}
+
+void Index::finalize(unsigned long collectionSize){
+    // length of a document is the sum of tfs of its postings
+    vector<unsigned long> lengths;
+    for(unsigned int termID = 0; termID < m_termPostings.size() && m_rankingModel == RANKING_MODEL_BM25; termID++){
+        const CompactPostingList* postings = m_termPostings[termID];
+        if(postings->size() > 0 && postings->lastDocID() >= lengths.size())
+            lengths.resize(static_cast<unsigned long>(postings->lastDocID()) + 1, 0);
+        for(PostingCursor cursor(postings); cursor.valid(); cursor.next())
+            lengths[cursor.docID()] += cursor.tf();
+    }
+
+    vector<unsigned int> maxTfs(m_termPostings.size());
+    for(unsigned int termID = 0; termID < m_termPostings.size(); termID++)
+        maxTfs[termID] = m_termPostings[termID]->maxTf();
+    computeWeights(collectionSize, lengths, maxTfs);
+
+    for(unsigned int termID = 0; termID < m_termPostings.size(); termID++)
+        updateImpacts(termID);
+
+    if(m_impactOrdered)
+        setImpactOrdered(true); // rebuild with the new impacts
+
+    if(m_pairIndex)
+        buildPairIndex();
+}
+
+void Index::computeWeights(unsigned long collectionSize, const vector<unsigned long>& lengths, const vector<unsigned int>& maxTfs){
+    m_collectionSize = collectionSize;
+
+    if(m_rankingModel == RANKING_MODEL_BM25){
+        m_lengthSum = 0.0;
+        m_minLengthCode = LENGTH_CODES - 1;
+        vector<unsigned char>& lengthCodes = m_lengthCodes.owned();
+        lengthCodes.resize(lengths.size());
+        for(unsigned long docID = 0; docID < lengths.size(); docID++){
+            lengthCodes[docID] = static_cast<unsigned char>(lengthCode(lengths[docID]));
+            if(docID >= FIRST_DOC_ID && lengths[docID] > 0){
+                m_lengthSum += lengths[docID];
+                if(lengthCodes[docID] < m_minLengthCode)
+                    m_minLengthCode = lengthCodes[docID];
+            }
+        }
+        updateLengthNorms();
+    }
+
+    updateIdf(maxTfs);
+
+    m_statisticsVersion++;
+    m_termVersions.assign(m_df.size(), m_statisticsVersion);
+    m_changedDocs.clear();
+}
+
+void Index::updateIdf(const vector<unsigned int>& maxTfs){
+    double N = static_cast<double>(m_collectionSize);
+    double maxWeight = 0.0;
+    vector<double>& idf = m_idf.owned();
+    idf.resize(m_df.size());
+
+    for(unsigned int termID = 0; termID < m_df.size(); termID++){
+        double df = static_cast<double>(m_df[termID]);
+        if(m_df[termID] == 0)
+            idf[termID] = 0.0;
+        else if(m_rankingModel == RANKING_MODEL_BM25)
+            idf[termID] = log(1 + (N - df + 0.5) / (df + 0.5));
+        else
+            idf[termID] = log2(N/df);
+
+        double weight = this->maxWeight(termID, maxTfs[termID]);
+        if(m_df[termID] > 0 && weight > maxWeight)
+            maxWeight = weight;
+    }
+    m_impactScale = maxWeight > 0 ? IMPACT_MAX / maxWeight : 0.0;
+}
+
+void Index::updateLengthNorms(){
+    double averageLength = m_lengthSum > 0 ? m_lengthSum / m_collectionSize : 1.0;
+    for(unsigned int code = 0; code < LENGTH_CODES; code++)
+        m_lengthNorms[code] = BM25_K1 * (1 - BM25_B + BM25_B * codeLength(code) / averageLength);
+    m_minLengthNorm = m_lengthNorms[m_minLengthCode];
+}
+
+bool Index::save(const string& path, const vector<unsigned long>& documents){
+    mergeSegments();    // a single list per term
+    for(unsigned int termID = 0; termID < termsCount(); termID++)
+        updateTermWeights(termID);
+
+    IndexFileWriter writer;
+    if(!writer.open(path))
+        return false;
+    saveTerms(writer, documents);
+
+    // posting lists of the terms, followed by those of the indexed pairs
+    vector<const CompactPostingList*> lists;
+    vector<unsigned int> pairs;
+    for(unsigned int termID = 0; termID < termsCount(); termID++)
+        lists.push_back(m_termPostings[termID]);
+    for(map<pair<unsigned int, unsigned int>, CompactPostingList>::const_iterator it = m_pairPostings.begin(); it != m_pairPostings.end(); it++){
+        pairs.push_back(it->first.first);
+        pairs.push_back(it->first.second);
+        lists.push_back(&it->second);
+    }
+    writer.beginSection(INDEX_SECTION_PAIRS);
+    writer.write(pairs.data(), pairs.size() * sizeof(unsigned int));
+
+    // each stream of all the lists is stored together, so that scans which don't need positions never read them
+    PostingListEntry emptyEntry;
+    memset(&emptyEntry, 0, sizeof(emptyEntry));
+    vector<PostingListEntry> entries(lists.size(), emptyEntry);
+    const INDEX_SECTION streams[] = {INDEX_SECTION_DOC_DATA, INDEX_SECTION_POSITION_DATA, INDEX_SECTION_SKIPS, INDEX_SECTION_IMPACTS};
+    for(unsigned int stream = 0; stream < sizeof(streams) / sizeof(streams[0]); stream++){
+        writer.beginSection(streams[stream]);
+        for(unsigned long i = 0; i < lists.size(); i++)
+            lists[i]->save(writer, streams[stream], entries[i]);
+    }
+    writer.beginSection(INDEX_SECTION_LISTS);
+    writer.write(entries.data(), entries.size() * sizeof(PostingListEntry));
+
+    return saveHeader(writer, m_pairPostings.size());
+}
+
+void Index::saveTerms(IndexFileWriter& writer, const vector<unsigned long>& documents) const{
+    // terms in ID order, and term IDs in the order of the terms, so that a loaded dictionary
+    // finds terms by binary search without building a hash table
+    string text;
+    vector<unsigned int> offsets, order(termsCount());
+    for(unsigned int termID = 0; termID < termsCount(); termID++){
+        offsets.push_back(text.size());
+        text += m_dictionary.term(termID);
+        order[termID] = termID;
+    }
+    offsets.push_back(text.size());
+    sort(order.begin(), order.end(), TermIDLess(m_dictionary));
+
+    writer.beginSection(INDEX_SECTION_TERM_TEXT);
+    writer.write(text.data(), text.size());
+    writer.beginSection(INDEX_SECTION_TERM_OFFSETS);
+    writer.write(offsets.data(), offsets.size() * sizeof(unsigned int));
+    writer.beginSection(INDEX_SECTION_TERM_ORDER);
+    writer.write(order.data(), order.size() * sizeof(unsigned int));
+    writer.beginSection(INDEX_SECTION_DF);
+    writer.write(m_df.data(), m_df.size() * sizeof(unsigned long));
+    writer.beginSection(INDEX_SECTION_IDF);
+    writer.write(m_idf.data(), m_idf.size() * sizeof(double));
+    writer.beginSection(INDEX_SECTION_LENGTH_CODES);
+    writer.write(m_lengthCodes.data(), m_lengthCodes.size());
+    writer.beginSection(INDEX_SECTION_LENGTH_NORMS);
+    if(m_rankingModel == RANKING_MODEL_BM25)
+        writer.write(m_lengthNorms, sizeof(m_lengthNorms));
+    writer.beginSection(INDEX_SECTION_DOCUMENTS);
+    writer.write(documents.data(), documents.size() * sizeof(unsigned long));
+}
+
+bool Index::saveHeader(IndexFileWriter& writer, unsigned long pairsCount) const{
+    IndexFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.rankingModel = m_rankingModel;
+    header.termsCount = termsCount();
+    header.pairsCount = pairsCount;
+    header.collectionPairsCount = m_pairsCount;
+    header.minLengthNorm = m_minLengthNorm;
+    header.impactScale = m_impactScale;
+    return writer.close(header);
+}
+
+bool Index::load(const string& path, vector<unsigned long>& documents){
+    MappedFile* file = new MappedFile();
+    if(!file->open(path)){
+        delete file;
+        return false;
+    }
+
+    const IndexFileHeader& header = file->header();
+    unsigned long termsCount = header.termsCount, pairsCount = header.pairsCount;
+    unsigned long textSize, offsetsCount, orderCount, dfCount, idfCount, lengthCodesCount, lengthNormsCount, documentsCount, pairTermsCount, listsCount;
+    const char* text = file->section<char>(INDEX_SECTION_TERM_TEXT, textSize);
+    const unsigned int* offsets = file->section<unsigned int>(INDEX_SECTION_TERM_OFFSETS, offsetsCount);
+    const unsigned int* order = file->section<unsigned int>(INDEX_SECTION_TERM_ORDER, orderCount);
+    const unsigned long* df = file->section<unsigned long>(INDEX_SECTION_DF, dfCount);
+    const double* idf = file->section<double>(INDEX_SECTION_IDF, idfCount);
+    const unsigned char* lengthCodes = file->section<unsigned char>(INDEX_SECTION_LENGTH_CODES, lengthCodesCount);
+    const double* lengthNorms = file->section<double>(INDEX_SECTION_LENGTH_NORMS, lengthNormsCount);
+    const unsigned long* docIDs = file->section<unsigned long>(INDEX_SECTION_DOCUMENTS, documentsCount);
+    const unsigned int* pairs = file->section<unsigned int>(INDEX_SECTION_PAIRS, pairTermsCount);
+    const PostingListEntry* entries = file->section<PostingListEntry>(INDEX_SECTION_LISTS, listsCount);
+
+    if(offsetsCount != termsCount + 1 || orderCount != termsCount || dfCount != termsCount || idfCount != termsCount ||
+       pairTermsCount != 2 * pairsCount || listsCount != termsCount + pairsCount || offsets[termsCount] > textSize ||
+       (lengthNormsCount != 0 && lengthNormsCount != LENGTH_CODES)){
+        delete file;
+        return false;
+    }
+
+    // the loaded index replaces all the segments
+    stopMerges();
+    for(unsigned long i = 0; i < m_completedMerges.size(); i++)
+        delete m_completedMerges[i].second;
+    m_completedMerges.clear();
+    for(unsigned long i = 0; i < m_segments.size(); i++)
+        delete m_segments[i];
+    m_segments.assign(1, new IndexSegment());
+    m_bufferedPostings = 0;
+    m_bufferedDocs.clear();
+    m_changedTerms.clear();
+
+    m_pairPostings.clear();
+    bool valid = m_segments[0]->load(*file, entries, termsCount);
+    m_termViews.clear();
+    m_termPostings.assign(termsCount, &m_emptyPostings);
+    for(unsigned long termID = 0; termID < termsCount; termID++){
+        if(m_segments[0]->find(termID) != NULL)
+            m_termPostings[termID] = m_segments[0]->find(termID);
+    }
+    for(unsigned long i = 0; i < pairsCount; i++){
+        CompactPostingList& pairPostings = m_pairPostings[make_pair(pairs[2 * i], pairs[2 * i + 1])];
+        valid = pairPostings.load(*file, entries[termsCount + i]) && valid;
+    }
+
+    m_dictionary.map(text, offsets, order, termsCount);
+    m_df.map(df, termsCount);
+    m_idf.map(idf, termsCount);
+    vector<POSTING_LIST>(termsCount).swap(m_postings);
+    m_rankingModel = static_cast<RANKING_MODEL>(header.rankingModel);
+    m_lengthCodes.map(lengthCodes, lengthCodesCount);
+    if(lengthNormsCount == LENGTH_CODES)
+        memcpy(m_lengthNorms, lengthNorms, sizeof(m_lengthNorms));
+    m_minLengthNorm = header.minLengthNorm;
+    m_impactScale = header.impactScale;
+
+    // running statistics of the collection (see update()): the norms of the first two length codes differ
+    // by k1 * b / average length, and the lowest norm is that of the shortest document
+    m_collectionSize = documentsCount;
+    m_lengthSum = 0.0;
+    m_minLengthCode = LENGTH_CODES - 1;
+    if(m_rankingModel == RANKING_MODEL_BM25 && lengthNormsCount == LENGTH_CODES){
+        m_lengthSum = BM25_K1 * BM25_B / (m_lengthNorms[1] - m_lengthNorms[0]) * documentsCount;
+        for(unsigned int code = 0; code < LENGTH_CODES; code++){
+            if(m_lengthNorms[code] == m_minLengthNorm){
+                m_minLengthCode = code;
+                break;
+            }
+        }
+    }
+    m_statisticsVersion++;
+    m_termVersions.assign(termsCount, m_statisticsVersion);
+    m_changedDocs.clear();
+    m_pairIndex = header.collectionPairsCount > 0;
+    m_pairsCount = header.collectionPairsCount;
+    documents.assign(docIDs, docIDs + documentsCount);
+
+    delete m_file;  // nothing refers to the previous file any more
+    m_file = file;
+
+    if(m_impactOrdered)
+        setImpactOrdered(true);
+    return valid;
+}
+
+void Index::setMemoryBudget(unsigned long memoryBudget, const string& spillDir){
+    m_memoryBudget = memoryBudget;
+    m_spillDir = spillDir;
+}
+
+void Index::decodeOccurrences(const vector<unsigned char>& buffer, POSTING_LIST& postings){
+    for(const unsigned char* in = &buffer[0]; in < &buffer[0] + buffer.size(); ){
+        unsigned int docID, pos;
+        in = vbyteDecode(vbyteDecode(in, docID), pos);
+
+        POSTING_LIST::iterator it = postings.end();
+        if(postings.empty() || (--it)->first != docID)
+            it = postings.insert(postings.end(), POSTING_LIST::value_type(docID, Posting()));
+        it->second.docID = docID;
+        it->second.positions.push_back(pos);
+        it->second.tf++;
+    }
+}
+
+bool Index::spill(){
+    if(m_runMemory == 0)
+        return true;
+
+    stringstream path;
+    path << m_spillDir << "/run-" << m_runsCount++;
+    ofstream run(path.str().c_str(), ios::out | ios::binary | ios::trunc);
+    if(!run.is_open())
+        return false;
+    m_runFiles.push_back(path.str());
+
+    POSTING_LIST postings;
+    vector<unsigned char> record;
+    for(unsigned int termID = 0; termID < m_runBuffers.size(); termID++){
+        vector<unsigned char>& buffer = m_runBuffers[termID];
+        if(buffer.empty())
+            continue;
+
+        postings.clear();
+        decodeOccurrences(buffer, postings);
+        vector<unsigned char>().swap(buffer);
+
+        record.clear();
+        vbyteEncode(postings.size(), record);
+        for(POSTING_LIST::iterator it = postings.begin(); it != postings.end(); it++){
+            vbyteEncode(it->first, record);
+            vbyteEncode(it->second.tf, record);
+            for(unsigned long i = 0; i < it->second.positions.size(); i++)
+                vbyteEncode(it->second.positions[i], record);
+        }
+
+        unsigned int header[2] = {termID, static_cast<unsigned int>(record.size())};
+        run.write(reinterpret_cast<const char*>(header), sizeof(header));
+        run.write(reinterpret_cast<const char*>(&record[0]), record.size());
+    }
+    m_runMemory = 0;
+    m_bufferedDocs.clear();
+
+    run.close();
+    return !run.fail();
+}
+
+/**
+ *  @brief Posting list of the current term of RunMerger in one of its sources: a segment's list read
+ *         by a cursor, or a run record decoded one posting at a time
+ */
+class TermSource{
+public:
+    TermSource(const CompactPostingList* list, const DeletedDocs* deletedDocs):
+        cursor(list, deletedDocs),
+        started(false),
+        record(NULL),
+        run(0),
+        remaining(0),
+        docID(0),
+        tf(0){}
+
+    PostingCursor  cursor;      // over the segment's list, invalid for a run
+    bool           started;     // the cursor was read
+    const unsigned char* record;    // next posting of the run record, NULL for a segment
+    unsigned long  run;         // index of the run
+    unsigned int   remaining;   // postings of the run record not decoded yet
+    unsigned int   docID;       // current posting
+    unsigned int   tf;
+    POSITIONS_LIST positions;
+};
+
+/**
+ *  @brief K-way merge of the terms of runs spilled by the index built within a memory budget and 
+ *         of index segments, in term ID order. Postings of the current term are merged from all its
+ *         sources in docID order, one at a time, and postings of a document found in several sources
+ *         are combined (positions in the order of the sources). Postings of the deleted documents are left out.
+ */
+class RunMerger{
+public:
+/** 
+ *   @param  segments segments to merge, their deleted documents are left out
+ *   @param  runFiles runs to merge, in the order they were spilled
+ *   @param  deletedRunDocs deleted documents, and the number of runs which leave them out (see Index::deleteDocument())
+ */
+    RunMerger(const vector<IndexSegment*>& segments, const vector<string>& runFiles, const map<unsigned long, unsigned long>& deletedRunDocs):
+        m_segments(segments),
+        m_positions(segments.size(), 0),
+        m_runFiles(runFiles),
+        m_deletedRunDocs(deletedRunDocs),
+        m_runs(runFiles.size()),
+        m_records(runFiles.size()){}
+
+    ~RunMerger(){
+        for(unsigned long run = 0; run < m_runs.size(); run++)
+            delete m_runs[run];
+    }
+
+/** 
+ *   @brief  opens the runs and reads the first term of every source
+ *  
+ *   @return false if a run can't be opened
+ */
+    bool open(){
+        for(unsigned long source = 0; source < m_segments.size(); source++){
+            if(m_segments[source]->termsCount() > 0)
+                m_heads.push(make_pair(m_segments[source]->termID(0), source));
+        }
+        for(unsigned long run = 0; run < m_runs.size(); run++){
+            m_runs[run] = new ifstream(m_runFiles[run].c_str(), ios::in | ios::binary);
+            if(!m_runs[run]->is_open())
+                return false;
+            readRecord(run);
+        }
+        return true;
+    }
+
+/** 
+ *   @brief  moves to the next term of the sources, whose postings are then read by nextPosting()
+ *  
+ *   @param  termID receives ID of the term
+ *   @return false if there are no more terms
+ */
+    bool nextTerm(unsigned int& termID){
+        // records of the runs holding the previous term are no longer read, the next ones replace them
+        for(unsigned long i = 0; i < m_termSources.size(); i++){
+            if(m_termSources[i].record != NULL)
+                readRecord(m_termSources[i].run);
+        }
+        m_termSources.clear();
+        m_postingHeads = POSTING_HEADS();
+
+        if(m_heads.empty())
+            return false;
+
+        termID = m_heads.top().first;
+        while(!m_heads.empty() && m_heads.top().first == termID){
+            unsigned long source = m_heads.top().second;
+            m_heads.pop();
+
+            if(source < m_segments.size()){
+                IndexSegment* segment = m_segments[source];
+                m_termSources.push_back(TermSource(segment->find(termID), &segment->deletedDocs()));
+                if(++m_positions[source] < segment->termsCount())
+                    m_heads.push(make_pair(segment->termID(m_positions[source]), source));
+            }
+            else{
+                TermSource termSource(NULL, NULL);
+                termSource.run = source - m_segments.size();
+                termSource.record = vbyteDecode(&m_records[termSource.run][0], termSource.remaining);
+                m_termSources.push_back(termSource);
+            }
+        }
+
+        for(unsigned long i = 0; i < m_termSources.size(); i++){
+            if(step(m_termSources[i]))
+                m_postingHeads.push(make_pair(m_termSources[i].docID, i));
+        }
+        return true;
+    }
+
+/** 
+ *   @brief  merges the next posting of the current term from its sources, leaving out deleted documents 
+ *           of the segments
+ *  
+ *   @param  docID receives document of the posting
+ *   @param  tf receives term frequency in the document
+ *   @param  positions receives positions of the term in the document
+ *   @return false if there are no more postings of the term
+ */
+    bool nextPosting(unsigned int& docID, unsigned int& tf, POSITIONS_LIST& positions){
+        if(m_postingHeads.empty())
+            return false;
+
+        docID = m_postingHeads.top().first;
+        tf = 0;
+        positions.clear();
+        while(!m_postingHeads.empty() && m_postingHeads.top().first == docID){
+            TermSource& source = m_termSources[m_postingHeads.top().second];
+            m_postingHeads.pop();
+
+            tf += source.tf;
+            positions.insert(positions.end(), source.positions.begin(), source.positions.end());
+            if(step(source))
+                m_postingHeads.push(make_pair(source.docID, &source - &m_termSources[0]));
+        }
+        return true;
+    }
+
+private:
+    typedef priority_queue<pair<unsigned int, unsigned long>, vector<pair<unsigned int, unsigned long> >, 
+                           greater<pair<unsigned int, unsigned long> > > POSTING_HEADS;
+
+/** 
+ *   @brief  moves source of the current term to its next posting
+ *  
+ *   @param  source the source
+ *   @return false if the source has no more postings
+ */
+    bool step(TermSource& source){
+        while(source.record != NULL){
+            if(source.remaining == 0)
+                return false;
+            source.remaining--;
+
+            unsigned int pos;
+            source.record = vbyteDecode(vbyteDecode(source.record, source.docID), source.tf);
+            source.positions.resize(source.tf);
+            for(unsigned int k = 0; k < source.tf; k++){
+                source.record = vbyteDecode(source.record, pos);
+                source.positions[k] = pos;
+            }
+
+            map<unsigned long, unsigned long>::const_iterator it = m_deletedRunDocs.find(source.docID);
+            if(it == m_deletedRunDocs.end() || source.run >= it->second)
+                return true;
+        }
+
+        if(source.started)
+            source.cursor.next();
+        source.started = true;
+        if(!source.cursor.valid())
+            return false;
+
+        source.docID = source.cursor.docID();
+        source.tf = source.cursor.tf();
+        source.positions = source.cursor.positions();
+        return true;
+    }
+
+    void readRecord(unsigned long run){
+        unsigned int header[2];
+        if(!m_runs[run]->read(reinterpret_cast<char*>(header), sizeof(header)))
+            return;     // end of the run
+
+        m_records[run].resize(header[1]);
+        if(m_runs[run]->read(reinterpret_cast<char*>(&m_records[run][0]), header[1]))
+            m_heads.push(make_pair(header[0], m_segments.size() + run));
+    }
+
+    const vector<IndexSegment*>&   m_segments;
+    vector<unsigned long>          m_positions;     // index of the next term of each segment
+    const vector<string>&          m_runFiles;
+    const map<unsigned long, unsigned long>& m_deletedRunDocs;
+    vector<ifstream*>              m_runs;
+    vector<vector<unsigned char> > m_records;       // current record of each run
+    priority_queue<pair<unsigned int, unsigned long>, vector<pair<unsigned int, unsigned long> >, 
+                   greater<pair<unsigned int, unsigned long> > > m_heads; // next term of each source, and the source 
+                                                    // (segments first, then runs in the order they were spilled)
+    vector<TermSource>             m_termSources;   // sources of the current term, in the order of the sources
+    POSTING_HEADS                  m_postingHeads;  // docID of the current posting of each source of the term, and its index
+};
+
+/**
+ *  @brief offset of a stream of posting list in the index file
+ */
+static unsigned long long& streamOffset(PostingListEntry& entry, INDEX_SECTION stream){
+    switch(stream){
+    case INDEX_SECTION_POSITION_DATA:
+        return entry.positionDataOffset;
+    case INDEX_SECTION_SKIPS:
+        return entry.skipsOffset;
+    case INDEX_SECTION_IMPACTS:
+        return entry.impactsOffset;
+    default:
+        return entry.docDataOffset;
+    }
+}
+
+bool Index::mergeRuns(const vector<unsigned long>& documents){
+    if(!spill())
+        return false;
+
+    flush();
+    stopMerges();
+    refresh();
+
+    // first pass: statistics of the merged posting lists
+    vector<unsigned long>& df = m_df.owned();
+    df.assign(termsCount(), 0);
+    vector<unsigned int> maxTfs(termsCount(), 0);
+    vector<unsigned long> lengths;
+    unsigned int termID, docID, tf;
+    POSITIONS_LIST positions;
+
+    RunMerger statsMerger(m_segments, m_runFiles, m_deletedRunDocs);
+    if(!statsMerger.open())
+        return false;
+    while(statsMerger.nextTerm(termID)){
+        while(statsMerger.nextPosting(docID, tf, positions)){
+            df[termID]++;
+            if(tf > maxTfs[termID])
+                maxTfs[termID] = tf;
+
+            if(m_rankingModel == RANKING_MODEL_BM25){
+                if(docID >= lengths.size())
+                    lengths.resize(docID + 1, 0);
+                lengths[docID] += tf;
+            }
+        }
+    }
+    computeWeights(documents.size(), lengths, maxTfs);
+
+    string path = m_spillDir + "/" + INDEX_FILE_NAME, newPath = path + ".new";
+    IndexFileWriter writer;
+    if(!writer.open(newPath))
+        return false;
+    saveTerms(writer, documents);
+    writer.beginSection(INDEX_SECTION_PAIRS);
+
+    // second pass: posting lists, one at a time, each encoded while its postings are merged. Each stream 
+    // is written to a file of its own and appended to the index file afterwards, laid out as save() lays it out.
+    const INDEX_SECTION streams[] = {INDEX_SECTION_DOC_DATA, INDEX_SECTION_POSITION_DATA, INDEX_SECTION_SKIPS, INDEX_SECTION_IMPACTS};
+    const unsigned int streamsCount = sizeof(streams) / sizeof(streams[0]);
+    IndexFileWriter streamWriters[streamsCount];
+    string streamPaths[streamsCount];
+    for(unsigned int stream = 0; stream < streamsCount; stream++){
+        stringstream streamPath;
+        streamPath << newPath << "." << stream;
+        streamPaths[stream] = streamPath.str();
+        if(!streamWriters[stream].open(streamPaths[stream]))
+            return false;
+    }
+
+    PostingListEntry emptyEntry;
+    memset(&emptyEntry, 0, sizeof(emptyEntry));
+    vector<PostingListEntry> entries(termsCount(), emptyEntry);
+
+    RunMerger listsMerger(m_segments, m_runFiles, m_deletedRunDocs);
+    if(!listsMerger.open())
+        return false;
+    bool merged = listsMerger.nextTerm(termID);
+    for(unsigned int i = 0; i < termsCount(); i++){
+        CompactPostingList list;
+        const CompactPostingList* termList = &m_emptyPostings;
+
+        if(merged && termID == i){
+            vector<IMPACT> impacts;
+            PostingListBuilder builder(list);
+            while(listsMerger.nextPosting(docID, tf, positions)){
+                builder.add(docID, tf, positions);
+                impacts.push_back(impact(weight(i, tf, docID)));
+            }
+            builder.finish();
+
+            // all documents of the term may be deleted
+            if(list.size() > 0){
+                list.setImpacts(impacts);
+                termList = &list;
+            }
+            merged = listsMerger.nextTerm(termID);
+        }
+
+        for(unsigned int stream = 0; stream < streamsCount; stream++)
+            termList->save(streamWriters[stream], streams[stream], entries[i]);
+    }
+
+    IndexFileHeader streamHeader;
+    memset(&streamHeader, 0, sizeof(streamHeader));
+    bool valid = true;
+    for(unsigned int stream = 0; stream < streamsCount; stream++){
+        unsigned long long streamSize = streamWriters[stream].offset() - sizeof(IndexFileHeader);
+        valid = streamWriters[stream].close(streamHeader) && valid;
+        writer.beginSection(streams[stream]);
+
+        // offsets in the stream file start after its header
+        unsigned long long offset = writer.append(streamPaths[stream], sizeof(IndexFileHeader), streamSize);
+        valid = offset > 0 && valid;
+        for(unsigned long i = 0; i < entries.size(); i++)
+            streamOffset(entries[i], streams[stream]) += offset - sizeof(IndexFileHeader);
+        remove(streamPaths[stream].c_str());
+    }
+    writer.beginSection(INDEX_SECTION_LISTS);
+    writer.write(entries.data(), entries.size() * sizeof(PostingListEntry));
+    if(!saveHeader(writer, 0) || !valid)
+        return false;
+
+    // the previous index file stays mapped until load() replaces it
+    if(rename(newPath.c_str(), path.c_str()) != 0)
+        return false;
+    for(unsigned long run = 0; run < m_runFiles.size(); run++)
+        remove(m_runFiles[run].c_str());
+    m_runFiles.clear();
+    m_deletedRunDocs.clear();
+
+    vector<unsigned long> loadedDocuments;
+    return load(path, loadedDocuments);
+}
+
+void Index::setPairIndex(unsigned long minFrequency, unsigned long memoryBudget){
+    m_pairIndex = true;
+    m_pairMinFrequency = minFrequency;
+    m_pairMemoryBudget = memoryBudget;
+}
+
+void Index::addPairCandidate(const string& term1, const string& term2){
+    m_pairCandidates.push_back(make_pair(term1, term2));
+}
+
+const CompactPostingList* Index::getPairPostings(unsigned int termID1, unsigned int termID2) const{
+    map<pair<unsigned int, unsigned int>, CompactPostingList>::const_iterator it = m_pairPostings.find(make_pair(termID1, termID2));
+    return it != m_pairPostings.end() ? &it->second : NULL;
+}
+
+void Index::buildPairIndex(){
+    // every occurrence of every term, ordered by document and position, so that adjacent terms follow each other
+    vector<pair<unsigned long long, unsigned int> > occurrences;
+    for(unsigned int termID = 0; termID < m_termPostings.size(); termID++){
+        for(PostingCursor cursor(m_termPostings[termID]); cursor.valid(); cursor.next()){
+            const POSITIONS_LIST& positions = cursor.positions();
+            for(unsigned long k=0; k < positions.size(); k++)
+                occurrences.push_back(make_pair(pairKey(cursor.docID(), positions[k]), termID));
+        }
+    }
+    sort(occurrences.begin(), occurrences.end());
+
+    // every occurrence of every adjacent pair, ordered by the pair and then by document and position,
+    // so that occurrences of a pair are counted and turned into postings in one run
+    vector<pair<unsigned long long, unsigned long long> > pairOccurrences;
+    for(unsigned long i=0; i + 1 < occurrences.size(); i++){
+        if(occurrences[i].first + 1 == occurrences[i + 1].first)
+            pairOccurrences.push_back(make_pair(pairKey(occurrences[i].second, occurrences[i + 1].second), occurrences[i].first));
+    }
+    vector<pair<unsigned long long, unsigned int> >().swap(occurrences);
+    sort(pairOccurrences.begin(), pairOccurrences.end());
+
+    set<unsigned long long> requested;
+    for(unsigned long i=0; i < m_pairCandidates.size(); i++){
+        unsigned int termID1 = getTermID(m_pairCandidates[i].first);
+        unsigned int termID2 = getTermID(m_pairCandidates[i].second);
+        if(termID1 != INVALID_TERM_ID && termID2 != INVALID_TERM_ID)
+            requested.insert(pairKey(termID1, termID2));
+    }
+
+    // pairs to index (frequency and the first occurrence), the most frequent first
+    vector<pair<unsigned long, unsigned long> > candidates;
+    m_pairsCount = 0;
+    for(unsigned long i=0; i < pairOccurrences.size(); ){
+        unsigned long end = i;
+        while(end < pairOccurrences.size() && pairOccurrences[end].first == pairOccurrences[i].first)
+            end++;
+
+        if((m_pairMinFrequency > 0 && end - i >= m_pairMinFrequency) || requested.count(pairOccurrences[i].first) > 0)
+            candidates.push_back(make_pair(end - i, i));
+        m_pairsCount++;
+        i = end;
+    }
+    stable_sort(candidates.begin(), candidates.end(), greater<pair<unsigned long, unsigned long> >());
+
+    m_pairPostings.clear();
+    unsigned long memoryUsage = 0;
+    POSTING_LIST postings;
+
+    for(unsigned long i=0; i < candidates.size(); i++){
+        // positions of the postings are positions of the first term
+        unsigned long first = candidates[i].second;
+        postings.clear();
+        for(unsigned long k = first; k < first + candidates[i].first; k++){
+            unsigned int docID = static_cast<unsigned int>(pairOccurrences[k].second >> 32);
+            Posting& posting = postings.insert(postings.end(), POSTING_LIST::value_type(docID, Posting()))->second;
+            posting.docID = docID;
+            posting.positions.push_back(pairOccurrences[k].second & 0xFFFFFFFF);
+            posting.tf++;
+        }
+
+        CompactPostingList pairPostings;
+        pairPostings.build(postings);
+        if(m_pairMemoryBudget > 0 && memoryUsage + pairPostings.memoryUsage() > m_pairMemoryBudget)
+            break;      // budget is used up by more frequent pairs
+
+        memoryUsage += pairPostings.memoryUsage();
+        unsigned long long key = pairOccurrences[first].first;
+        m_pairPostings[make_pair(static_cast<unsigned int>(key >> 32), static_cast<unsigned int>(key))] = pairPostings;
+    }
+}
+
+void Index::setImpactOrdered(bool impactOrdered){
+    m_impactOrdered = impactOrdered;
+    m_impactOrderedPostings.clear();
+
+    if(m_impactOrdered){
+        // impacts are available once the index is finalized
+        m_impactOrderedPostings.resize(m_termPostings.size());
+        for(unsigned int termID = 0; termID < m_termPostings.size() && m_impactScale > 0; termID++)
+            m_impactOrderedPostings[termID].build(*m_termPostings[termID]);
+    }
+}
+
+unsigned int Index::impact(double weight) const{
+    weight *= m_impactScale;
+
+    if(weight <= 0)
+        return 0;   // terms present in (almost) every document carry no weight
+    if(weight >= IMPACT_MAX)
+        return IMPACT_MAX;
+    // round to the nearest, but keep the smallest weights distinguishable from absent terms
+    unsigned int impact = static_cast<unsigned int>(weight + 0.5);
+    return impact > 0 ? impact : 1;
+}
+
+unsigned int Index::lengthCode(unsigned long length){
+    if(length < LENGTH_EXACT_CODES)
+        return static_cast<unsigned int>(length);
+
+    unsigned int code = LENGTH_EXACT_CODES + static_cast<unsigned int>(log(static_cast<double>(length) / LENGTH_EXACT_CODES) / log(LENGTH_CODE_GROWTH));
+    // correct rounding errors of the logarithms, so that codeLength(code) <= length < codeLength(code + 1)
+    while(code > LENGTH_EXACT_CODES && codeLength(code) > length)
+        code--;
+    while(code + 1 < LENGTH_CODES && codeLength(code + 1) <= length)
+        code++;
+    return code < LENGTH_CODES ? code : LENGTH_CODES - 1;
+}
+
+double Index::codeLength(unsigned int code){
+    if(code < LENGTH_EXACT_CODES)
+        return code;
+    return floor(LENGTH_EXACT_CODES * pow(LENGTH_CODE_GROWTH, static_cast<double>(code - LENGTH_EXACT_CODES)));
+}
+
+void SearchEngine::setPairIndex(unsigned long minFrequency, unsigned long memoryBudget, const vector<string>& queryLog){
+    m_index.setPairIndex(minFrequency, memoryBudget);
+
+    for(unsigned long i=0; i < queryLog.size(); i++){
+        string query = queryLog[i];
+        vector<string> terms = Tokenizer::singleton().tokenize(query);
+
+        for(unsigned long k=0; k + 1 < terms.size(); k++)
+            m_index.addPairCandidate(terms[k], terms[k + 1]);
+    }
+}
+
+void SearchEngine::saveIndex(string indexDirPath){
+    mkdir(indexDirPath.c_str(), 0755);  // fails harmlessly if the directory exists
+
+    string indexFilePath = indexDirPath + "/" + INDEX_FILE_NAME;
+    if(!m_index.save(indexFilePath, m_collectionDocIDs)){
+        cout << "Unable to open file: " << indexFilePath << endl;
+        exit(1);
+    }
+}
+
+void SearchEngine::loadIndex(string indexDirPath){
+    string indexFilePath = indexDirPath + "/" + INDEX_FILE_NAME;
+    if(!m_index.load(indexFilePath, m_collectionDocIDs)){
+        cout << "Invalid index file: " << indexFilePath << endl;
+        exit(1);
+    }
+    updateDocumentIDs();
+}
+
+bool SearchEngine::deleteDocument(unsigned long docID){
+    bool found = false;
+
+    // documents of a loaded index have docIDs, but no Document objects
+    for(unsigned long i = m_collectionDocIDs.size(); i-- > 0; ){
+        if(m_collectionDocIDs[i] == docID){
+            if(m_collection.size() == m_collectionDocIDs.size()){
+                delete m_collection[i];
+                m_collection.erase(m_collection.begin() + i);
+            }
+            m_collectionDocIDs.erase(m_collectionDocIDs.begin() + i);
+            found = true;
+        }
+    }
+
+    if(found){
+        vector<unsigned long>::iterator it = lower_bound(m_documentIDs.begin(), m_documentIDs.end(), docID);
+        if(it != m_documentIDs.end() && *it == docID)
+            m_documentIDs.erase(it);
+        m_index.deleteDocument(docID);
+        m_collectionChanged = true;
+    }
+    return found;
+}
+
+bool SearchEngine::updateDocument(unsigned long docID, string text){
+    if(!validDocID(docID))
+        return false;
+    deleteDocument(docID);
+
+    TextDocument* pTextDoc = new TextDocument(docID);
+    stringstream textStream(text);
+    string token;
+    string space = SPACE_STR;
+    unsigned long termPos = 0;
+
+    // tokens are added the way buildFromFile() adds them
+    while(textStream >> token){
+        termPos++;
+        pTextDoc->appendToBody(token);
+        pTextDoc->appendToBody(space);
+        m_index.addText(token, docID, termPos);
+    }
+
+    // the document takes its place in docID order, which exhaustive evaluation and the index file keep
+    unsigned long i = lower_bound(m_collectionDocIDs.begin(), m_collectionDocIDs.end(), docID) - m_collectionDocIDs.begin();
+    if(m_collection.size() == m_collectionDocIDs.size())
+        m_collection.insert(m_collection.begin() + i, pTextDoc);
+    else
+        delete pTextDoc;
+    m_collectionDocIDs.insert(m_collectionDocIDs.begin() + i, docID);
+    m_documentIDs.insert(lower_bound(m_documentIDs.begin(), m_documentIDs.end(), docID), docID);
+    m_index.endDocument();
+    m_collectionChanged = true;
+    return true;
+}
+
+void SearchEngine::refreshIndex(){
+    m_index.refresh();
+
+    if(m_collectionChanged){
+        if(m_index.runsCount() > 0)
+            finalizeIndex();    // writes the index file again
+        else
+            m_index.update(m_collectionDocIDs.size());
+        m_collectionChanged = false;
+    }
+}
+
+void SearchEngine::setMemoryBudget(unsigned long memoryBudget, string spillDir){
+    mkdir(spillDir.c_str(), 0755);  // fails harmlessly if the directory exists
+    m_index.setMemoryBudget(memoryBudget, spillDir);
+}
+
+void SearchEngine::finalizeIndex(){
+    if(m_index.memoryBudget() > 0){
+        if(!m_index.mergeRuns(m_collectionDocIDs)){
+            cout << "Unable to write index file into: " << m_index.spillDir() << endl;
+            exit(1);
+        }
+    }
+    else{
+        m_index.freeze();
+        m_index.finalize(m_collectionDocIDs.size());
+    }
+    updateDocumentIDs();
+}
+
+void SearchEngine::printIndex(bool includePostings){
+    m_index.print(includePostings);
+}
+
+void SearchEngine::printIndexStats(){
+    cout << "Documents: " << m_collectionDocIDs.size() << endl;
+    m_index.printStats();
+}
+
+void SearchEngine::buildFromFile(string xmlFilePath){
+    ifstream inFile;
+    string token;
+    unsigned long docID = 0;
+    unsigned long termPos = 0;
+    TextDocument* pTextDoc = NULL;
+    string space = SPACE_STR;
+    string closing_bracket;
+
+    if(m_indexThreads > 1 && m_index.memoryBudget() == 0){
+        buildFromFileParallel(xmlFilePath);
+        return;
+    }
+
+    inFile.open(xmlFilePath.c_str());
+    if (!inFile) {
+        cout << "Unable to open file";
+        exit(1); // terminate with error
+    }
+    
+    while (inFile >> token) {
+    
+        if(token == XML_TAG_DOC_OPEN){
+            inFile >> docID;
+            if(!validDocID(docID)){
+                cout << "Invalid document ID " << docID << " in " << xmlFilePath << ", IDs must be from " << FIRST_DOC_ID << " to " << MAX_DOC_ID - 1 << endl;
+                exit(1);
+            }
+  
+            inFile >> closing_bracket;
+            assert (closing_bracket == ">");
+
+            pTextDoc = new TextDocument(docID);
+        }
+        else if( token == XML_TAG_DOC_CLOSE){
+            m_collectionDocIDs.push_back(docID);
+            if(m_index.memoryBudget() > 0)
+                delete pTextDoc;    // document text isn't kept within a memory budget, as that of a loaded index
+            else
+                m_collection.push_back(pTextDoc);
+            m_index.endDocument();
+
+            docID = 0; // clear the ID to ensure next document will properly contain an ID.
+            pTextDoc = NULL;
+            termPos = 0;
+        }
+        else if (docID != 0){
+            termPos++; // increment by one to get position of this new term
+            // we are reading in the document, token by token
+            pTextDoc->appendToBody(token);
+            pTextDoc->appendToBody(space);
+            m_index.addText(token, docID, termPos);
+        }
+    }
+    
+    inFile.close();  
+
+    finalizeIndex();
+}
+
+/**
+ *  @brief Batches of documents read from the collection file, waiting for the threads inverting them
+ */
+class BatchQueue{
+public:
+    BatchQueue():
+        m_closed(false){
+        pthread_mutex_init(&m_mutex, NULL);
+        pthread_cond_init(&m_changed, NULL);
+    }
+    ~BatchQueue(){
+        pthread_cond_destroy(&m_changed);
+        pthread_mutex_destroy(&m_mutex);
+    }
+
+    void push(DocumentBatch* batch){
+        pthread_mutex_lock(&m_mutex);
+        m_batches.push_back(batch);
+        pthread_cond_signal(&m_changed);
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    // no more batches will be pushed
+    void close(){
+        pthread_mutex_lock(&m_mutex);
+        m_closed = true;
+        pthread_cond_broadcast(&m_changed);
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    // waits for a batch, NULL once the queue is closed and empty
+    DocumentBatch* pop(){
+        pthread_mutex_lock(&m_mutex);
+        while(m_batches.empty() && !m_closed)
+            pthread_cond_wait(&m_changed, &m_mutex);
+
+        DocumentBatch* batch = NULL;
+        if(!m_batches.empty()){
+            batch = m_batches.front();
+            m_batches.pop_front();
+        }
+        pthread_mutex_unlock(&m_mutex);
+        return batch;
+    }
+
+private:
+    deque<DocumentBatch*> m_batches;
+    bool                  m_closed;
+    pthread_mutex_t       m_mutex;
+    pthread_cond_t        m_changed;
+};
+
+/**
+ *  @brief inverts batches of the queue until it is closed, with a tokenizer of the thread
+ */
+static void* invertBatches(void* queue){
+    BatchQueue* pQueue = static_cast<BatchQueue*>(queue);
+    Tokenizer tokenizer;
+
+    DocumentBatch* batch;
+    while((batch = pQueue->pop()) != NULL)
+        batch->invert(tokenizer);
+    return NULL;
+}
+
+void SearchEngine::buildFromFileParallel(string& xmlFilePath){
+    ifstream inFile;
+    string token;
+    unsigned long docID = 0;
+    string closing_bracket;
+    vector<string> tokens;
+
+    inFile.open(xmlFilePath.c_str());
+    if (!inFile) {
+        cout << "Unable to open file";
+        exit(1); // terminate with error
+    }
+
+    BatchQueue queue;
+    vector<pthread_t> threads(m_indexThreads);
+    unsigned long started = 0;
+    while(started < threads.size() && pthread_create(&threads[started], NULL, invertBatches, &queue) == 0)
+        started++;
+
+    // batches are read in the order of the file, and keep it through the merge
+    vector<DocumentBatch*> batches;
+    DocumentBatch* batch = new DocumentBatch();
+    unsigned long batchSize = 0;
+
+    while (inFile >> token) {
+
+        if(token == XML_TAG_DOC_OPEN){
+            inFile >> docID;
+            if(!validDocID(docID)){
+                cout << "Invalid document ID " << docID << " in " << xmlFilePath << ", IDs must be from " << FIRST_DOC_ID << " to " << MAX_DOC_ID - 1 << endl;
+                exit(1);
+            }
+
+            inFile >> closing_bracket;
+            assert (closing_bracket == ">");
+        }
+        else if( token == XML_TAG_DOC_CLOSE){
+            batch->addDocument(docID, tokens);
+            tokens.clear();
+            docID = 0; // clear the ID to ensure next document will properly contain an ID.
+
+            if(++batchSize == INDEX_BATCH_SIZE){
+                batches.push_back(batch);
+                queue.push(batch);
+                batch = new DocumentBatch();
+                batchSize = 0;
+            }
+        }
+        else if (docID != 0){
+            tokens.push_back(token);
+        }
+    }
+    inFile.close();
+
+    batches.push_back(batch);
+    queue.push(batch);
+    queue.close();
+
+    if(started == 0)
+        invertBatches(&queue);  // no thread could be started
+    for(unsigned long i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    // all the batches are merged into one segment, as the single thread flushes the whole collection
+    m_index.addBatches(batches, m_indexThreads);
+
+    for(unsigned long b = 0; b < batches.size(); b++){
+        const vector<unsigned long>& docIDs = batches[b]->docIDs();
+        const vector<TextDocument*>& documents = batches[b]->documents();
+
+        m_collectionDocIDs.insert(m_collectionDocIDs.end(), docIDs.begin(), docIDs.end());
+        m_collection.insert(m_collection.end(), documents.begin(), documents.end());
+        delete batches[b];
+    }
+
+    finalizeIndex();
+}
+
+void SearchEngine::buildFromSquadData(string jsonFilePath, bool tokenizeCollection){
+    ifstream inFile;
+    string token;
+    unsigned long docID = 0;
+    unsigned long termPos = 0;
+    TextDocument* pTextDoc = NULL;
+    string closing_bracket;
+    size_t docBegin = 0, pos;
+    unsigned long biggestDocSize = 0;
+    string space = SPACE_STR;
+    ofstream tokenizedDocsFile;
+    bool processingQuestion = false, processingAnswer =false;
+    unsigned long posUnused = 0;
+    unsigned long fakeDocID = 0;
+
+    if(tokenizeCollection)
+    {
+        string tokenizedDocPath = jsonFilePath + "tokenized";
+        tokenizedDocsFile.open(tokenizedDocPath);
+    
+        if (!tokenizedDocsFile) {
+            cout << "Unable to open file: " + tokenizedDocPath;
+            exit(1); // terminate with error
+        }
+    }
+
+    inFile.open(jsonFilePath.c_str());
+    if (!inFile) {
+        cout << "Unable to open file";
+        exit(1); // terminate with error
+    }
+    
+    string line;
+    vector<string> tokens;
+
+    while( getline(inFile, line) ) {
+
+        stringstream singleLineText( line );
+
+        while (singleLineText >> token) {
+
+#if 0
+            pos = token.find("unives");
+            if(pos != std::string::npos)
+            {
+                int x = 0;
+                x = 9;
+            }
+#endif
+
+            docBegin = token.find(JSON_TAG_DOC_OPEN);
+            if(docBegin == 0 || docBegin == 1){
+                docID++;
+    
+                pTextDoc = new TextDocument(docID);
+
+                if(tokenizeCollection)
+                    tokenizedDocsFile << token << " \"";
+            }
+            else if( pTextDoc && token.length() >= 2 &&
+                    token.rfind(JSON_TAG_DOC_CLOSE) == token.length()-2 &&
+                    token[token.length()-3] != '\\'){
+                
+                termPos++; // increment by one to get position of this new term
+                // we are reading in the document, token by token
+                pTextDoc->appendToBody(token);
+                pTextDoc->appendToBody(space);
+                m_index.addText(token, docID, termPos);
+                
+                m_collectionDocIDs.push_back(docID);
+                m_index.endDocument();
+
+                if(biggestDocSize < pTextDoc->length())
+                    biggestDocSize = pTextDoc->length();
+                if(m_index.memoryBudget() > 0)
+                    delete pTextDoc;    // document text isn't kept within a memory budget, as that of a loaded index
+                else
+                    m_collection.push_back(pTextDoc);
+
+                pTextDoc = NULL;
+                termPos = 0;
+
+                if(tokenizeCollection){
+                    tokens = Tokenizer::singleton().tokenize(token);
+                    for(int i = 0; i < tokens.size(); i++)
+                        tokenizedDocsFile << tokens[i] << " ";  
+
+                    if(token.find(".") != std::string::npos)
+                        tokenizedDocsFile << ".";
+                    tokenizedDocsFile << JSON_TAG_DOC_CLOSE << " ";
+                }
+            }
+            else if (pTextDoc){
                 termPos++; // increment by one to get position of this new term
                 // we are reading in the document, token by token
                 pTextDoc->appendToBody(token);
                 pTextDoc->appendToBody(space);
                 m_index.addText(token, docID, termPos);
 
-                if(tokenizeCollection)
-                {
-                    tokens = Tokenizer::singleton().tokenize(token);
-                    for(int i = 0; i < tokens.size(); i++)
-                        tokenizedDocsFile << tokens[i] << " ";
+                if(tokenizeCollection)
+                {
+                    tokens = Tokenizer::singleton().tokenize(token);
+                    for(int i = 0; i < tokens.size(); i++)
+                        tokenizedDocsFile << tokens[i] << " ";
+
+                    if(token.find(".") != std::string::npos)
+                        tokenizedDocsFile << ".";
+                }
+            }
+            else{
+                if(tokenizeCollection)
+                {
+                    pos = token.find(JSON_TAG_QUESTION_START);
+
+                    if(pos != std::string::npos){
+                        processingQuestion = true;
+                        tokenizedDocsFile << token << " \"";
+                    }
+                    else if( processingQuestion &&
+                             token.find(JSON_TAG_QUESTION_STOP) != std::string::npos){
+                        processingQuestion = false;
+
+                        tokenizedDocsFile << "\", " << token;
+                    }
+                    else if(processingQuestion){
+                        tokens = Tokenizer::singleton().tokenize(token);
+                        for(int i = 0; i < tokens.size(); i++)
+                        {
+                            tokenizedDocsFile << tokens[i] << " ";
+                            posUnused = 0;
+                            fakeDocID = 0;
+                            m_index.addTerm(tokens[i], fakeDocID, posUnused);
+                        }
+                    }
+                    else if(token.find(JSON_TAG_ANSWER_START) != std::string::npos){
+                        processingAnswer = true;
+                        tokenizedDocsFile << token << " \"";
+                    }
+                    else if( processingAnswer && token.length() >= 4 &&
+                             token.rfind(JSON_TAG_ANSWER_STOP) == token.length()-4){
+                        processingAnswer = false;
+
+                        tokens = Tokenizer::singleton().tokenize(token);
+                        for(int i = 0; i < tokens.size(); i++)
+                        {
+                            posUnused = 0;
+                            fakeDocID = 0;
+                            m_index.addTerm(tokens[i], fakeDocID, posUnused);    
+                            tokenizedDocsFile << tokens[i] << " ";  
+                        }
+                        tokenizedDocsFile << JSON_TAG_ANSWER_STOP << " ";
+                    }
+                    else if( processingAnswer && token.length() >= 3 &&
+                             token.rfind(JSON_TAG_ANSWER_STOP2) == token.length()-3){
+                        processingAnswer = false;
+
+                        tokens = Tokenizer::singleton().tokenize(token);
+                        for(int i = 0; i < tokens.size(); i++)
+                        {
+                            posUnused = 0;
+                            fakeDocID = 0;
+                            m_index.addTerm(tokens[i], fakeDocID, posUnused);     
+                            tokenizedDocsFile << tokens[i] << " ";  
+                        }
+                        tokenizedDocsFile << JSON_TAG_ANSWER_STOP2 << " ";
+                    }                    
+                    else if(processingAnswer){
+                        tokens = Tokenizer::singleton().tokenize(token);
+                        for(int i = 0; i < tokens.size(); i++)
+                        {
+                            posUnused = 0;
+                            fakeDocID = 0;
+                            m_index.addTerm(tokens[i], fakeDocID, posUnused);  
+                            tokenizedDocsFile << tokens[i] << " ";
+                        }
+                    }    
+                    else
+                        tokenizedDocsFile << token << " ";
+                }
+            }
+        }
+
+        if(tokenizeCollection)
+            tokenizedDocsFile << endl;
+    }
+    inFile.close();  
+    if(tokenizeCollection)
+        tokenizedDocsFile.close();
+
+    finalizeIndex();
+
+   // cout << "Biggest doc in collection contains " << biggestDocSize << " words" << endl;
+}
+
+void SearchEngine::buildQueries(string userQuestion, PROXIMITY_QUERY_LIST& proxQueries, FREETEXT_QUERY_LIST& freeTextQueries){
+    string curQuery;
+    unsigned long proxWnd = 0;
+    bool proxOrdered = true;
+
+    for(unsigned int i=0; i < userQuestion.length(); i++){       
+        if(userQuestion[i] == '"'){
+            // phrase, up to the closing quote (or the end of the question)
+            string::size_type phraseEnd = userQuestion.find('"', i + 1);
+            if(phraseEnd == string::npos)
+                phraseEnd = userQuestion.length();
+
+            if(curQuery != ""){
+                Query freeTextQuery(curQuery);
+                if(freeTextQuery.terms().size() > 0)
+                    freeTextQueries.push_back(freeTextQuery);
+                curQuery = "";
+            }
+
+            string phraseText = userQuestion.substr(i + 1, phraseEnd - i - 1);
+            ProximityQuery phrase(phraseText, 0, true, true);
+            if(phrase.terms().size() > 0)
+                proxQueries.push_back(phrase);
+
+            i = phraseEnd; // skip the closing quote
+            continue;
+        }
+
+        unsigned int digitsEnd = i;
+        while(digitsEnd < userQuestion.length() && isdigit(userQuestion[digitsEnd]))
+            digitsEnd++;
+
+        if(digitsEnd > i && digitsEnd < userQuestion.length() && (userQuestion[digitsEnd] == '(' || userQuestion[digitsEnd] == '[')){
+            // beginning of proximity query, ordered with '(' and unordered with '['
+            
+            proxWnd = strtoul(userQuestion.substr(i, digitsEnd - i).c_str(), NULL, 10);
+            proxOrdered = userQuestion[digitsEnd] == '(';
+
+            if(curQuery != ""){
+                Query freeTextQuery(curQuery);
+                if(freeTextQuery.terms().size() > 0)
+                    freeTextQueries.push_back(freeTextQuery);
+                curQuery = "";
+            }
+            i = digitsEnd; // skip the bracket
+        }
+        else if(digitsEnd > i){
+            // number which is not a proximity window
+            curQuery += userQuestion.substr(i, digitsEnd - i);
+            i = digitsEnd - 1;
+        }
+        else if(userQuestion[i] == ')' || userQuestion[i] == ']'){
+            // end of proximity query
+            if(curQuery != ""){
+                ProximityQuery proxQ(curQuery, proxWnd, proxOrdered);
+                if(proxQ.terms().size() > 0)
+                    proxQueries.push_back(proxQ);
+                curQuery = "";
+            }
+        }
+        else
+            curQuery += userQuestion[i];
+    }
+
+    if(curQuery != ""){
+        freeTextQueries.push_back(Query(curQuery));
+    }   
+
+    // from now on the queries are evaluated using term IDs only
+    for(unsigned int i=0; i < proxQueries.size(); i++)
+        proxQueries[i].resolveTerms(m_index);
+
+    for(unsigned int i=0; i < freeTextQueries.size(); i++)
+        freeTextQueries[i].resolveTerms(m_index);
+}
+
+/**
+ *  @brief finds the first position after the given one, by a linear scan 
+ *
+ *  @param  positions sorted positions
+ *  @param  from index to start the scan from
+ *  @param  pos position to skip
+ *  @return index of the first position greater than pos (at or after from), positions.size() if there is none
+ */
+static unsigned long skipPositions(const POSITIONS_LIST& positions, unsigned long from, unsigned long pos){
+    while(from < positions.size() && positions[from] <= pos)
+        from++;
+    return from;
+}
+
+#ifdef PROXIMITY_SSE2
+/**
+ *  @brief skipPositions() comparing 4 positions at once: pos - position is negative (has the sign bit set) 
+ *         exactly for the positions after pos, as positions are far below 2^63
+ */
+static unsigned long skipPositionsSSE2(const POSITIONS_LIST& positions, unsigned long from, unsigned long pos){
+    const __m128i bound = _mm_set1_epi64x(static_cast<long long>(pos));
+    const unsigned long* data = positions.data();
+
+    for(; from + 4 <= positions.size(); from += 4){
+        __m128i diff1 = _mm_sub_epi64(bound, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + from)));
+        __m128i diff2 = _mm_sub_epi64(bound, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + from + 2)));
+        int greater = _mm_movemask_pd(_mm_castsi128_pd(diff1)) | (_mm_movemask_pd(_mm_castsi128_pd(diff2)) << 2);
+
+        if(greater != 0)
+            return from + __builtin_ctz(greater);
+    }
+    return skipPositions(positions, from, pos);
+}
+#endif
+
+/**
+ *  @brief implements findProximityPair(): for every position of term1, the positions of term2 up to it are 
+ *         skipped (they can't follow any later position of term1 either), and the next one is checked 
+ *         against the window
+ *
+ *  @param  skip function finding the first position after the given one, see skipPositions()
+ */
+template<unsigned long (*skip)(const POSITIONS_LIST&, unsigned long, unsigned long)>
+static bool mergeProximityPair(const POSITIONS_LIST& positions1, const POSITIONS_LIST& positions2, unsigned long proximityWnd){
+    unsigned long k = 0;
+
+    for(unsigned long i = 0; i < positions1.size(); i++){
+        k = skip(positions2, k, positions1[i]);
+        if(k == positions2.size())
+            return false;   // no more positions of term2 after term1
+
+        if(positions2[k] - positions1[i] <= proximityWnd + 1) // adding 1 to proximity window since distance is represented by the difference in indexes
+            return true;
+    }
+    return false;
+}
+
+/**
+ *  @brief checks every pair of positions, the reference for printProximityBenchmark()
+ */
+static bool nestedProximityPair(const POSITIONS_LIST& positions1, const POSITIONS_LIST& positions2, unsigned long proximityWnd){
+    for(unsigned int i = 0; i < positions1.size(); i++){
+        unsigned long pos1 = positions1[i];
+
+        for(unsigned int k = 0; k < positions2.size(); k++){
+            unsigned long pos2 = positions2[k];
+
+            if(pos2 > pos1 && pos2 - pos1 <= proximityWnd + 1)
+                return true;
+        }
+    }
+    return false;
+}
+
+/**
+ *  @brief implements findProximityPair(), selects the merge by the number of positions of term2
+ */
+static bool proximityPair(const POSITIONS_LIST& positions1, const POSITIONS_LIST& positions2, unsigned long proximityWnd){
+#ifdef PROXIMITY_SSE2
+    if(positions2.size() >= PROXIMITY_SIMD_MIN_POSITIONS)
+        return mergeProximityPair<skipPositionsSSE2>(positions1, positions2, proximityWnd);
+#endif
+    return mergeProximityPair<skipPositions>(positions1, positions2, proximityWnd);
+}
+
+bool SearchEngine::findProximityPair(const POSITIONS_LIST& positions1, const POSITIONS_LIST& positions2, unsigned long proximityWnd ){
+    return proximityPair(positions1, positions2, proximityWnd);
+}
+
+/**
+ *  @brief implements ordered findProximityWindow(): from every position of the first term, each following term 
+ *         is matched to its first position after the previous term, which gives the shortest window starting 
+ *         there. The matched positions only move forward with the start, so each list is scanned once.
+ *
+ *  @param  skip function finding the first position after the given one, see skipPositions()
+ *  @param  positions positions of every query term, in the query order
+ *  @param  maxSpan highest distance between the first and the last term
+ */
+template<unsigned long (*skip)(const POSITIONS_LIST&, unsigned long, unsigned long)>
+static bool orderedWindow(const vector<const POSITIONS_LIST*>& positions, unsigned long maxSpan){
+    const POSITIONS_LIST& first = *positions[0];
+    vector<unsigned long> next(positions.size(), 0);    // index of the position each term was matched to
+
+    for(unsigned long i = 0; i < first.size(); i++){
+        unsigned long pos = first[i];
+        unsigned long t = 1;
+
+        for(; t < positions.size(); t++){
+            next[t] = skip(*positions[t], next[t], pos);
+            if(next[t] == positions[t]->size())
+                return false;   // the term doesn't occur after the previous one anymore
+
+            pos = (*positions[t])[next[t]];
+            if(pos - first[i] > maxSpan)
+                break;          // the shortest window from this start is too long
+        }
+
+        if(t == positions.size())
+            return true;
+    }
+    return false;
+}
+
+/**
+ *  @brief implements unordered findProximityWindow(): positions of all the terms are merged in increasing order
+ *         into a window, which is shrunk from the front while it still contains all the terms. The shortest 
+ *         window ending at each position is checked.
+ *
+ *  @param  positions positions of every query term, in the query order
+ *  @param  maxSpan highest distance between the first and the last term
+ */
+static bool unorderedWindow(const vector<const POSITIONS_LIST*>& positions, unsigned long maxSpan){
+    // distinct terms (terms repeated in the query share their positions), and how many times each one is needed
+    vector<const POSITIONS_LIST*> terms;
+    vector<unsigned long> needed;
+    for(unsigned long i = 0; i < positions.size(); i++){
+        unsigned long t = find(terms.begin(), terms.end(), positions[i]) - terms.begin();
+        if(t == terms.size()){
+            terms.push_back(positions[i]);
+            needed.push_back(0);
+        }
+        needed[t]++;
+    }
+
+    vector<unsigned long> next(terms.size(), 0);       // index of the next position of each term to merge
+    vector<unsigned long> inWindow(terms.size(), 0);   // number of positions of each term in the window
+    vector<pair<unsigned long, unsigned long> > window; // merged positions with their term, window starts at windowStart
+    unsigned long windowStart = 0;
+    unsigned long missing = terms.size();               // number of terms without enough positions in the window
+
+    while(true){
+        // next position in the merged order
+        unsigned long t = terms.size();
+        for(unsigned long k = 0; k < terms.size(); k++){
+            if(next[k] < terms[k]->size() && (t == terms.size() || (*terms[k])[next[k]] < (*terms[t])[next[t]]))
+                t = k;
+        }
+        if(t == terms.size())
+            return false;   // all positions merged
+
+        window.push_back(make_pair((*terms[t])[next[t]++], t));
+        if(++inWindow[t] == needed[t])
+            missing--;
+
+        while(missing == 0){
+            if(window.back().first - window[windowStart].first <= maxSpan)
+                return true;
+
+            unsigned long front = window[windowStart++].second;
+            if(inWindow[front]-- == needed[front])
+                missing++;
+        }
+    }
+}
+
+/**
+ *  @brief finds the first position which isn't smaller than the given one, by galloping: the step doubles 
+ *         until a position is passed, and the last step is searched with binary search 
+ *
+ *  @param  positions sorted positions
+ *  @param  from index to start the search from
+ *  @param  pos position to find
+ *  @return index of the first position not smaller than pos (at or after from), positions.size() if there is none
+ */
+static unsigned long gallopPositions(const POSITIONS_LIST& positions, unsigned long from, unsigned long pos){
+    unsigned long step = 1;
+    unsigned long low = from;
+    unsigned long high = from;
+
+    while(high < positions.size() && positions[high] < pos){
+        low = high + 1;
+        high = from + step;
+        step *= 2;
+    }
+    if(high > positions.size())
+        high = positions.size();
+
+    return lower_bound(positions.begin() + low, positions.begin() + high, pos) - positions.begin();
+}
+
+/**
+ *  @brief detects whether the units of a phrase (terms, or pairs of adjacent terms, see SearchEngine::planPhrase()) occur
+ *         at their offsets in the phrase. Positions of the unit with the fewest positions in the document propose 
+ *         where the phrase starts, and positions of the other units are only probed for them with galloping search.
+ *
+ *  @param  positions positions of every phrase unit in the document
+ *  @param  offsets position of every unit in the phrase
+ *  @return true if the document contains the phrase, otherwise - false.
+ */
+static bool findPhrase(const vector<const POSITIONS_LIST*>& positions, const vector<unsigned long>& offsets){
+    unsigned long rarest = 0;
+    for(unsigned long t = 1; t < positions.size(); t++){
+        if(positions[t]->size() < positions[rarest]->size())
+            rarest = t;
+    }
+
+    // phrase starts at the offset of the rarest unit before each of its positions, the other units are probed
+    // at their offsets from there. Probed positions only grow, so each search continues from the last one.
+    vector<unsigned long> next(positions.size(), 0);
+    const POSITIONS_LIST& rarestPositions = *positions[rarest];
+
+    for(unsigned long i = 0; i < rarestPositions.size(); i++){
+        if(rarestPositions[i] < offsets[rarest])
+            continue;   // the phrase would start before the document
+
+        unsigned long start = rarestPositions[i] - offsets[rarest];
+        unsigned long t = 0;
+
+        for(; t < positions.size(); t++){
+            if(t == rarest)
+                continue;
+
+            next[t] = gallopPositions(*positions[t], next[t], start + offsets[t]);
+            if(next[t] == positions[t]->size())
+                return false;   // the unit doesn't occur late enough anymore
+            if((*positions[t])[next[t]] != start + offsets[t])
+                break;
+        }
+
+        if(t == positions.size())
+            return true;
+    }
+    return false;
+}
+
+/**
+ *  @brief detects whether all the terms of a proximity query occur in the document with at most proximityWnd 
+ *         other words among them. Finds the minimal windows in one pass over the positions of all the terms:
+ *         ordered windows are extended greedily from each position of the first term, unordered windows 
+ *         are found by sliding a window over the positions of all the terms merged.
+ *
+ *  @param  positions positions of every query term in the document, in the query order 
+ *                    (a term repeated in the query appears repeatedly, and must occur as many times)
+ *  @param  proximityWnd proximity window
+ *  @param  ordered true if the terms must occur in the query order
+ *  @return true if the terms occur within the window, otherwise - false.
+ */
+static bool findProximityWindow(const vector<const POSITIONS_LIST*>& positions, unsigned long proximityWnd, bool ordered){
+    if(positions.size() == 1)
+        return !positions[0]->empty();
+
+    // the terms with at most proximityWnd other words among them
+    unsigned long maxSpan = proximityWnd + positions.size() - 1;
+
+    if(!ordered)
+        return unorderedWindow(positions, maxSpan);
+
+    if(positions.size() == 2)
+        return proximityPair(*positions[0], *positions[1], proximityWnd);
+
+#ifdef PROXIMITY_SSE2
+    for(unsigned long t = 1; t < positions.size(); t++){
+        if(positions[t]->size() >= PROXIMITY_SIMD_MIN_POSITIONS)
+            return orderedWindow<skipPositionsSSE2>(positions, maxSpan);
+    }
+#endif
+    return orderedWindow<skipPositions>(positions, maxSpan);
+}
+
+/**
+ *  @brief orders term IDs by document frequency (rarest first), ties are broken by term ID
+ */
+class DfLess{
+public:
+    explicit DfLess(const Index& index): m_index(index){}
+
+    bool operator()(unsigned int id1, unsigned int id2) const{
+        if(m_index.df(id1) != m_index.df(id2))
+            return m_index.df(id1) < m_index.df(id2);
+        return id1 < id2;
+    }
+
+private:
+    const Index& m_index;
+};
+
+/**
+ *  @brief orders posting lists by their size (shortest first), ties are broken by address
+ */
+class PostingListSizeLess{
+public:
+    bool operator()(const CompactPostingList* list1, const CompactPostingList* list2) const{
+        if(list1->size() != list2->size())
+            return list1->size() < list2->size();
+        return list1 < list2;
+    }
+};
+
+unsigned int SearchEngine::planPhrase(const vector<unsigned int>& terms, vector<const CompactPostingList*>& lists, vector<unsigned long>& offsets){
+    unsigned int pairLists = 0;
+
+    for(unsigned int i=0; i < terms.size(); i++){
+        const CompactPostingList* pairPostings = NULL;
+        unsigned int offset = i;
+
+        if(i + 1 < terms.size())
+            pairPostings = m_index.getPairPostings(terms[i], terms[i + 1]);
+        else if(i > 0 && (pairPostings = m_index.getPairPostings(terms[i - 1], terms[i])) != NULL)
+            offset = i - 1;     // the last term, overlapping with the previous unit
+
+        if(pairPostings != NULL){
+            lists.push_back(pairPostings);
+            offsets.push_back(offset);
+            pairLists++;
+            if(offset == i)
+                i++;    // the next term is covered by the pair
+        }
+        else{
+            lists.push_back(m_index.getPostings(terms[i]));
+            offsets.push_back(i);
+        }
+    }
+    return pairLists;
+}
+
+void DocListIterator::advance(unsigned int target){
+    m_operations++;
+    while(valid() && docID() < target)
+        m_index++;
+}
 
-                    if(token.find(".") != std::string::npos)
-                        tokenizedDocsFile << ".";
-                }
+/**
+ *  @brief orders iterators by their cost (cheapest first)
+ */
+class DocIteratorCostLess{
+public:
+    bool operator()(const DocIterator* iterator1, const DocIterator* iterator2) const{
+        return iterator1->cost() < iterator2->cost();
+    }
+};
+
+AndIterator::AndIterator(const DOC_ITERATOR_LIST& children, INTERSECTION_ALGORITHM algorithm):
+    m_children(children),
+    m_algorithm(algorithm),
+    m_valid(false){
+
+    if(!m_children.empty())
+        findMatch();
+}
+
+AndIterator::~AndIterator(){
+    for(unsigned long i=0; i < m_children.size(); i++)
+        delete m_children[i];
+}
+
+void AndIterator::next(){
+    if(m_valid){
+        m_children[0]->next();
+        findMatch();
+    }
+}
+
+void AndIterator::advance(unsigned int target){
+    if(m_valid && docID() < target){
+        m_children[0]->advance(target);
+        findMatch();
+    }
+}
+
+unsigned long AndIterator::operations() const{
+    unsigned long operations = 0;
+    for(unsigned long i=0; i < m_children.size(); i++)
+        operations += m_children[i]->operations();
+    return operations;
+}
+
+void AndIterator::findMatch(){
+    DocIterator* lead = m_children[0];
+
+    while(lead->valid()){
+        unsigned int candidate = lead->docID();
+        unsigned long i = 1;
+
+        for(; i < m_children.size(); i++){
+            if(m_algorithm == INTERSECTION_MERGE){
+                while(m_children[i]->valid() && m_children[i]->docID() < candidate)
+                    m_children[i]->next();
             }
             else{
-                if(tokenizeCollection)
-                {
-                    pos = token.find(JSON_TAG_QUESTION_START);
+                m_children[i]->advance(candidate);
+            }
+            if(!m_children[i]->valid()){
+                m_valid = false;    // no more common documents
+                return;
+            }
+            if(m_children[i]->docID() != candidate)
+                break;
+        }
 
-                    if(pos != std::string::npos){
-                        processingQuestion = true;
-                        tokenizedDocsFile << token << " \"";
-                    }
-                    else if( processingQuestion &&
-                             token.find(JSON_TAG_QUESTION_STOP) != std::string::npos){
-                        processingQuestion = false;
+        if(i == m_children.size()){
+            m_valid = true;
+            return;
+        }
+        if(m_algorithm == INTERSECTION_MERGE){
+            while(lead->valid() && lead->docID() < m_children[i]->docID())
+                lead->next();
+        }
+        else{
+            lead->advance(m_children[i]->docID());
+        }
+    }
+    m_valid = false;
+}
 
-                        tokenizedDocsFile << "\", " << token;
-                    }
-                    else if(processingQuestion){
-                        tokens = Tokenizer::singleton().tokenize(token);
-                        for(int i = 0; i < tokens.size(); i++)
-                        {
-                            tokenizedDocsFile << tokens[i] << " ";
-                            posUnused = 0;
-                            fakeDocID = 0;
-                            m_index.addTerm(tokens[i], fakeDocID, posUnused);
-                        }
-                    }
-                    else if(token.find(JSON_TAG_ANSWER_START) != std::string::npos){
-                        processingAnswer = true;
-                        tokenizedDocsFile << token << " \"";
-                    }
-                    else if( processingAnswer && token.length() >= 4 &&
-                             token.rfind(JSON_TAG_ANSWER_STOP) == token.length()-4){
-                        processingAnswer = false;
+OrIterator::OrIterator(const DOC_ITERATOR_LIST& children):
+    m_children(children),
+    m_valid(false),
+    m_docID(0),
+    m_comparisons(0){
 
-                        tokens = Tokenizer::singleton().tokenize(token);
-                        for(int i = 0; i < tokens.size(); i++)
-                        {
-                            posUnused = 0;
-                            fakeDocID = 0;
-                            m_index.addTerm(tokens[i], fakeDocID, posUnused);    
-                            tokenizedDocsFile << tokens[i] << " ";  
-                        }
-                        tokenizedDocsFile << JSON_TAG_ANSWER_STOP << " ";
-                    }
-                    else if( processingAnswer && token.length() >= 3 &&
-                             token.rfind(JSON_TAG_ANSWER_STOP2) == token.length()-3){
-                        processingAnswer = false;
+    findMatch();
+}
 
-                        tokens = Tokenizer::singleton().tokenize(token);
-                        for(int i = 0; i < tokens.size(); i++)
-                        {
-                            posUnused = 0;
-                            fakeDocID = 0;
-                            m_index.addTerm(tokens[i], fakeDocID, posUnused);     
-                            tokenizedDocsFile << tokens[i] << " ";  
-                        }
-                        tokenizedDocsFile << JSON_TAG_ANSWER_STOP2 << " ";
-                    }                    
-                    else if(processingAnswer){
-                        tokens = Tokenizer::singleton().tokenize(token);
-                        for(int i = 0; i < tokens.size(); i++)
-                        {
-                            posUnused = 0;
-                            fakeDocID = 0;
-                            m_index.addTerm(tokens[i], fakeDocID, posUnused);  
-                            tokenizedDocsFile << tokens[i] << " ";
-                        }
-                    }    
-                    else
-                        tokenizedDocsFile << token << " ";
-                }
+OrIterator::~OrIterator(){
+    for(unsigned long i=0; i < m_children.size(); i++)
+        delete m_children[i];
+}
+
+unsigned long OrIterator::cost() const{
+    unsigned long cost = 0;
+    for(unsigned long i=0; i < m_children.size(); i++)
+        cost += m_children[i]->cost();
+    return cost;
+}
+
+unsigned long OrIterator::operations() const{
+    unsigned long operations = m_comparisons;
+    for(unsigned long i=0; i < m_children.size(); i++)
+        operations += m_children[i]->operations();
+    return operations;
+}
+
+void OrIterator::next(){
+    if(!m_valid)
+        return;
+
+    for(unsigned long i=0; i < m_children.size(); i++){
+        if(m_children[i]->valid() && m_children[i]->docID() == m_docID)
+            m_children[i]->next();
+    }
+    findMatch();
+}
+
+void OrIterator::advance(unsigned int target){
+    if(!m_valid || m_docID >= target)
+        return;
+
+    for(unsigned long i=0; i < m_children.size(); i++)
+        m_children[i]->advance(target);
+    findMatch();
+}
+
+void OrIterator::findMatch(){
+    m_valid = false;
+    m_comparisons += m_children.size();
+    for(unsigned long i=0; i < m_children.size(); i++){
+        if(m_children[i]->valid() && (!m_valid || m_children[i]->docID() < m_docID)){
+            m_docID = m_children[i]->docID();
+            m_valid = true;
+        }
+    }
+}
+
+NotIterator::NotIterator(DocIterator* included, DocIterator* excluded):
+    m_included(included),
+    m_excluded(excluded){
+
+    findMatch();
+}
+
+NotIterator::~NotIterator(){
+    delete m_included;
+    delete m_excluded;
+}
+
+void NotIterator::next(){
+    if(m_included->valid()){
+        m_included->next();
+        findMatch();
+    }
+}
+
+void NotIterator::advance(unsigned int target){
+    m_included->advance(target);
+    findMatch();
+}
+
+void NotIterator::findMatch(){
+    while(m_included->valid()){
+        m_excluded->advance(m_included->docID());
+        if(!m_excluded->valid() || m_excluded->docID() != m_included->docID())
+            return;
+        m_included->next();
+    }
+}
+
+BitmapIterator::BitmapIterator(const DOC_ITERATOR_LIST& sources):
+    m_docs(0),
+    m_valid(false),
+    m_docID(0),
+    m_operations(0){
+
+    for(unsigned long i=0; i < sources.size(); i++){
+        for(; sources[i]->valid(); sources[i]->next()){
+            unsigned int docID = sources[i]->docID();
+
+            if(docID / 64 >= m_bits.size())
+                m_bits.resize(docID / 64 + 1, 0);
+            if(!(m_bits[docID / 64] & (1ULL << (docID % 64)))){
+                m_bits[docID / 64] |= 1ULL << (docID % 64);
+                m_docs++;
+            }
+        }
+        m_operations += sources[i]->operations();
+        delete sources[i];
+    }
+    findMatch(0);
+}
+
+void BitmapIterator::next(){
+    if(m_valid){
+        m_operations++;
+        findMatch(static_cast<unsigned long>(m_docID) + 1);
+    }
+}
+
+void BitmapIterator::advance(unsigned int target){
+    if(m_valid && m_docID < target){
+        m_operations++;
+        findMatch(target);
+    }
+}
+
+void BitmapIterator::findMatch(unsigned long from){
+    unsigned long word = from / 64;
+    if(word >= m_bits.size()){
+        m_valid = false;
+        return;
+    }
+
+    unsigned long long bits = m_bits[word] & (~0ULL << (from % 64));   // ignore documents before the given one
+    while(bits == 0){
+        if(++word == m_bits.size()){
+            m_valid = false;
+            return;
+        }
+        bits = m_bits[word];
+    }
+
+#ifdef __GNUC__
+    unsigned int bit = __builtin_ctzll(bits);
+#else
+    unsigned int bit = 0;
+    while(!(bits & (1ULL << bit)))
+        bit++;
+#endif
+
+    m_docID = static_cast<unsigned int>(word * 64 + bit);
+    m_valid = true;
+}
+
+ExplainIterator::ExplainIterator(DocIterator* iterator, QueryNode* node):
+    m_iterator(iterator),
+    m_node(node),
+    m_counted(false),
+    m_lastDocID(0){
+
+    m_node->evaluated = true;
+    countDocument();
+}
+
+ExplainIterator::~ExplainIterator(){
+    m_node->actualCost = m_iterator->operations();
+    delete m_iterator;
+}
+
+void ExplainIterator::countDocument(){
+    if(m_iterator->valid() && (!m_counted || m_iterator->docID() != m_lastDocID)){
+        m_node->actualDocs++;
+        m_lastDocID = m_iterator->docID();
+        m_counted = true;
+    }
+}
+
+PositionalIterator::PositionalIterator(const vector<const CompactPostingList*>& lists, ProximityQuery* query):
+    m_query(query),
+    m_valid(false),
+    m_operations(0){
+
+    // distinct posting lists of the query, from the shortest one, which proposes candidate documents
+    vector<const CompactPostingList*> distinctLists(lists);
+    sort(distinctLists.begin(), distinctLists.end(), PostingListSizeLess());
+    distinctLists.erase(unique(distinctLists.begin(), distinctLists.end()), distinctLists.end());
+
+    for(unsigned long k=0; k < distinctLists.size(); k++)
+        m_cursors.push_back(PostingCursor(distinctLists[k]));
+
+    for(unsigned long k=0; k < lists.size(); k++)
+        m_unitCursors.push_back(find(distinctLists.begin(), distinctLists.end(), lists[k]) - distinctLists.begin());
+}
+
+void PositionalIterator::next(){
+    if(m_valid){
+        m_operations++;
+        m_cursors[0].next();
+        findMatch();
+    }
+}
+
+void PositionalIterator::advance(unsigned int target){
+    if(m_valid && docID() < target){
+        m_operations++;
+        m_cursors[0].advance(target);
+        findMatch();
+    }
+}
+
+void PositionalIterator::findMatch(){
+    // intersect posting lists of all the units and check positioning of the units in common documents
+    while(m_cursors[0].valid()){
+        unsigned int candidate = m_cursors[0].docID();
+        unsigned long k = 1;
+
+        for(; k < m_cursors.size(); k++){
+            m_operations++;
+            m_cursors[k].advance(candidate);
+            if(!m_cursors[k].valid() || m_cursors[k].docID() != candidate)
+                break;
+        }
+
+        if(k < m_cursors.size()){
+            if(!m_cursors[k].valid())
+                break;  // no more common documents
+            m_operations++;
+            m_cursors[0].advance(m_cursors[k].docID());
+            continue;
+        }
+
+        bool verified = true;   // a single term, or a single pair of adjacent terms, needs no positions
+        if(m_unitCursors.size() > 1){
+            m_positions.clear();
+            for(unsigned long t=0; t < m_unitCursors.size(); t++)
+                m_positions.push_back(&m_cursors[m_unitCursors[t]].positions());
+
+            verified = matchPositions(m_positions);
+        }
+        if(m_query)
+            m_query->countCandidate(verified);
+
+        if(verified){
+            m_valid = true;
+            return;
+        }
+        m_operations++;
+        m_cursors[0].next();
+    }
+    m_valid = false;
+}
+
+PhraseIterator::PhraseIterator(const vector<const CompactPostingList*>& lists, const vector<unsigned long>& offsets, ProximityQuery* query):
+    PositionalIterator(lists, query),
+    m_offsets(offsets){
+
+    findMatch();
+}
+
+bool PhraseIterator::matchPositions(const vector<const POSITIONS_LIST*>& positions){
+    return findPhrase(positions, m_offsets);
+}
+
+WindowIterator::WindowIterator(const vector<const CompactPostingList*>& lists, unsigned long proximityWnd, bool ordered, ProximityQuery* query):
+    PositionalIterator(lists, query),
+    m_proximityWnd(proximityWnd),
+    m_ordered(ordered){
+
+    findMatch();
+}
+
+bool WindowIterator::matchPositions(const vector<const POSITIONS_LIST*>& positions){
+    return findProximityWindow(positions, m_proximityWnd, m_ordered);
+}
+
+DocIterator* SearchEngine::proximityIterator(ProximityQuery& proxQuery){
+    vector<unsigned int>& terms = proxQuery.termIDs();
+
+    // a term which is not in the index can't occur in any window
+    if(find(terms.begin(), terms.end(), INVALID_TERM_ID) != terms.end())
+        return new TermIterator(NULL);
+
+    // posting list of every unit of the query with position of the unit in the query. Units are single terms, 
+    // or pairs of adjacent terms from the pair index when the terms must be next to each other.
+    vector<const CompactPostingList*> lists;
+    vector<unsigned long> offsets;
+
+    if(proxQuery.isPhrase() || (proxQuery.isOrdered() && proxQuery.getProximityWnd() == 0)){
+        proxQuery.setPairLists(planPhrase(terms, lists, offsets));
+        return new PhraseIterator(lists, offsets, &proxQuery);
+    }
+
+    for(unsigned int k=0; k < terms.size(); k++)
+        lists.push_back(m_index.getPostings(terms[k]));
+    return new WindowIterator(lists, proxQuery.getProximityWnd(), proxQuery.isOrdered(), &proxQuery);
+}
+
+/**
+ *  @brief orders plan nodes by their estimated number of documents (fewest first), NOT nodes go last
+ */
+class QueryNodeLess{
+public:
+    bool operator()(const QueryNode* node1, const QueryNode* node2) const{
+        if((node1->type == QUERY_NODE_NOT) != (node2->type == QUERY_NODE_NOT))
+            return node2->type == QUERY_NODE_NOT;
+        return node1->estimatedDocs < node2->estimatedDocs;
+    }
+};
+
+/**
+ *  @brief operations of loading a plan node into a bitmap (see BitmapIterator), operands of a disjunction
+ *         are loaded one by one, without comparing their docIDs
+ */
+static double bitmapLoadCost(const QueryNode* node){
+    if(node->type != QUERY_NODE_OR)
+        return node->estimatedCost;
+
+    double cost = 0;
+    for(unsigned long i=0; i < node->children.size(); i++)
+        cost += node->children[i]->estimatedCost;
+    return cost;
+}
+
+QueryNode* SearchEngine::planQuery(QueryNode* node){
+    double documents = m_documentIDs.empty() ? 1.0 : m_documentIDs.size();
+
+    if(node->type == QUERY_NODE_TERM){
+        node->termID = m_index.getTermID(node->text);
+        node->estimatedDocs = node->termID != INVALID_TERM_ID ? m_index.df(node->termID) : 0;
+        node->estimatedCost = node->estimatedDocs;
+        node->probeCost = 1;
+        return node;
+    }
+
+    if(node->type == QUERY_NODE_PROXIMITY){
+        // the terms are assumed to occur independently, the positions are assumed to always match
+        vector<unsigned int> terms = node->proxQuery->termIDs();
+        sort(terms.begin(), terms.end());
+        terms.erase(unique(terms.begin(), terms.end()), terms.end());
+
+        double rarest = documents;
+        node->estimatedDocs = documents;
+        for(unsigned long i=0; i < terms.size(); i++){
+            double df = terms[i] != INVALID_TERM_ID ? m_index.df(terms[i]) : 0;
+            node->estimatedDocs *= df / documents;
+            rarest = min(rarest, df);
+        }
+        node->estimatedCost = rarest * terms.size();
+        node->probeCost = terms.size();
+        return node;
+    }
+
+    for(unsigned long i=0; i < node->children.size(); i++)
+        node->children[i] = planQuery(node->children[i]);
+
+    if(node->type == QUERY_NODE_NOT){
+        // documents of the collection, except the ones of the operand
+        QueryNode* operand = node->children[0];
+        node->estimatedDocs = documents - operand->estimatedDocs;
+        node->estimatedCost = documents * (1 + operand->probeCost);
+        node->probeCost = 1 + operand->probeCost;
+        return node;
+    }
+
+    // merge nested operators of the same kind, and drop repeated terms
+    vector<QueryNode*> children;
+    for(unsigned long i=0; i < node->children.size(); i++){
+        QueryNode* child = node->children[i];
+
+        if(child->type == node->type){
+            children.insert(children.end(), child->children.begin(), child->children.end());
+            child->children.clear();
+            delete child;
+            continue;
+        }
+
+        bool repeated = false;
+        for(unsigned long k=0; k < children.size() && child->type == QUERY_NODE_TERM; k++)
+            repeated = repeated || (children[k]->type == QUERY_NODE_TERM && children[k]->termID == child->termID);
+
+        if(repeated)
+            delete child;
+        else
+            children.push_back(child);
+    }
+    stable_sort(children.begin(), children.end(), QueryNodeLess());
+    node->children = children;
+
+    if(children.size() == 1 && children[0]->type != QUERY_NODE_NOT){
+        node->children.clear();
+        delete node;
+        return children[0];
+    }
+
+    if(node->type == QUERY_NODE_OR){
+        double missing = 1.0;   // fraction of documents matching none of the operands
+        node->estimatedCost = 0;
+        node->probeCost = children.size();
+        for(unsigned long i=0; i < children.size(); i++){
+            missing *= 1.0 - children[i]->estimatedDocs / documents;
+            node->estimatedCost += children[i]->estimatedCost;
+            node->probeCost += children[i]->probeCost;
+        }
+        node->estimatedDocs = documents * (1.0 - missing);
+        node->estimatedCost += node->estimatedDocs * children.size();  // comparisons of docIDs of the operands
+        return node;
+    }
+
+    // AND: the first positive operand proposes candidates, the others are probed for the candidates which
+    // matched the previous operands (gallop), stepped through (merge) or loaded into bitmaps (bitmap)
+    unsigned long positives = 0;
+    while(positives < children.size() && children[positives]->type != QUERY_NODE_NOT)
+        positives++;
+
+    if(positives == 0){
+        node->estimatedDocs = documents;
+        node->estimatedCost = documents;
+        node->probeCost = 1;
+    }
+    else{
+        double candidates = children[0]->estimatedDocs;
+        double mergeCost = children[0]->estimatedCost;
+        double gallopCost = children[0]->estimatedCost;
+        double bitmapCost = children[0]->estimatedCost;
+
+        node->probeCost = children[0]->probeCost;
+        for(unsigned long i=1; i < positives; i++){
+            mergeCost += children[i]->estimatedCost;
+            gallopCost += candidates * children[i]->probeCost;
+            bitmapCost += bitmapLoadCost(children[i]) + candidates;
+            node->probeCost += children[i]->probeCost;
+            candidates *= children[i]->estimatedDocs / documents;
+        }
+
+        node->algorithm = INTERSECTION_GALLOP;
+        node->estimatedCost = gallopCost;
+        if(mergeCost < node->estimatedCost){
+            node->algorithm = INTERSECTION_MERGE;
+            node->estimatedCost = mergeCost;
+        }
+        if(bitmapCost < node->estimatedCost){
+            node->algorithm = INTERSECTION_BITMAP;
+            node->estimatedCost = bitmapCost;
+        }
+        node->estimatedDocs = candidates;
+    }
+
+    // every document of the conjunction is probed in the operands of NOT
+    double included = node->estimatedDocs;
+    for(unsigned long i=positives; i < children.size(); i++){
+        QueryNode* excluded = children[i]->children[0];
+        node->estimatedDocs *= 1.0 - excluded->estimatedDocs / documents;
+        node->estimatedCost += included * excluded->probeCost;
+        node->probeCost += excluded->probeCost;
+    }
+    return node;
+}
+
+DocIterator* SearchEngine::explainIterator(DocIterator* iterator, QueryNode* node){
+    return m_explain ? new ExplainIterator(iterator, node) : iterator;
+}
+
+DocIterator* SearchEngine::queryIterator(QueryNode* node){
+    if(node->type == QUERY_NODE_TERM)
+        return explainIterator(new TermIterator(m_index.getPostings(node->termID)), node);
+
+    if(node->type == QUERY_NODE_PROXIMITY)
+        return explainIterator(proximityIterator(*node->proxQuery), node);
+
+    if(node->type == QUERY_NODE_NOT)
+        return explainIterator(new NotIterator(new DocListIterator(m_documentIDs), queryIterator(node->children[0])), node);
+
+    DOC_ITERATOR_LIST iterators;
+    if(node->type == QUERY_NODE_OR){
+        for(unsigned long i=0; i < node->children.size(); i++)
+            iterators.push_back(queryIterator(node->children[i]));
+        return explainIterator(new OrIterator(iterators), node);
+    }
+
+    DOC_ITERATOR_LIST excluded;
+    for(unsigned long i=0; i < node->children.size(); i++){
+        QueryNode* child = node->children[i];
+
+        if(child->type == QUERY_NODE_NOT){
+            excluded.push_back(queryIterator(child->children[0]));
+        }
+        else if(i > 0 && node->algorithm == INTERSECTION_BITMAP){
+            // operands of a disjunction are loaded into the bitmap directly
+            DOC_ITERATOR_LIST sources;
+            if(child->type == QUERY_NODE_OR){
+                for(unsigned long k=0; k < child->children.size(); k++)
+                    sources.push_back(queryIterator(child->children[k]));
+            }
+            else{
+                sources.push_back(queryIterator(child));
             }
+            iterators.push_back(explainIterator(new BitmapIterator(sources), child));
         }
+        else{
+            iterators.push_back(queryIterator(child));
+        }
+    }
 
-        if(tokenizeCollection)
-            tokenizedDocsFile << endl;
+    DocIterator* iterator;
+    if(iterators.empty())
+        iterator = new DocListIterator(m_documentIDs);
+    else if(iterators.size() == 1)
+        iterator = iterators[0];
+    else
+        iterator = new AndIterator(iterators, node->algorithm);
+
+    if(excluded.size() == 1)
+        iterator = new NotIterator(iterator, excluded[0]);
+    else if(excluded.size() > 1)
+        iterator = new NotIterator(iterator, new OrIterator(excluded));
+
+    return explainIterator(iterator, node);
+}
+
+void SearchEngine::printPlan(const QueryNode* node, unsigned int depth){
+    const char* algorithms[] = {"merge", "gallop", "bitmap"};
+
+    cout << string(2 * depth + 2, ' ');
+    if(node->type == QUERY_NODE_TERM)
+        cout << "TERM " << node->text;
+    else if(node->type == QUERY_NODE_PROXIMITY)
+        cout << (node->proxQuery->isPhrase() ? "PHRASE " : "PROXIMITY ") << node->text;
+    else if(node->type == QUERY_NODE_AND)
+        cout << "AND (" << algorithms[node->algorithm] << ")";
+    else if(node->type == QUERY_NODE_OR)
+        cout << "OR";
+    else
+        cout << "NOT";
+
+    cout << ": estimated docs " << static_cast<unsigned long>(node->estimatedDocs + 0.5) 
+         << ", cost " << static_cast<unsigned long>(node->estimatedCost + 0.5);
+    if(node->evaluated)
+        cout << "; actual docs " << node->actualDocs << ", cost " << node->actualCost;
+    cout << endl;
+
+    for(unsigned long i=0; i < node->children.size(); i++)
+        printPlan(node->children[i], depth + 1);
+}
+
+void SearchEngine::collectProximityQueries(QueryNode* node, vector<ProximityQuery*>& proxQueries){
+    if(node->type == QUERY_NODE_PROXIMITY)
+        proxQueries.push_back(node->proxQuery);
+
+    for(unsigned long i=0; i < node->children.size(); i++)
+        collectProximityQueries(node->children[i], proxQueries);
+}
+
+void SearchEngine::printPhraseStats(ProximityQuery& proxQuery){
+    if(!m_phraseStats || !proxQuery.isPhrase())
+        return;
+
+    cout << "PHRASE: \"" << proxQuery.text() << "\", candidate documents: " << proxQuery.candidateDocs() 
+         << ", verified: " << proxQuery.verifiedDocs();
+    if(proxQuery.pairLists() > 0)
+        cout << ", pair lists: " << proxQuery.pairLists();
+    cout << endl;
+}
+
+vector<unsigned long> SearchEngine::booleanSearch(string query)
+{
+    vector<unsigned long> searchResultSet;
+    refreshIndex();
+
+    QueryParser parser(query);
+    QueryNode* root = parser.parse();
+    if(root == NULL)
+        return searchResultSet;     // no terms to match
+
+    vector<ProximityQuery*> proxQueries;
+    collectProximityQueries(root, proxQueries);
+    for(unsigned long i=0; i < proxQueries.size(); i++)
+        proxQueries[i]->resolveTerms(m_index);
+
+    root = planQuery(root);
+
+    DocIterator* matches = queryIterator(root);
+    for(; matches->valid(); matches->next())
+        searchResultSet.push_back(matches->docID());
+    delete matches;
+
+    for(unsigned long i=0; i < proxQueries.size(); i++)
+        printPhraseStats(*proxQueries[i]);
+
+    if(m_explain){
+        cout << "PLAN: \"" << query << "\"" << endl;
+        printPlan(root, 0);
     }
-    inFile.close();  
-    if(tokenizeCollection)
-        tokenizedDocsFile.close();
 
-   // cout << "Biggest doc in collection contains " << biggestDocSize << " words" << endl;
+    delete root;
+    return searchResultSet;
 }
 
-vector<unsigned long> SearchEngine::intersect(vector<unsigned long> v1, vector<unsigned long> v2){
-    vector<unsigned long> intersection;
+void SearchEngine::updateDocumentIDs(){
+    m_documentIDs = m_collectionDocIDs;
+    sort(m_documentIDs.begin(), m_documentIDs.end());
+    m_documentIDs.erase(unique(m_documentIDs.begin(), m_documentIDs.end()), m_documentIDs.end());
+}
 
-    vector<unsigned long>::const_iterator v1_it = v1.begin();
-    vector<unsigned long>::const_iterator v2_it = v2.begin();
 
-    while(v1_it != v1.end() && v2_it != v2.end()){
-        if( (*v1_it) == (*v2_it)){
-            // docID matched, add to the answer
-            intersection.push_back(*v1_it);
-            v1_it++;
-            v2_it++;
+void SearchEngine::collectTermIDs(PROXIMITY_QUERY_LIST& proxQueries, FREETEXT_QUERY_LIST& freeTextQueries, vector<unsigned int>& termIDs){
+    // put all terms into one single list
+    for(unsigned long i=0; i < proxQueries.size(); i++){
+        vector<unsigned int>& curQueryTerms = proxQueries[i].termIDs();
+        for(unsigned long k=0; k < curQueryTerms.size(); k++){
+            if(curQueryTerms[k] != INVALID_TERM_ID)
+                termIDs.push_back(curQueryTerms[k]);
         }
-        else if(*v1_it < *v2_it){
-            v1_it++;
+    }
+
+    for(unsigned long i=0; i < freeTextQueries.size(); i++){
+        vector<unsigned int>& curQueryTerms = freeTextQueries[i].termIDs();
+        for(unsigned long k=0; k < curQueryTerms.size(); k++){
+            if(curQueryTerms[k] != INVALID_TERM_ID)
+                termIDs.push_back(curQueryTerms[k]);
         }
-        else{
-            v2_it++;
+    }
+}
+
+template<class Scorer>
+bool SearchEngine::score(const Scorer& scorer, const vector<unsigned int>& termIDs, vector<PostingCursor>& cursors, unsigned long docID, double& score){
+    score = 0.0;
+    bool atLeastOneTermInDoc = false;
+
+    // sum up weights of each term present in the doc
+    for(unsigned long i=0; i < termIDs.size(); i++){
+        PostingCursor& cursor = cursors[i];
+
+        cursor.advance(docID);
+        if(cursor.valid() && cursor.docID() == docID){
+            score += scorer.weight(cursor, m_index.idf(termIDs[i]));
+            atLeastOneTermInDoc = true;
+        }
+    }
+    return atLeastOneTermInDoc;
+}
+
+void TopDocs::collect(double score, unsigned long docID){
+    Entry entry(score, m_count++, docID);
+
+    if(m_maxResults == 0){
+        m_heap.push_back(entry);    // everything is kept, sorted in sortedResults()
+    }
+    else if(m_heap.size() < m_maxResults){
+        m_heap.push_back(entry);
+        push_heap(m_heap.begin(), m_heap.end(), greater<Entry>());
+    }
+    else if(entry > m_heap.front()){
+        pop_heap(m_heap.begin(), m_heap.end(), greater<Entry>());
+        m_heap.back() = entry;
+        push_heap(m_heap.begin(), m_heap.end(), greater<Entry>());
+    }
+}
+
+void TopDocs::sortedResults(SCORED_DOC_LIST& results){
+    if(m_maxResults == 0)
+        sort(m_heap.begin(), m_heap.end(), greater<Entry>());
+    else
+        sort_heap(m_heap.begin(), m_heap.end(), greater<Entry>());   // best document goes first
+
+    results.clear();
+    results.reserve(m_heap.size());
+    for(unsigned long i=0; i < m_heap.size(); i++)
+        results.push_back(ScoredDoc(m_heap[i].score, m_heap[i].docID));
+
+    m_heap.clear();
+    m_count = 0;
+}
+
+void SearchEngine::prepareQueryTerms(const vector<unsigned int>& termIDs, QUERY_TERM_LIST& queryTerms, vector<unsigned int>& occurrences){
+    for(unsigned long i=0; i < termIDs.size(); i++){
+        unsigned int k = 0;
+        while(k < queryTerms.size() && queryTerms[k].termID != termIDs[i])
+            k++;
+
+        if(k == queryTerms.size()){
+            // first occurrence of the term
+            const CompactPostingList* pPostings = m_index.getPostings(termIDs[i]);
+
+            queryTerms.push_back(QueryTerm(termIDs[i], pPostings));
+            queryTerms[k].idf = m_index.idf(termIDs[i]);
+            queryTerms[k].cursor.advance(FIRST_DOC_ID);
         }
+
+        // each occurrence of a term in the query adds its weight to the score
+        queryTerms[k].upperBound += maxTermWeight(queryTerms[k], m_index.getPostings(termIDs[i])->maxTf());
+        queryTerms[k].queryTf++;
+        occurrences.push_back(k);
     }
+}
+
+template<class Scorer>
+double SearchEngine::scoreAtCursors(const Scorer& scorer, QUERY_TERM_LIST& queryTerms, const vector<unsigned int>& occurrences, unsigned int docID){
+    double score = 0.0;
+
+    for(unsigned long i=0; i < occurrences.size(); i++){
+        PostingCursor& cursor = queryTerms[occurrences[i]].cursor;
 
-    return intersection;
+        if(cursor.valid() && cursor.docID() == docID)
+            score += scorer.weight(cursor, queryTerms[occurrences[i]].idf);
+    }
+    return score;
 }
 
-vector<unsigned long> SearchEngine::intersect(const POSTING_LIST* p1, const POSTING_LIST* p2){
-    vector<unsigned long> answer;
+/**
+ *  @brief orders query terms by docID of their cursors, exhausted cursors go last
+ */
+class CursorDocIDLess{
+public:
+    explicit CursorDocIDLess(const QUERY_TERM_LIST& queryTerms): m_queryTerms(queryTerms){}
+
+    bool operator()(unsigned int t1, unsigned int t2) const{
+        const PostingCursor& c1 = m_queryTerms[t1].cursor;
+        const PostingCursor& c2 = m_queryTerms[t2].cursor;
+
+        if(!c2.valid())
+            return c1.valid();
+        return c1.valid() && c1.docID() < c2.docID();
+    }
+
+private:
+    const QUERY_TERM_LIST& m_queryTerms;
+};
+
+template<class Scorer>
+void SearchEngine::wandSearch(const Scorer& scorer, QUERY_TERM_LIST& queryTerms, const vector<unsigned int>& occurrences, bool blockMax, TopDocs& topDocs){
+    vector<unsigned int> order;     // query terms sorted by docID of their cursors
+
+    for(unsigned int i=0; i < queryTerms.size(); i++)
+        order.push_back(i);
+
+    while(true){
+        sort(order.begin(), order.end(), CursorDocIDLess(queryTerms));
+
+        // find pivot: the first term at which the sum of upper bounds can beat the k-th best score.
+        // A document with score equal to the k-th best still gets in, since it has higher docID.
+        double threshold = topDocs.threshold();
+        double upperBound = 0.0;
+        unsigned int pivot = 0;
+
+        for(; pivot < order.size() && queryTerms[order[pivot]].cursor.valid(); pivot++){
+            upperBound += queryTerms[order[pivot]].upperBound;
+            if(upperBound + SCORE_EPSILON >= threshold)
+                break;
+        }
 
-    if(p1 && p2){
-        POSTING_LIST::const_iterator p1_it = p1->begin();
-        POSTING_LIST::const_iterator p2_it = p2->begin();
+        if(pivot == order.size() || !queryTerms[order[pivot]].cursor.valid())
+            break; // no more documents can make it into the result
 
-        while(p1_it != p1->end() && p2_it != p2->end()){
-            if( (*p1_it).first == (*p2_it).first){
-                // docID matched, add to the answer
-                answer.push_back((*p1_it).first);
-                p1_it++;
-                p2_it++;
+        unsigned int pivotDocID = queryTerms[order[pivot]].cursor.docID();
+
+        // terms following the pivot which are at the pivot document can contribute to its score as well
+        while(pivot + 1 < order.size() && queryTerms[order[pivot + 1]].cursor.valid() && 
+              queryTerms[order[pivot + 1]].cursor.docID() == pivotDocID)
+            pivot++;
+
+        if(blockMax){
+            // check the pivot against upper bounds of the blocks which may contain it
+            double blockUpperBound = 0.0;
+            unsigned int nextDocID = MAX_DOC_ID;
+
+            for(unsigned int i=0; i <= pivot; i++){
+                QueryTerm& term = queryTerms[order[i]];
+
+                term.cursor.shallowAdvance(pivotDocID);
+                if(term.cursor.blockMaxTf() > 0)
+                    blockUpperBound += term.queryTf * maxTermWeight(term, term.cursor.blockMaxTf());
+                if(term.cursor.blockLastDocID() < nextDocID)
+                    nextDocID = term.cursor.blockLastDocID() + 1;
             }
-            else if((*p1_it).first < (*p2_it).first){
-                p1_it++;
+
+            if(blockUpperBound + SCORE_EPSILON < threshold){
+                // no document before the end of the shortest block (or before the next term's document)
+                // can beat the threshold, since only the terms up to the pivot may be present in it
+                if(pivot + 1 < order.size() && queryTerms[order[pivot + 1]].cursor.valid() &&
+                   queryTerms[order[pivot + 1]].cursor.docID() < nextDocID)
+                    nextDocID = queryTerms[order[pivot + 1]].cursor.docID();
+
+                for(unsigned int i=0; i <= pivot; i++)
+                    queryTerms[order[i]].cursor.advance(nextDocID);
+                continue;
             }
-            else{
-                p2_it++;
+        }
+
+        if(queryTerms[order[0]].cursor.docID() == pivotDocID){
+            // all terms before the pivot are at the pivot document, evaluate it
+            topDocs.collect(scoreAtCursors(scorer, queryTerms, occurrences, pivotDocID), pivotDocID);
+
+            for(unsigned int i=0; i < order.size(); i++){
+                PostingCursor& cursor = queryTerms[order[i]].cursor;
+                if(cursor.valid() && cursor.docID() == pivotDocID)
+                    cursor.next();
             }
         }
+        else{
+            // documents before the pivot can't beat the threshold, move the preceding terms to the pivot
+            for(unsigned int i=0; i < pivot; i++)
+                queryTerms[order[i]].cursor.advance(pivotDocID);
+        }
     }
-
-    return answer;
 }
 
-void SearchEngine::buildQueries(string userQuestion, PROXIMITY_QUERY_LIST& proxQueries, FREETEXT_QUERY_LIST& freeTextQueries){
-    string curQuery;
-    unsigned long proxWnd = 0;
+/**
+ *  @brief orders query terms by their score upper bounds
+ */
+class UpperBoundLess{
+public:
+    explicit UpperBoundLess(const QUERY_TERM_LIST& queryTerms): m_queryTerms(queryTerms){}
 
-    for(unsigned int i=0; i < userQuestion.length(); i++){       
-        if(i < userQuestion.length()-1 && isdigit(userQuestion[i]) && userQuestion[i+1] == '('){
-            // beginning of proximity query
-            
-            proxWnd = userQuestion[i] - '0'; // convert ASCII to digit
+    bool operator()(unsigned int t1, unsigned int t2) const{
+        return m_queryTerms[t1].upperBound < m_queryTerms[t2].upperBound;
+    }
 
-            if(curQuery != ""){
-                Query freeTextQuery(curQuery);
-                if(freeTextQuery.terms().size() > 0)
-                    freeTextQueries.push_back(freeTextQuery);
-                curQuery = "";
+private:
+    const QUERY_TERM_LIST& m_queryTerms;
+};
+
+template<class Scorer>
+void SearchEngine::maxScoreSearch(const Scorer& scorer, QUERY_TERM_LIST& queryTerms, const vector<unsigned int>& occurrences, TopDocs& topDocs){
+    vector<unsigned int> order;     // query terms sorted by score upper bounds
+    vector<double> boundSums;       // sum of upper bounds of the terms in order, up to and including each one
+    unsigned int essential = 0;     // index in order of the first essential term
+
+    for(unsigned int i=0; i < queryTerms.size(); i++)
+        order.push_back(i);
+    stable_sort(order.begin(), order.end(), UpperBoundLess(queryTerms));
+
+    double boundSum = 0.0;
+    for(unsigned int i=0; i < order.size(); i++){
+        boundSum += queryTerms[order[i]].upperBound;
+        boundSums.push_back(boundSum);
+    }
+
+    while(essential < order.size()){
+        // next candidate is the smallest document in the lists of essential terms
+        unsigned int candidate = MAX_DOC_ID;
+        for(unsigned int i = essential; i < order.size(); i++){
+            const PostingCursor& cursor = queryTerms[order[i]].cursor;
+            if(cursor.valid() && cursor.docID() < candidate)
+                candidate = cursor.docID();
+        }
+
+        if(candidate == MAX_DOC_ID)
+            break; // essential lists are exhausted
+
+        double threshold = topDocs.threshold();
+        double partialScore = 0.0;
+
+        for(unsigned int i = essential; i < order.size(); i++){
+            const QueryTerm& term = queryTerms[order[i]];
+            if(term.cursor.valid() && term.cursor.docID() == candidate)
+                partialScore += term.queryTf * scorer.weight(term.cursor, term.idf);
+        }
+
+        // probe non-essential lists, starting from the highest upper bound, while the candidate can still make it.
+        // A document with score equal to the k-th best still gets in, since it has higher docID.
+        bool competitive = true;
+        for(int i = static_cast<int>(essential) - 1; i >= 0; i--){
+            if(partialScore + boundSums[i] + SCORE_EPSILON < threshold){
+                competitive = false;
+                break;
             }
-            i++; // skip the bracket
+
+            QueryTerm& term = queryTerms[order[i]];
+            term.cursor.advance(candidate);
+            if(term.cursor.valid() && term.cursor.docID() == candidate)
+                partialScore += term.queryTf * scorer.weight(term.cursor, term.idf);
         }
-        else if(userQuestion[i] == ')'){
-            // end of proximity query
-            if(curQuery != ""){
-                ProximityQuery proxQ(curQuery, proxWnd);
-                if(proxQ.terms().size() > 0)
-                    proxQueries.push_back(proxQ);
-                curQuery = "";
+
+        if(competitive){
+            // partial score only estimates the score, calculate it the same way as exhaustive evaluation does
+            topDocs.collect(scoreAtCursors(scorer, queryTerms, occurrences, candidate), candidate);
+
+            // terms which together can't beat the new k-th best score become non-essential
+            while(essential < order.size() && boundSums[essential] + SCORE_EPSILON < topDocs.threshold())
+                essential++;
+        }
+
+        for(unsigned int i = essential; i < order.size(); i++){
+            PostingCursor& cursor = queryTerms[order[i]].cursor;
+            if(cursor.valid() && cursor.docID() == candidate)
+                cursor.next();
+        }
+    }
+}
+
+/**
+ *  @brief orders query terms from the rarest one, i.e. by idf in decreasing order
+ */
+class IdfGreater{
+public:
+    explicit IdfGreater(const QUERY_TERM_LIST& queryTerms): m_queryTerms(queryTerms){}
+
+    bool operator()(unsigned int t1, unsigned int t2) const{
+        return m_queryTerms[t1].idf > m_queryTerms[t2].idf;
+    }
+
+private:
+    const QUERY_TERM_LIST& m_queryTerms;
+};
+
+template<class Scorer>
+void SearchEngine::taatSearch(const Scorer& scorer, QUERY_TERM_LIST& queryTerms, TopDocs& topDocs){
+    vector<unsigned int> order;     // order of processing the query terms
+    unsigned int lastDocID = 0;
+
+    for(unsigned int i=0; i < queryTerms.size(); i++){
+        order.push_back(i);
+        if(m_index.getPostings(queryTerms[i].termID)->lastDocID() > lastDocID)
+            lastDocID = m_index.getPostings(queryTerms[i].termID)->lastDocID();
+    }
+
+    // accumulators are only allocated when the collection grows, and reset by selectTopDocs() after every query
+    if(m_accumulators.size() < static_cast<unsigned long>(lastDocID) + 1)
+        m_accumulators.resize(static_cast<unsigned long>(lastDocID) + 1, ACCUMULATOR_EMPTY);
+
+    if(m_accumulatorLimit > 0){
+        // with limited accumulators, rare terms (with highest weights) should get them first
+        stable_sort(order.begin(), order.end(), IdfGreater(queryTerms));
+    }
+
+    float* accumulators = m_accumulators.data();
+    unsigned long accumulatorsCount = 0;
+    bool addAccumulators = true;
+
+    for(unsigned int i=0; i < order.size(); i++){
+        QueryTerm& term = queryTerms[order[i]];
+
+        for(; term.cursor.valid(); term.cursor.next()){
+            float& accumulator = accumulators[term.cursor.docID()];
+            double weight = term.queryTf * scorer.weight(term.cursor, term.idf);
+
+            if(accumulator != ACCUMULATOR_EMPTY){
+                accumulator += weight;
+            }
+            else if(addAccumulators){
+                accumulator = weight;
+
+                if(++accumulatorsCount == m_accumulatorLimit){
+                    if(m_accumulatorLimitMode == ACCUMULATOR_LIMIT_QUIT)
+                        break;
+                    addAccumulators = false;
+                }
             }
         }
-        else
-            curQuery += userQuestion[i];
+
+        if(m_accumulatorLimit > 0 && accumulatorsCount == m_accumulatorLimit && m_accumulatorLimitMode == ACCUMULATOR_LIMIT_QUIT)
+            break;
     }
 
-    if(curQuery != ""){
-        freeTextQueries.push_back(Query(curQuery));
-    }   
+    selectTopDocs(lastDocID, topDocs);
 }
 
-bool SearchEngine::findProximityPair(const Posting p1, const Posting p2, unsigned long proximityWnd ){
-    for(unsigned int i = 0; i < p1.positions.size(); i++){
-        long pos1 = p1.positions[i];
+/**
+ *  @brief Segment of impact-ordered posting list of a query term, see saatSearch()
+ */
+class QuerySegment{
+public:
+    QuerySegment(unsigned int term, unsigned int segment, unsigned int contribution):
+        term(term), segment(segment), contribution(contribution){}
+
+    // orders segments by decreasing contribution, stable sort keeps terms and their segments in order on equal contribution
+    bool operator<(const QuerySegment& other) const {return contribution > other.contribution;}
 
-        for(unsigned int k = 0; k < p2.positions.size(); k++){
-            long pos2 = p2.positions[k];
+    unsigned int term;          // index of the query term
+    unsigned int segment;       // index of the segment in the term's list
+    unsigned int contribution;  // impact of the segment multiplied by number of the term's occurrences in the query
+};
 
-            if(pos2 - pos1 > 0  && pos2 - pos1 <= (proximityWnd+1)) // adding 1 to proximity window since distance is represented by the difference in indexes 
-                return true;
+void SearchEngine::saatSearch(const QUERY_TERM_LIST& queryTerms, TopDocs& topDocs){
+    vector<QuerySegment> segments;
+    unsigned int lastDocID = 0;
+
+    for(unsigned int i=0; i < queryTerms.size(); i++){
+        const ImpactOrderedList* pPostings = m_index.getImpactOrderedPostings(queryTerms[i].termID);
+
+        for(unsigned int k=0; k < pPostings->segmentsCount(); k++)
+            segments.push_back(QuerySegment(i, k, queryTerms[i].queryTf * pPostings->segment(k).impact));
+
+        if(m_index.getPostings(queryTerms[i].termID)->lastDocID() > lastDocID)
+            lastDocID = m_index.getPostings(queryTerms[i].termID)->lastDocID();
+    }
+    stable_sort(segments.begin(), segments.end());
+
+    // accumulators are only allocated when the collection grows, and reset by selectTopDocs() after every query
+    if(m_accumulators.size() < static_cast<unsigned long>(lastDocID) + 1)
+        m_accumulators.resize(static_cast<unsigned long>(lastDocID) + 1, ACCUMULATOR_EMPTY);
+
+    float* accumulators = m_accumulators.data();
+    unsigned long budget = m_postingsBudget > 0 ? m_postingsBudget : ~0UL;
+
+    for(unsigned int i=0; i < segments.size() && budget > 0; i++){
+        const ImpactOrderedList* pPostings = m_index.getImpactOrderedPostings(queryTerms[segments[i].term].termID);
+        const ImpactSegment& segment = pPostings->segment(segments[i].segment);
+        unsigned int maxCount = budget < segment.count ? budget : segment.count;
+
+        if(m_segmentDocIDs.size() < maxCount + POSTING_BLOCK_SIZE)
+            m_segmentDocIDs.resize(maxCount + POSTING_BLOCK_SIZE);
+
+        unsigned int count = pPostings->decodeSegment(segments[i].segment, maxCount, m_segmentDocIDs.data());
+        float contribution = segments[i].contribution;
+
+        for(unsigned int k=0; k < count; k++){
+            float& accumulator = accumulators[m_segmentDocIDs[k]];
+            accumulator = accumulator != ACCUMULATOR_EMPTY ? accumulator + contribution : contribution;
         }
+        budget -= count;
     }
-    return false;
+
+    selectTopDocs(lastDocID, topDocs);
 }
 
-vector<unsigned long> SearchEngine::filterBy(PROXIMITY_QUERY_LIST& proxQueries){
-    vector<unsigned long> combinedResults;
-    vector<unsigned long> curQueryResult;
+RANKING_ALGORITHM SearchEngine::chooseRankingAlgorithm(const QUERY_TERM_LIST& queryTerms){
+    if(m_rankingAlgorithm == RANKING_SAAT && !m_index.impactOrdered())
+        m_index.setImpactOrdered(true); // impact-ordered lists are built on first use
 
-    for(int i=0; i < proxQueries.size(); i++){
-        vector<string> terms = proxQueries[i].terms();
+    if(m_rankingAlgorithm != RANKING_AUTO)
+        return m_rankingAlgorithm;
 
-        const POSTING_LIST* pTerm1List = m_index.getPostings(terms[0]);
-        const POSTING_LIST* pTerm2List = m_index.getPostings(terms[1]);
-        vector<unsigned long> termsIntercectionSet = intersect(pTerm1List, pTerm2List);    
+    if(m_index.impactOrdered() && m_postingsBudget > 0){
+        unsigned long postingsCount = 0;
+        for(unsigned int i=0; i < queryTerms.size(); i++)
+            postingsCount += queryTerms[i].cursor.size();
 
-        // check positioning
-        curQueryResult.clear();
-        for(unsigned long y = 0; y < termsIntercectionSet.size(); y++){
-            unsigned long docID = termsIntercectionSet[y];
-            const Posting p1 = pTerm1List->find(docID)->second;
-            const Posting p2 = pTerm2List->find(docID)->second;
+        if(postingsCount > m_postingsBudget)
+            return RANKING_SAAT;   // exact evaluation would take too long
+    }
+
+    return queryTerms.size() >= MAXSCORE_MIN_TERMS ? RANKING_MAXSCORE : RANKING_BLOCK_MAX_WAND;
+}
+
+void SearchEngine::selectTopDocs(unsigned int lastDocID, TopDocs& topDocs){
+    float* accumulators = m_accumulators.data();
+    unsigned long end = static_cast<unsigned long>(lastDocID) + 1;
+    unsigned long docID = 0;
+
+#ifdef __SSE__
+    // compare 4 accumulators at a time with the current k-th best score, most of them don't make it
+    const __m128 empty = _mm_set1_ps(ACCUMULATOR_EMPTY);
+    __m128 threshold = _mm_set1_ps(-FLT_MAX);
 
-            if(findProximityPair(p1,p2, proxQueries[i].getProximityWnd()))
-                curQueryResult.push_back(docID);
+    for(; docID + 4 <= end; docID += 4){
+        __m128 values = _mm_loadu_ps(accumulators + docID);
+        int mask = _mm_movemask_ps(_mm_cmpge_ps(values, threshold));
+
+        if(mask != 0){
+            for(unsigned int lane = 0; lane < 4; lane++){
+                if(mask & (1 << lane))
+                    topDocs.collect(accumulators[docID + lane], docID + lane);
+            }
+            if(topDocs.full())
+                threshold = _mm_set1_ps(static_cast<float>(topDocs.threshold()));
         }
+        _mm_storeu_ps(accumulators + docID, empty);
+    }
+#endif
 
-        if(i == 0)
-            combinedResults = curQueryResult;
+    for(; docID < end; docID++){
+        if(accumulators[docID] != ACCUMULATOR_EMPTY){
+            if(!topDocs.full() || accumulators[docID] >= topDocs.threshold())
+                topDocs.collect(accumulators[docID], docID);
+            accumulators[docID] = ACCUMULATOR_EMPTY;
+        }
+    }
+}
 
-        combinedResults = intersect(combinedResults, curQueryResult);
+template<class Scorer>
+void SearchEngine::evaluateQuery(const Scorer& scorer, RANKING_ALGORITHM algorithm, QUERY_TERM_LIST& queryTerms, 
+                                 const vector<unsigned int>& occurrences, TopDocs& topDocs){
+    if(algorithm == RANKING_TAAT){
+        taatSearch(scorer, queryTerms, topDocs);
+    }
+    else if(algorithm == RANKING_MAXSCORE){
+        maxScoreSearch(scorer, queryTerms, occurrences, topDocs);
+    }
+    else{
+        wandSearch(scorer, queryTerms, occurrences, algorithm == RANKING_BLOCK_MAX_WAND, topDocs);
     }
+}
 
-    return combinedResults;
+void SearchEngine::exhaustiveSearch(DocIterator& searchSet, const vector<unsigned int>& termIDs, TopDocs& topDocs){
+    if(m_impactScoring)
+        scoreDocuments(ImpactScorer(), searchSet, termIDs, topDocs);
+    else if(m_index.rankingModel() == RANKING_MODEL_BM25)
+        scoreDocuments(Bm25Scorer(m_index), searchSet, termIDs, topDocs);
+    else
+        scoreDocuments(TfIdfScorer(), searchSet, termIDs, topDocs);
 }
 
-vector<unsigned long> SearchEngine::intersectWithQuery(vector<unsigned long>& filterSet, Query& freeTextQuery){
-    // execute intersection algorithm
-    vector<unsigned long> intersection;
-    vector<string> terms =freeTextQuery.terms();
+template<class Scorer>
+void SearchEngine::scoreDocuments(const Scorer& scorer, DocIterator& searchSet, const vector<unsigned int>& termIDs, TopDocs& topDocs){
+    vector<PostingCursor> cursors;
+    bool first = true;
+    unsigned int lastDocID = 0;
+
+    for(; searchSet.valid(); searchSet.next()){
+        unsigned int docID = searchSet.docID();
+        double docScore;
 
-    for(int i=0; i < terms.size(); i++){
-        const POSTING_LIST* pTermList = m_index.getPostings(terms[i]);
+        if(first || docID < lastDocID){
+            // (re)start posting cursors, collection built from several files may restart docIDs from 1
+            cursors.clear();
+            for(unsigned long k=0; k < termIDs.size(); k++)
+                cursors.push_back(PostingCursor(m_index.getPostings(termIDs[k])));
+            first = false;
+        }
+        lastDocID = docID;
 
-        vector<unsigned long> curTermList = intersect(pTermList, pTermList);
-        if(i == 0)
-            intersection = curTermList;
-        else    
-            intersection = intersect(intersection, curTermList);
+        if(score(scorer, termIDs, cursors, docID, docScore))
+            topDocs.collect(docScore, docID);
     }
+}
 
-    if(filterSet.size() > 0)
-        intersection = intersect(filterSet, intersection);
+/**
+ *  @brief compares results of two ranked searches. With non-zero tolerance, only scores at each rank are compared,
+ *         and they may differ by the given fraction.
+ */
+static bool sameResults(const SCORED_DOC_LIST& expected, const SCORED_DOC_LIST& results, double tolerance){
+    if(tolerance == 0.0)
+        return expected == results;
 
-    return intersection;
+    if(expected.size() != results.size())
+        return false;
+    for(unsigned long i=0; i < expected.size(); i++){
+        if(fabs(expected[i].score - results[i].score) > tolerance * fabs(expected[i].score))
+            return false;
+    }
+    return true;
 }
 
-vector<unsigned long> SearchEngine::booleanSearch(string query)
+SCORED_DOC_LIST SearchEngine::rankedSearch(string query, unsigned long maxResults)
 {
-    vector<unsigned long> searchResultSet;
+    refreshIndex();
+
     // extract proximity queries and free-text queries into separate lists
     PROXIMITY_QUERY_LIST proxQueries;
     FREETEXT_QUERY_LIST freeTextQueries;
     buildQueries(query, proxQueries, freeTextQueries);
 
-    if(proxQueries.size() > 0){
-        // filter search by proximity queries if any
-        vector<unsigned long> filteredSet = filterBy(proxQueries);
+    vector<unsigned int> termIDs;
+    collectTermIDs(proxQueries, freeTextQueries, termIDs);
+    for(unsigned long i=0; i < termIDs.size(); i++)
+        m_index.updateTermWeights(termIDs[i]);    // impacts are updated lazily after documents were deleted or updated
 
-        if(filteredSet.size() > 0){
-            // intersect filteredSet with search results of free text queries
-            for(unsigned int i=0; i < freeTextQueries.size(); i++){          
-                filteredSet = intersectWithQuery(filteredSet, freeTextQueries[i]);
-            }
-        }
+    TopDocs topDocs(maxResults);
+    SCORED_DOC_LIST results;
+    bool impactScores = m_impactScoring;    // whether scores are sums of impacts
 
-        searchResultSet = filteredSet;
-    }
-    else{
-        // just intersect search results of free text queries, with empty "filtere set" 
-        for(unsigned int i=0; i < freeTextQueries.size(); i++){          
-            searchResultSet = intersectWithQuery(searchResultSet, freeTextQueries[i]);
+    if(proxQueries.size() == 0 && m_rankingAlgorithm != RANKING_EXHAUSTIVE && 
+       (maxResults > 0 || m_rankingAlgorithm == RANKING_TAAT || m_rankingAlgorithm == RANKING_SAAT)){
+        // only the best documents are needed (or scores are accumulated) - evaluate posting 
+        // lists of the query terms instead of scoring every document in the collection
+        QUERY_TERM_LIST queryTerms;
+        vector<unsigned int> occurrences;
+        prepareQueryTerms(termIDs, queryTerms, occurrences);
+
+        RANKING_ALGORITHM algorithm = chooseRankingAlgorithm(queryTerms);
+        if(algorithm == RANKING_SAAT){
+            saatSearch(queryTerms, topDocs);
+            impactScores = true;
         }
-    }
+        else if(m_impactScoring){
+            evaluateQuery(ImpactScorer(), algorithm, queryTerms, occurrences, topDocs);
+        }
+        else if(m_index.rankingModel() == RANKING_MODEL_BM25){
+            evaluateQuery(Bm25Scorer(m_index), algorithm, queryTerms, occurrences, topDocs);
+        }
+        else{
+            evaluateQuery(TfIdfScorer(), algorithm, queryTerms, occurrences, topDocs);
+        }
+        topDocs.sortedResults(results);
 
-    return searchResultSet;
-}
+        if(m_verifyRanking){
+            TopDocs expectedDocs(maxResults);
+            SCORED_DOC_LIST expected;
+            bool impactScoring = m_impactScoring;
 
+            m_impactScoring = impactScores;
+            DocListIterator collection(m_documentIDs);
+            exhaustiveSearch(collection, termIDs, expectedDocs);
+            expectedDocs.sortedResults(expected);
+            m_impactScoring = impactScoring;
 
-bool SearchEngine::score(PROXIMITY_QUERY_LIST& proxQueries, FREETEXT_QUERY_LIST& freeTextQueries , unsigned long docID, double& score){
-    score = 0.0;
-    bool atLeastOneTermInDoc = false;
+            // term-at-a-time scores are rounded to float, documents with (almost) equal scores may swap
+            double tolerance = algorithm == RANKING_TAAT && !impactScores ? FLT_EPSILON * 4 : 0.0;
+            if(!sameResults(expected, results, tolerance)){
+                cout << "RANKING MISMATCH: results of \"" << query << "\" differ from exhaustive evaluation" << endl;
+            }
+        }
+    }
+    else{
+        if(proxQueries.size() > 0){
+            // score only documents matching all the proximity queries
+            DOC_ITERATOR_LIST iterators;
+            for(unsigned int i=0; i < proxQueries.size(); i++)
+                iterators.push_back(proximityIterator(proxQueries[i]));
 
-    vector<string> allTerms;
+            stable_sort(iterators.begin(), iterators.end(), DocIteratorCostLess());
+            AndIterator searchSet(iterators);
+            exhaustiveSearch(searchSet, termIDs, topDocs);
 
-    // put all terms into one single list
-    for(unsigned long i=0; i < proxQueries.size(); i++){
-        vector<string>& curQueryTerms = proxQueries[i].terms();
-        allTerms.insert( allTerms.end(), curQueryTerms.begin(), curQueryTerms.end() );
+            for(unsigned int i=0; i < proxQueries.size(); i++)
+                printPhraseStats(proxQueries[i]);
+        }
+        else{
+            DocListIterator searchSet(m_documentIDs);
+            exhaustiveSearch(searchSet, termIDs, topDocs);
+        }
+        topDocs.sortedResults(results);
     }
 
-    for(unsigned long i=0; i < freeTextQueries.size(); i++){
-        vector<string>& curQueryTerms = freeTextQueries[i].terms();
-        allTerms.insert( allTerms.end(), curQueryTerms.begin(), curQueryTerms.end() );
+    if(impactScores){
+        // scale sums of impacts back to weights of the ranking model
+        for(unsigned long i=0; i < results.size(); i++)
+            results[i].score /= m_index.impactScale();
     }
 
-    // sum up weights of each term present in the doc
-    for(unsigned long i=0; i < allTerms.size(); i++){
-        const POSTING_LIST* pTerm1List = m_index.getPostings(allTerms[i]);
-        const TermInfo* pTermInfo = m_index.getTermInfo(allTerms[i]);
+    return results;
+}
+
+void SearchEngine::printImpactQuality(const vector<string>& queries, unsigned long maxResults){
+    bool impactScoring = m_impactScoring;
+    unsigned long identical = 0, exactCount = 0, foundCount = 0, commonCount = 0;
+    double errorSum = 0.0, maxError = 0.0;
+    clock_t exactTime = 0, impactTime = 0;
+
+    for(unsigned long i=0; i < queries.size(); i++){
+        clock_t start = clock();
+        m_impactScoring = false;
+        SCORED_DOC_LIST exact = rankedSearch(queries[i], maxResults);
+        exactTime += clock() - start;
+
+        start = clock();
+        m_impactScoring = true;
+        SCORED_DOC_LIST approximate = rankedSearch(queries[i], maxResults);
+        impactTime += clock() - start;
 
-        if(pTerm1List &&pTermInfo){
-            POSTING_LIST::const_iterator it = pTerm1List->find(docID);
-            if(it != pTerm1List->end()){
-                const Posting& posting = it->second;
+        bool sameOrder = exact.size() == approximate.size();
+        for(unsigned long k=0; sameOrder && k < exact.size(); k++)
+            sameOrder = exact[k].docID == approximate[k].docID;
+        if(sameOrder)
+            identical++;
 
-                double N = static_cast<double>(m_collectionDocIDs.size());
-                double df = static_cast<double>(pTermInfo->df);
-                double tf = static_cast<double>(posting.tf);
+        // documents found by both, with relative error of their impact score
+        map<unsigned long, double> exactScores;
+        for(unsigned long k=0; k < exact.size(); k++)
+            exactScores[exact[k].docID] = exact[k].score;
 
-                double w = (1 + log2(tf))*(log2(N/df));
-                score += w;
+        for(unsigned long k=0; k < approximate.size(); k++){
+            map<unsigned long, double>::iterator it = exactScores.find(approximate[k].docID);
+            if(it == exactScores.end())
+                continue;
 
-                atLeastOneTermInDoc = true;
+            commonCount++;
+            if(it->second != 0){
+                double error = fabs(approximate[k].score - it->second) / fabs(it->second);
+                errorSum += error;
+                if(error > maxError)
+                    maxError = error;
             }
         }
+        exactCount += exact.size();
+        foundCount += approximate.size();
     }
-    return atLeastOneTermInDoc;
+    m_impactScoring = impactScoring;
+
+    cout << "Queries: " << queries.size() << ", compared results: top " << maxResults << endl;
+    cout << "Identical results (same documents in the same order): " << identical << " of " << queries.size() << endl;
+    cout << "Exact results also found with impacts: " << commonCount << " of " << exactCount;
+    if(exactCount > 0)
+        cout << " (" << 100.0 * commonCount / exactCount << "%)";
+    cout << endl;
+    cout << "Score error of common results: " << (commonCount > 0 ? 100.0 * errorSum / commonCount : 0.0) << "% mean, " 
+         << 100.0 * maxError << "% max" << endl;
+    cout << "Search time: " << static_cast<double>(exactTime) / CLOCKS_PER_SEC << "s exact, " 
+         << static_cast<double>(impactTime) / CLOCKS_PER_SEC << "s with impacts" << endl;
 }
 
-SCORES_LIST SearchEngine::rankedSearch(string query)
-{
-    vector<unsigned long> searchSet;
-    // extract proximity queries and free-text queries into separate lists
-    PROXIMITY_QUERY_LIST proxQueries;
-    FREETEXT_QUERY_LIST freeTextQueries;
-    buildQueries(query, proxQueries, freeTextQueries);
+typedef bool (*PROXIMITY_PAIR_FUNC)(const POSITIONS_LIST&, const POSITIONS_LIST&, unsigned long);
+typedef vector<pair<POSITIONS_LIST, POSITIONS_LIST> > POSITIONS_PAIR_LIST;
 
-    if(proxQueries.size() > 0){
-        // filter search by proximity queries if any
-        searchSet = filterBy(proxQueries);
+/**
+ *  @brief runs a proximity check over position lists of term pairs, in both orders of the terms 
+ *
+ *  @param  name name of the check to print
+ *  @param  proximityPairFunc the check
+ *  @param  pairs position lists of both terms in each document
+ *  @param  proximityWnd proximity window
+ *  @param  baseTime time of the reference check (0 for the reference itself)
+ *  @return time taken by the check
+ */
+static clock_t benchmarkProximityPair(const char* name, PROXIMITY_PAIR_FUNC proximityPairFunc, const POSITIONS_PAIR_LIST& pairs, 
+                                      unsigned long proximityWnd, clock_t baseTime){
+    unsigned long matches = 0;
+    clock_t start = clock();
+
+    for(unsigned long i=0; i < pairs.size(); i++){
+        if(proximityPairFunc(pairs[i].first, pairs[i].second, proximityWnd))
+            matches++;
+        if(proximityPairFunc(pairs[i].second, pairs[i].first, proximityWnd))
+            matches++;
     }
-    else{
-        searchSet = m_collectionDocIDs;
+    clock_t time = clock() - start;
+
+    cout << "  " << name << ": " << 1000.0 * time / CLOCKS_PER_SEC << " ms";
+    if(baseTime > 0 && time > 0)
+        cout << " (" << static_cast<double>(baseTime) / time << "x faster)";
+    cout << ", " << matches << " matches" << endl;
+    return time;
+}
+
+void SearchEngine::printProximityBenchmark(unsigned long proximityWnd){
+    vector<unsigned int> terms;
+    for(unsigned int termID = 0; termID < m_index.termsCount(); termID++){
+        if(m_index.df(termID) > 0)
+            terms.push_back(termID);
     }
 
-    SCORES_LIST scoresSet;
+    // the most frequent terms share the most documents and have the longest position lists
+    sort(terms.begin(), terms.end(), DfLess(m_index));
+    if(terms.size() > PROXIMITY_BENCHMARK_TERMS)
+        terms.erase(terms.begin(), terms.end() - PROXIMITY_BENCHMARK_TERMS);
 
-    for(unsigned long i=0; i < searchSet.size(); i++){
-        double docScore;
-        unsigned long docID;
+    // positions of the neighbouring terms in every document they share are decoded up-front, so that 
+    // only the checks are timed. Documents with long position lists are also measured separately.
+    POSITIONS_PAIR_LIST pairs, longPairs;
+    for(unsigned int i=0; i + 1 < terms.size(); i++){
+        PostingCursor term1Cursor(m_index.getPostings(terms[i]));
+        PostingCursor term2Cursor(m_index.getPostings(terms[i + 1]));
 
-        if(score(proxQueries, freeTextQueries, searchSet[i], docScore)){
-            docID = searchSet[i];
-            scoresSet.insert(pair<double,unsigned long>(docScore, docID));
+        while(term1Cursor.valid() && term2Cursor.valid()){
+            if(term1Cursor.docID() == term2Cursor.docID()){
+                pairs.push_back(make_pair(term1Cursor.positions(), term2Cursor.positions()));
+                if(pairs.back().first.size() >= PROXIMITY_SIMD_MIN_POSITIONS || pairs.back().second.size() >= PROXIMITY_SIMD_MIN_POSITIONS)
+                    longPairs.push_back(pairs.back());
+                term1Cursor.next();
+                term2Cursor.next();
+            }
+            else if(term1Cursor.docID() < term2Cursor.docID()){
+                term1Cursor.advance(term2Cursor.docID());
+            }
+            else{
+                term2Cursor.advance(term1Cursor.docID());
+            }
         }
     }
 
-    return scoresSet;
+    for(int longOnly = 0; longOnly < 2; longOnly++){
+        const POSITIONS_PAIR_LIST& benchmarkPairs = longOnly ? longPairs : pairs;
+
+        cout << "Proximity checks, window " << proximityWnd << ": " << 2 * benchmarkPairs.size() << " term pairs in shared documents";
+        if(longOnly)
+            cout << " with " << PROXIMITY_SIMD_MIN_POSITIONS << " or more positions";
+        cout << endl;
+
+        clock_t nestedTime = benchmarkProximityPair("nested loops", nestedProximityPair, benchmarkPairs, proximityWnd, 0);
+        benchmarkProximityPair("linear merge", mergeProximityPair<skipPositions>, benchmarkPairs, proximityWnd, nestedTime);
+#ifdef PROXIMITY_SSE2
+        benchmarkProximityPair("linear merge, SSE2", mergeProximityPair<skipPositionsSSE2>, benchmarkPairs, proximityWnd, nestedTime);
+#endif
+        benchmarkProximityPair("findProximityPair", proximityPair, benchmarkPairs, proximityWnd, nestedTime);
+    }
 }
\ No newline at end of file
@@ -19,6 +19,9 @@
 #define _SEARCH_ENGINE_H
 
 #include "KrovetzStemmer.hpp"
+#include "TermDictionary.h"
+#include "PostingCodec.h"
+#include "IndexFile.h"
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
@@ -28,7 +31,12 @@
 #include <map>
 #include <sstream>
 #include <set>
+#include <queue>
+#include <deque>
+#include <functional>
 #include <algorithm>
+#include <math.h>
+#include <pthread.h>
 
 using namespace std;
 using namespace stem;
@@ -46,21 +54,93 @@ using namespace stem;
 
 #define SPACE_STR            " "
 
+#define FIRST_DOC_ID         1      // docID 0 is never a collection document (buildFromSquadData() indexes question/answer terms under it)
+#define SCORE_EPSILON        1e-9   // tolerance for comparing score upper bounds, protects from rounding errors
+#define MAX_DOC_ID           0xFFFFFFFF   // ends posting cursors; docIDs are stored in 32 bits, so documents have IDs from FIRST_DOC_ID to MAX_DOC_ID - 1
+
+#define IMPACT_MAX           0xFFFF // highest quantized term weight (impact), must fit into IMPACT
+#define ACCUMULATOR_EMPTY    (-HUGE_VALF)   // value of accumulators of documents not scored by term-at-a-time evaluation yet
+#define MAXSCORE_MIN_TERMS   3      // RANKING_AUTO evaluates queries with at least this many distinct terms with MaxScore
+#define PROXIMITY_SIMD_MIN_POSITIONS 32   // findProximityPair() scans positions of the second term with SIMD when it has this many
+#define PROXIMITY_BENCHMARK_TERMS    16   // printProximityBenchmark() pairs up this many most frequent terms
+#define BM25_K1              1.2    // BM25 term frequency saturation
+#define BM25_B               0.75   // BM25 document length normalization
+#define LENGTH_EXACT_CODES   64     // document lengths below this are quantized exactly, longer ones geometrically (see Index::lengthCode())
+#define LENGTH_CODE_GROWTH   1.04   // ratio of the consecutive quantized lengths above LENGTH_EXACT_CODES
+#define LENGTH_CODES         256    // number of quantized document lengths, must fit into unsigned char
+#define SEGMENT_SIZE         262144 // postings of the in-memory segment flushed into an immutable segment (see Index::setSegmentSize())
+#define SEGMENT_MERGE_FACTOR 4      // segments of the same size tier merged together, and size ratio of the consecutive tiers
+#define INDEX_BATCH_SIZE     256    // documents inverted together by a worker thread of the parallel index build
+#define INDEX_MERGE_CHUNK    1024   // terms whose posting lists a thread of the parallel index build merges at a time
+#define SPILL_DIR            "spill"    // directory of the runs and the index file of an index built within a memory budget (see Index::setMemoryBudget())
+
 typedef enum{
   DOCUMENT_TYPE_TEXT = 0,
   DOCUMENT_TYPE_IMAGE
 }DOCUMENT_TYPE;
 
+typedef enum{
+  RANKING_EXHAUSTIVE = 0,       // score every document of the collection
+  RANKING_WAND,                 // WAND with per-term score upper bounds
+  RANKING_BLOCK_MAX_WAND,       // WAND which also skips blocks of postings using per-block score upper bounds
+  RANKING_MAXSCORE,             // MaxScore, only the lists of essential terms propose candidates
+  RANKING_TAAT,                 // term-at-a-time, postings of every term are added into a dense array of accumulators
+  RANKING_SAAT,                 // score-at-a-time over impact-ordered postings, the highest impacts first, within a postings budget
+  RANKING_AUTO                  // SAAT for queries over the postings budget (if impact-ordered index is enabled), otherwise
+                                // MaxScore for long queries (see MAXSCORE_MIN_TERMS) and Block-Max WAND for the others
+}RANKING_ALGORITHM;
+
+typedef enum{
+  RANKING_MODEL_TFIDF = 0,      // (1 + log2(tf)) * log2(N/df)
+  RANKING_MODEL_BM25            // Okapi BM25, with document lengths quantized into LENGTH_CODES classes
+}RANKING_MODEL;
+
+typedef enum{
+  INTERSECTION_MERGE = 0,       // all the operands step through their documents one by one
+  INTERSECTION_GALLOP,          // the other operands skip to candidates of the first one, using skip pointers
+  INTERSECTION_BITMAP           // the other operands are loaded into bitmaps, where candidates of the first one are looked up
+}INTERSECTION_ALGORITHM;
+
+typedef enum{
+  QUERY_NODE_TERM = 0,          // documents containing a term
+  QUERY_NODE_PROXIMITY,         // documents matching a phrase or a proximity window
+  QUERY_NODE_AND,               // documents matching all the positive operands and none of the NOT operands
+  QUERY_NODE_OR,                // documents matching any of the operands
+  QUERY_NODE_NOT                // documents not matching the operand
+}QUERY_NODE_TYPE;
+
+typedef enum{
+  QUERY_TOKEN_WORD = 0,
+  QUERY_TOKEN_PHRASE,           // "term1 term2 ..."
+  QUERY_TOKEN_PROXIMITY,        // N(term1 term2 ...) or N[term1 term2 ...]
+  QUERY_TOKEN_AND,
+  QUERY_TOKEN_OR,
+  QUERY_TOKEN_NOT,
+  QUERY_TOKEN_OPEN,             // (
+  QUERY_TOKEN_CLOSE             // )
+}QUERY_TOKEN_TYPE;
+
+typedef enum{
+  ACCUMULATOR_LIMIT_QUIT = 0,   // once the limit is reached, the remaining postings are ignored
+  ACCUMULATOR_LIMIT_CONTINUE    // once the limit is reached, the remaining postings only update existing accumulators
+}ACCUMULATOR_LIMIT_MODE;
+
 class Posting;
-class TermInfo;
+class CompactPostingList;
+class Index;
 class ProximityQuery;
 class Query;
+class QueryTerm;
+class QueryNode;
+class ScoredDoc;
 typedef map<unsigned int, Posting> POSTING_LIST;
-typedef map<string, TermInfo> TERMS_LIST;
 typedef vector<unsigned long> POSITIONS_LIST;
 typedef vector<ProximityQuery> PROXIMITY_QUERY_LIST;
 typedef vector<Query> FREETEXT_QUERY_LIST;
-typedef multimap<double, unsigned long> SCORES_LIST;
+typedef vector<ScoredDoc> SCORED_DOC_LIST;
+typedef vector<QueryTerm> QUERY_TERM_LIST;
+typedef unsigned short IMPACT;  // quantized term weight of a posting. With 8 bits, about 3% of the top 10 results 
+                                // on SQuAD-like collections change, since most postings get the few lowest values
 
 /**
  *  @brief Base class for a document in the collection.  
@@ -119,248 +199,2578 @@ public:
     void print();
 };
 
-class TermInfo{
+/**
+ *  @brief Skip pointer to a block of CompactPostingList
+ */
+class SkipEntry{
 public:
-    string term;                // term (i.e. index word)
-    unsigned long df;           // document frequence, i.e. in how many documents in the collection this term is present
-    POSTING_LIST  postings;     // list of postings (posting is created for each document where the term is present)
-
-    void print(bool includePostings = true);
+    unsigned int lastDocID;         // docID of the last posting in the block
+    unsigned int docOffset;         // offset of the block in the docID/tf stream
+    unsigned int positionOffset;    // offset of positions of the block's first posting in the position stream
+    unsigned int maxTf;             // highest term frequency in the block, used for block score upper bounds
 };
 
 /**
- *  @brief Holds both original user query and tokenized list  
+ *  @brief Bitset of the documents deleted from an index segment (tombstones), indexed by docID.
+ *         Postings of deleted documents stay in the segment's lists until the segment is merged.
  */
-class Query{
-public: 
-    explicit Query(string& queryText);
-    vector<string>& terms();
+class DeletedDocs{
+public:
+    DeletedDocs():
+        m_count(0){}
 
-protected: 
-    string m_originalText;
-    vector<string> m_terms;
+    bool contains(unsigned int docID) const {
+        return docID / 64 < m_bits.size() && (m_bits[docID / 64] & (1ULL << (docID % 64))) != 0;
+    }
+
+/** 
+ *   @brief  marks document as deleted 
+ *  
+ *   @param  docID the document
+ *   @return false if the document was deleted already
+ */
+    bool add(unsigned int docID);
+
+    unsigned long count() const {return m_count;}
+    unsigned long size() const {return 64 * m_bits.size();}    // docIDs below this may be deleted
+
+private:
+    vector<unsigned long long> m_bits;
+    unsigned long              m_count;     // number of deleted documents
 };
 
 /**
- *  @brief Holds 'proximity' queries, i.e. a 2-terms query where proximity distance
- *  is specified for them
+ *  @brief Read-optimized, immutable copy of a POSTING_LIST.
+ *         Postings are sorted by docID and split into blocks of POSTING_BLOCK_SIZE postings.
+ *         Each block stores docID d-gaps followed by term frequencies, both coded with Stream VByte.
+ *         Positions are stored as VByte coded d-gaps within each posting in a separate stream,
+ *         so that scans which don't need positions never touch them. A skip pointer is kept for every 
+ *         block, so that readers can jump over blocks without decoding them. The list is read with PostingCursor.
+ *         A list may also be a view of the lists of a term in several index segments (see setParts()).
  */
-class ProximityQuery : public Query{
+class CompactPostingList{
 public:
+    CompactPostingList():
+        m_size(0),
+        m_positionsCount(0),
+        m_maxTf(0),
+        m_deletedDocs(NULL){}
 
-    explicit ProximityQuery(string& queryText, unsigned long proximityWnd);
+/** 
+ *   @brief  (re)builds the compressed list from the posting list produced during indexing 
+ *  
+ *   @param  postings posting list of a term, sorted by docID
+ *   @return void
+ */
+    void build(const POSTING_LIST& postings);
 
-    unsigned long getProximityWnd(){return m_proximityWnd;}
-private: 
-    unsigned long m_proximityWnd;
-};
+/** 
+ *   @brief  decompresses the list back into POSTING_LIST. If the target list already holds 
+ *           a posting for some document, decoded tf and positions are added to it. 
+ *  
+ *   @param  postings posting list to add decoded postings to
+ *   @param  deletedDocs documents whose postings are left out, instead of those of the list's segment
+ *   @return void
+ */
+    void decode(POSTING_LIST& postings, const DeletedDocs* deletedDocs) const;
 
-/**
- *  @brief Singleton class used for tokenization and normalizations of free text
+/** 
+ *   @brief  stores quantized weight (impact) of every posting, see Index::finalize() 
+ *  
+ *   @param  impacts impact of each posting, in docID order
+ *   @return void
  */
-class Tokenizer{
-public: 
-    static Tokenizer& singleton();
+    void setImpacts(const vector<IMPACT>& impacts){m_impacts.owned() = impacts;}
 
- /** 
- *   @brief  breaks free text into normlized tokens 
+    unsigned long size() const {return m_size;}     // number of postings, including those of deleted documents
+    unsigned long positionsCount() const {return m_positionsCount;}
+    unsigned int maxTf() const {return m_maxTf;}      // highest term frequency in the list, used for score upper bounds
+    unsigned int lastDocID() const;
+
+/** 
+ *   @brief  makes the list a view of the lists of the same term in several index segments (see IndexSegment), 
+ *           which PostingCursor reads as if they were merged: postings of a document present in several lists
+ *           are combined into one, with tfs added up and positions merged, the way decode() combines them.
+ *           Counters of the list (size(), maxTf(), ...) are those of the combined postings. 
  *  
- *   @param  text free text (can be a user query or text from document)
+ *   @param  parts lists of the term in the segments, must stay alive as long as the view
  *   @return void
- */ 
-    vector<string> tokenize(string& text);
+ */
+    void setParts(const vector<const CompactPostingList*>& parts);
 
-protected:
- /** 
- *   @brief  applies stemming to the term.
- *           (uses Krovetz stemmer) 
+/** 
+ *   @brief  makes cursors over the list skip postings of deleted documents 
  *  
- *   @param  term term to stem, modified upon return 
+ *   @param  deletedDocs deleted documents of the list's segment, must stay alive as long as the list
  *   @return void
- */   
-    void stemTerm(string& term);
+ */
+    void setDeletedDocs(const DeletedDocs* deletedDocs){m_deletedDocs = deletedDocs;}
+    const DeletedDocs* deletedDocs() const {return m_deletedDocs;}
 
- /** 
- *   @brief  determines whether a word is a stop-word
+/** 
+ *   @brief  calculates memory occupied by the compressed postings
  *  
- *   @param  word word to check 
- *   @return true if stop-word, false otherwise
- */     
-    bool isStopWord(string& word);
+ *   @return size in bytes
+ */
+    unsigned long memoryUsage() const;
 
-private: 
-    Tokenizer();
-    static KrovetzStemmer m_stemmer;    // 3rd party stemmer
+/** 
+ *   @brief  calculates memory the same postings occupy uncompressed, i.e. stored as 
+ *           Posting objects (docID, tf and positions as unsigned long values)
+ *  
+ *   @return size in bytes
+ */
+    unsigned long uncompressedSize() const;
+
+/** 
+ *   @brief  writes the part of the list stored in a section of the index file (docID/tf blocks, positions,
+ *           skip pointers or impacts) and records its location
+ *  
+ *   @param  writer index file being written, positioned in the section
+ *   @param  section the section
+ *   @param  entry location of the list in the file, the part written is filled in
+ *   @return void
+ */
+    void save(IndexFileWriter& writer, INDEX_SECTION section, PostingListEntry& entry) const;
+
+/** 
+ *   @brief  makes the list read its postings from a memory-mapped index file (see Index::load())
+ *  
+ *   @param  file the index file, must stay mapped for the lifetime of the list
+ *   @param  entry location of the list in the file
+ *   @return false if the entry points out of the file
+ */
+    bool load(const MappedFile& file, const PostingListEntry& entry);
+
+private:
+    friend class PostingCursor;
+    friend class PostingListBuilder;
+
+/** 
+ *   @brief  encodes a block of postings and adds skip pointer for it 
+ *  
+ *   @param  docGaps docID gaps of the block
+ *   @param  tfs term frequencies of the block
+ *   @param  count number of postings in the block
+ *   @param  lastDocID docID of the last posting in the block
+ *   @param  maxTf highest term frequency in the block
+ *   @param  positionOffset offset of the block's first posting positions in m_positionData
+ *   @return void
+ */
+    void addBlock(const unsigned int* docGaps, const unsigned int* tfs, unsigned int count, 
+                  unsigned int lastDocID, unsigned int maxTf, unsigned long positionOffset);
+
+    unsigned long         m_size;           // number of postings
+    unsigned long         m_positionsCount; // total number of positions in all postings
+    unsigned int          m_maxTf;          // highest term frequency of all postings
+    MappedArray<unsigned char> m_docData;       // blocks of docID gaps and tfs (padded with STREAM_VBYTE_PADDING bytes)
+    MappedArray<unsigned char> m_positionData;  // position gaps, tf entries per posting
+    MappedArray<SkipEntry>     m_skips;         // skip pointer of each block
+    MappedArray<IMPACT>        m_impacts;       // quantized weight of each posting (empty until Index::finalize())
+    vector<const CompactPostingList*> m_parts;  // lists the view consists of (see setParts()), the list holds no postings itself
+    const DeletedDocs*         m_deletedDocs;   // deleted documents of the list's segment, see setDeletedDocs()
 };
 
 /**
- *  @brief Implements indexing of the documents including 
- *   tokenization, stemming, and normalization (i.e. lower-case conversion) 
+ *  @brief Builds CompactPostingList from postings added one at a time in docID order, encoding them block
+ *         by block, so that the postings don't have to be held uncompressed (see CompactPostingList::build())
  */
-class Index{
+class PostingListBuilder{
 public:
-    
 /** 
- *   @brief  adds new text into the index by performing  
- *           tokenization, stemming, and normalization  
+ *   @param  list the list to (re)build, emptied by the constructor
+ */
+    explicit PostingListBuilder(CompactPostingList& list);
+
+/** 
+ *   @brief  adds posting of the next document
  *  
- *   @param  text text to add, can contain multiple words 
- *   @param  docID document ID where text resides 
- *   @pos    position of the term in the document
+ *   @param  docID document, greater than that of the previous posting
+ *   @param  tf term frequency in the document
+ *   @param  positions positions of the term in the document, in any order
  *   @return void
- */  
-    void addText(string& text, unsigned long& docID, unsigned long& pos);
+ */
+    void add(unsigned int docID, unsigned int tf, const POSITIONS_LIST& positions);
 
 /** 
- *   @brief  prints index terms to the screen, including document frequency and posting lists 
+ *   @brief  encodes the last, partially filled block. The list must not be added to afterwards.
  *  
  *   @return void
  */
-    void print(bool includePostings = true);
+    void finish();
+
+private:
+    CompactPostingList& m_list;
+    unsigned int        m_prevDocID;
+    unsigned long       m_positionOffset;   // offset of positions of the block's first posting
+    unsigned int        m_docGaps[POSTING_BLOCK_SIZE];  // block being filled
+    unsigned int        m_tfs[POSTING_BLOCK_SIZE];
+    unsigned int        m_blockSize;
+    unsigned int        m_blockMaxTf;
+    POSITIONS_LIST      m_positions;        // sorted positions of the posting being added
+};
+
+/**
+ *  @brief Group of postings of a term with the same impact, see ImpactOrderedList
+ */
+class ImpactSegment{
+public:
+    IMPACT       impact;    // impact of all postings in the segment
+    unsigned int count;     // number of postings
+    unsigned int offset;    // offset of the segment's docIDs in the data stream
+};
 
+/**
+ *  @brief Impact-ordered copy of a term's postings, for score-at-a-time evaluation. Postings are grouped 
+ *         into segments by impact, segments are sorted by decreasing impact, and docIDs within a segment 
+ *         are sorted and stored as d-gaps, coded with Stream VByte in blocks of POSTING_BLOCK_SIZE.
+ *         Only docIDs are kept, tf and positions are available from CompactPostingList. 
+ */
+class ImpactOrderedList{
+public:
 /** 
- *   @brief  retrieves posting list for a give term in the index 
+ *   @brief  (re)builds the list from impacts stored in the docID-ordered list (see Index::finalize()) 
  *  
- *   @param  term term for which posting list is desired 
- *   @return pointer to POSTING_LIST
- */  
-    const POSTING_LIST* getPostings(string term);
+ *   @param  postings docID-ordered posting list of the term
+ *   @return void
+ */
+    void build(const CompactPostingList& postings);
 
 /** 
- *   @brief  retrieves term information 
+ *   @brief  decodes docIDs of a segment 
  *  
- *   @param  term term for which info is desired 
- *   @return pointer to TermInfo
- */  
-    const TermInfo* getTermInfo(string term);
+ *   @param  segment index of the segment
+ *   @param  maxCount decode at most this many docIDs (the first ones)
+ *   @param  docIDs buffer to decode to, must have room for maxCount rounded up to POSTING_BLOCK_SIZE
+ *   @return number of decoded docIDs
+ */
+    unsigned int decodeSegment(unsigned int segment, unsigned int maxCount, unsigned int* docIDs) const;
+
+    unsigned int segmentsCount() const {return m_segments.size();}
+    const ImpactSegment& segment(unsigned int segment) const {return m_segments[segment];}
 
 /** 
- *   @brief  adds term into index if not already there. If already there, just adds a document ID to the posting list. 
+ *   @brief  calculates memory occupied by the list
  *  
- *   @param  term term being added 
- *   @param  docID id of the document where the term is from
- *   @pos    position of the term in the document
- *   @return void
+ *   @return size in bytes
  */
-    void addTerm(string& term,unsigned long& docID, unsigned long& pos);
-
-protected:
+    unsigned long memoryUsage() const {return m_data.size() + m_segments.size() * sizeof(ImpactSegment);}
 
-    TERMS_LIST m_terms;      // map of all terms in the index
+private:
+    vector<ImpactSegment> m_segments;   // segments by decreasing impact
+    vector<unsigned char> m_data;       // docID gaps of all segments (padded with STREAM_VBYTE_PADDING bytes)
 };
 
 /**
- *  @brief Implements search engine by building collection of the documents,
- *         creating an index for it, and evaluating queries
+ *  @brief Forward-only iterator decoding CompactPostingList on the fly, one block at a time.
+ *         A view of several lists (see CompactPostingList::setParts()) is read with a cursor over each
+ *         of them, combining their postings one document at a time.
  */
-class SearchEngine{
+class PostingCursor{
 public:
+    explicit PostingCursor(const CompactPostingList* list);
 
 /** 
- *   @brief  builds document collection from XML file containing multiple documents separated by <DOC> tags  
+ *   @param  list the list
+ *   @param  deletedDocs documents to skip instead of the deleted documents of the list's segment, NULL to read all postings
+ */
+    PostingCursor(const CompactPostingList* list, const DeletedDocs* deletedDocs);
+
+    bool valid() const {return m_index < m_size;}
+
+/** 
+ *   @brief  moves to the next posting in the list 
  *  
- *   @param  xmlFilePath path to XML file with document entries 
  *   @return void
- */  
-    void buildFromFile(string xmlFilePath);
-
-    void buildFromSquadData(string jsonFilePath, bool tokenizeCollection = false);
+ */
+    void next(){
+        nextPosting();
+        if(m_deletedDocs != NULL)
+            skipDeleted();
+    }
 
+/** 
+ *   @brief  moves to the first posting with docID equal or greater than the target.
+ *           Blocks which can't contain the target are skipped without decoding.
+ *  
+ *   @param  target docID to move to
+ *   @return void
+ */
+    void advance(unsigned int target){
+        if(valid() && docID() < target)
+            seek(target);
+    }
 
 /** 
- *   @brief  prints index of the seach engine to the screen
+ *   @brief  moves block information (see blockLastDocID() and blockMaxTf()) to the block which may contain 
+ *           the target, without decoding it. The current posting of the cursor doesn't change.
  *  
+ *   @param  target docID to move to
  *   @return void
  */
-    void printIndex(bool includePostings = true);
+    void shallowAdvance(unsigned int target);
 
 /** 
- *   @brief  performs boolean search against the document collection  
+ *   @brief  docID of the last posting in the block found by shallowAdvance()
  *  
- *   @param  query a text query
- *   @return vector<unsigned long> list of documents mating the search criteria
+ *   @return docID, MAX_DOC_ID if all documents of the list are smaller than the target of shallowAdvance()
  */
-    vector<unsigned long> booleanSearch(string query);
+    unsigned int blockLastDocID() const {
+        if(!m_partCursors.empty())
+            return partsBlockLastDocID();
+        return m_shallowBlock < m_list->m_skips.size() ? m_list->m_skips[m_shallowBlock].lastDocID : MAX_DOC_ID;
+    }
 
- /** 
- *   @brief  performs ranked search against the document collection  
+/** 
+ *   @brief  highest term frequency in the block found by shallowAdvance()
  *  
- *   @param  query a text query
- *   @return SCORES_LIST map of documents with non-zero ranking, sorted by rank value
- */   
-    SCORES_LIST rankedSearch(string query);
+ *   @return term frequency, 0 if all documents of the list are smaller than the target of shallowAdvance()
+ */
+    unsigned int blockMaxTf() const {
+        if(!m_partCursors.empty())
+            return partsBlockMaxTf();
+        return m_shallowBlock < m_list->m_skips.size() ? m_list->m_skips[m_shallowBlock].maxTf : 0;
+    }
 
-protected:
 /** 
- *   @brief implements intersection of two sets, based on algorithm from the assignment  
+ *   @brief  number of postings in the list
  *  
- *   @param  p1 set1 of posting lists
- *   @param  p2 set2 of posting lists
- *   @return intersection set
- */ 
-    vector<unsigned long> intersect(const POSTING_LIST* p1, const POSTING_LIST* p2);
+ *   @return number of postings
+ */
+    unsigned long size() const {return m_partCursors.empty() ? m_size : m_list->size();}
+
+    unsigned int docID() const {return m_docIDs[m_blockPos];}
+    unsigned int tf() const {return m_tfs[m_blockPos];}
 
 /** 
- *   @brief implements intersection of two sets, based on algorithm from the assignment  
+ *   @brief  quantized weight of the current posting (see Index::finalize()). Of the lists of a view, the first 
+ *           one holding the document carries impact of the combined posting, and the others carry 0.
  *  
- *   @param  v1 set1 of unique numbers
- *   @param  v2 set2 of unique numbers
- *   @return intersection set
- */     
-    vector<unsigned long> intersect(vector<unsigned long> v1, vector<unsigned long> v2);
+ *   @return impact
+ */
+    unsigned int impact() const {
+        if(!m_partCursors.empty())
+            return partsImpact();
+        return m_list->m_impacts[m_index];
+    }
 
 /** 
- *   @brief parses user query and builds 2 separate lists holding 'proximity' and 'free text' queries  
+ *   @brief  decodes positions of the current posting (only done when positions are requested)
  *  
- *   @param  userQuestion user question (can be a mixed of 'free text' and 'proximity' query)
- *   @param  proxQueries list of 'proximity' queries, populated by the function
- *   @param  freeTextQueries list of 'free text' queries, populated by the function
- *   @return intersection set
- */     
-    void buildQueries(string userQuestion, PROXIMITY_QUERY_LIST& proxQueries, FREETEXT_QUERY_LIST& freeTextQueries);
+ *   @return sorted list of term positions in the current document
+ */
+    const POSITIONS_LIST& positions();
 
+private:
 /** 
- *   @brief filters collection by proximity queries 
+ *   @brief  positions the cursor at the first posting of the list
  *  
- *   @param  proxQueries list of 'proximity' queries to filter by
- *   @return a sub-set of document IDs from the whole collection matching all the proximity queries
+ *   @param  deletedDocs documents to skip
+ *   @return void
  */
-    vector<unsigned long> filterBy(PROXIMITY_QUERY_LIST& proxQueries);
+    void init(const DeletedDocs* deletedDocs);
 
 /** 
- *   @brief intersects filtered set of documents with the set of the 'free text' query 
+ *   @brief  implements next(), including postings of deleted documents 
  *  
- *   @param  filterSet a set of documents to be intersected
- *   @param  freeTextQuery 'free text' query to use for intersection
- *   @return intersection of two sets
+ *   @return void
  */
-    vector<unsigned long> intersectWithQuery(vector<unsigned long>& filterSet, Query& freeTextQuery);
+    void nextPosting(){
+        if(!m_positionsDecoded)
+            m_positionsToSkip += m_tfs[m_blockPos];
+        m_positionsDecoded = false;
+
+        m_index++;
+        if(++m_blockPos == m_blockSize && m_index < m_size){
+            m_block++;
+            decodeBlock(m_docIDs[m_blockSize - 1]);
+        }
+    }
 
 /** 
- *   @brief detects whether 2 terms are located from each other with-in proximity window (order is important) 
+ *   @brief  moves past postings of deleted documents, if the cursor is at one
  *  
- *   @param  p1 posting of term1
- *   @param  p2 posting of term2
- *   @param  proximityWnd proximity window
- *   @return true if there is a least one instance of correct proximity, otherwise - false.
+ *   @return void
  */
-    bool findProximityPair(const Posting p1, const Posting p2, unsigned long proximityWnd );
+    void skipDeleted();
 
 /** 
- *   @brief scores a document based on the query. Usef TF.IDF alrogirthm for scoring
+ *   @brief  decodes block of docIDs and tfs at m_docData 
  *  
- *   @param  proxQueries list of 'proximity' queries extracted from original user query (see buildQueries() function)
- *   @param  freeTextQueries list of 'free text' queries extracted from original user query (see buildQueries() function)
- *   @param  docID document to score
- *   @param  score will hold the value when function returns
+ *   @param  lastDocID docID of the last posting in the previous block
+ *   @return void
+ */
+    void decodeBlock(unsigned int lastDocID);
+
+/** 
+ *   @brief  implements advance() for targets past the current posting 
  *  
- *   @return true if score was calculated, false if not (i.e. this document does not contain any terms in the provided queries).
+ *   @param  target docID to move to
+ *   @return void
+ */
+    void seek(unsigned int target);
+
+/** 
+ *   @brief  finds the first block which may contain the target, using exponential search 
+ *           over skip pointers followed by binary search
+ *  
+ *   @param  from index of the block to start search from
+ *   @param  target docID to find
+ *   @return index of the block, number of blocks if all documents are smaller than the target
+ */
+    unsigned long findBlock(unsigned long from, unsigned int target) const;
+
+/** 
+ *   @brief  combines postings of the lists of a view at their lowest docID into a block of one posting, 
+ *           the cursor becomes invalid when all the lists are passed
+ *  
+ *   @return void
+ */
+    void combineParts();
+
+/** 
+ *   @brief  adds list of a view to the heap of the lists ordered by their current docID, unless it is passed
+ *  
+ *   @param  part index of the list in m_partCursors
+ *   @return void
+ */
+    void pushPart(unsigned int part);
+
+    // implement blockLastDocID(), blockMaxTf(), impact() and positions() of a view
+    unsigned int partsBlockLastDocID() const;
+    unsigned int partsBlockMaxTf() const;
+    unsigned int partsImpact() const;
+    const POSITIONS_LIST& partsPositions();
+
+    const CompactPostingList* m_list;
+    const unsigned char* m_docData;         // next block to decode
+    const unsigned char* m_positionData;    // positions of the first posting which wasn't skipped yet
+    unsigned long        m_index;           // index of the current posting in the list
+    unsigned long        m_size;
+    unsigned long        m_block;           // index of the decoded block
+    unsigned long        m_shallowBlock;    // index of the block found by shallowAdvance()
+    unsigned int         m_blockPos;        // index of the current posting in the decoded block
+    unsigned int         m_blockSize;       // number of postings in the decoded block
+    unsigned int         m_docIDs[POSTING_BLOCK_SIZE];  // decoded block
+    unsigned int         m_tfs[POSTING_BLOCK_SIZE];
+    unsigned long        m_positionsToSkip; // number of encoded positions of already passed postings
+    bool                 m_positionsDecoded;
+    POSITIONS_LIST       m_positions;
+    vector<PostingCursor> m_partCursors;    // cursor over each list of a view, empty for other lists
+    vector<unsigned int> m_partHeap;        // lists of a view past the current posting, min-heap by docID
+    vector<unsigned int> m_currentParts;    // lists of a view at the current posting
+    const DeletedDocs*   m_deletedDocs;     // documents to skip, NULL if there are none
+};
+
+/**
+ *  @brief Query term prepared for document-at-a-time ranked evaluation
+ */
+class QueryTerm{
+public:
+    QueryTerm(unsigned int id, const CompactPostingList* postings):
+        termID(id),
+        cursor(postings),
+        idf(0),
+        upperBound(0),
+        queryTf(0){}
+
+    unsigned int  termID;
+    PostingCursor cursor;       // current position in the term's posting list
+    double        idf;          // inverse document frequency (see Index::idf())
+    double        upperBound;   // highest possible contribution of the term (all its query occurrences) to a document score
+    unsigned int  queryTf;      // number of occurrences of the term in the query
+};
+
+/**
+ *  @brief Document with its ranking score
+ */
+class ScoredDoc{
+public:
+    ScoredDoc(double s, unsigned long id): score(s), docID(id){}
+
+    bool operator==(const ScoredDoc& other) const {return score == other.score && docID == other.docID;}
+
+    double        score;
+    unsigned long docID;
+};
+
+/**
+ *  @brief Collects the best scoring documents of a ranked search in a min-heap of fixed size, so that
+ *         memory and time per document don't depend on the number of matching documents. On equal score, 
+ *         the document collected later ranks higher (with documents collected in increasing docID order, 
+ *         the one with higher docID).
+ */
+class TopDocs{
+public:
+/** 
+ *   @param  maxResults number of best documents to keep, 0 keeps all the collected documents
+ */
+    explicit TopDocs(unsigned long maxResults):
+        m_maxResults(maxResults),
+        m_count(0){}
+
+/** 
+ *   @brief  adds a document, if it's better than the worst of the documents kept so far (or if there is still room)
+ *  
+ *   @param  score score of the document
+ *   @param  docID document to add
+ *   @return void
+ */
+    void collect(double score, unsigned long docID);
+
+/** 
+ *   @brief  score a document needs to get in: the k-th best score, or 0 while less than k documents are kept. 
+ *           Pruning strategies may skip documents whose score upper bound is lower than this.
+ *  
+ *   @return score threshold
+ */
+    double threshold() const {return full() ? m_heap.front().score : 0.0;}
+
+    bool full() const {return m_maxResults > 0 && m_heap.size() == m_maxResults;}
+    unsigned long size() const {return m_heap.size();}
+    unsigned long maxResults() const {return m_maxResults;}
+
+/** 
+ *   @brief  returns the kept documents, sorted from the best to the worst. The collector is emptied.
+ *  
+ *   @param  results list to populate
+ *   @return void
+ */
+    void sortedResults(SCORED_DOC_LIST& results);
+
+private:
+/**
+ *  @brief Heap entry, ordered by score and then by collection order
+ */
+    class Entry{
+    public:
+        Entry(double s, unsigned long seq, unsigned long id): score(s), sequence(seq), docID(id){}
+
+        bool operator>(const Entry& other) const{
+            return score > other.score || (score == other.score && sequence > other.sequence);
+        }
+
+        double        score;
+        unsigned long sequence;
+        unsigned long docID;
+    };
+
+    unsigned long m_maxResults;
+    unsigned long m_count;      // number of collected documents
+    vector<Entry> m_heap;       // kept documents, heap with the worst document at front (unless m_maxResults is 0)
+};
+
+/**
+ *  @brief Holds both original user query and tokenized list  
+ */
+class Query{
+public: 
+    explicit Query(string& queryText);
+    vector<string>& terms();
+    vector<unsigned int>& termIDs();
+    const string& text() const {return m_originalText;}
+
+/** 
+ *   @brief  looks up IDs of the query terms in the index, so that query evaluation
+ *           can work with IDs only. Terms not present in the index get INVALID_TERM_ID.
+ *  
+ *   @param  index index to resolve the terms against
+ *   @return void
+ */
+    void resolveTerms(const Index& index);
+
+protected: 
+    string m_originalText;
+    vector<string> m_terms;
+    vector<unsigned int> m_termIDs;     // ID of each term in m_terms, filled by resolveTerms()
+};
+
+/**
+ *  @brief Holds 'proximity' queries, i.e. a query of one or more terms where proximity distance
+ *  is specified for them: all the terms must occur with at most proximityWnd other words among them,
+ *  either in the query order (ordered window, "N(a b c)") or in any order (unordered window, "N[a b c]").
+ *  A phrase ("a b c") is an ordered window where the terms are adjacent. 
+ */
+class ProximityQuery : public Query{
+public:
+
+    ProximityQuery(string& queryText, unsigned long proximityWnd, bool ordered = true, bool phrase = false);
+
+    unsigned long getProximityWnd(){return m_proximityWnd;}
+    bool isOrdered(){return m_ordered;}
+    bool isPhrase(){return m_phrase;}
+
+/** 
+ *   @brief  counts a document containing all the terms, which was checked for their positions
+ *  
+ *   @param  verified true if the terms are positioned as the query requires
+ *   @return void
+ */
+    void countCandidate(bool verified){
+        m_candidateDocs++;
+        if(verified)
+            m_verifiedDocs++;
+    }
+
+    unsigned long candidateDocs() const {return m_candidateDocs;}
+    unsigned long verifiedDocs() const {return m_verifiedDocs;}
+
+    void setPairLists(unsigned int pairLists){m_pairLists = pairLists;}
+    unsigned int pairLists() const {return m_pairLists;}
+
+private: 
+    unsigned long m_proximityWnd;
+    bool m_ordered;
+    bool m_phrase;
+    unsigned long m_candidateDocs;  // documents with all the terms
+    unsigned long m_verifiedDocs;   // candidate documents where the terms are within the window
+    unsigned int m_pairLists;       // posting lists of the pair index used for evaluation (see SearchEngine::planPhrase())
+};
+
+/**
+ *  @brief Iterator over documents matching a query or a part of it, in increasing docID order. Iterators are 
+ *         combined into a tree evaluating the whole query lazily: a document is only found when the consumer 
+ *         moves to it, so memory taken by the evaluation depends on the size of the query only, not on the 
+ *         number of matching documents. A new iterator is positioned at its first document. Iterators 
+ *         combining other iterators own them.
+ */
+class DocIterator{
+public:
+    DocIterator(){}
+    virtual ~DocIterator(){}
+
+    virtual bool valid() const = 0;
+    virtual unsigned int docID() const = 0;
+
+/** 
+ *   @brief  moves to the next matching document 
+ *  
+ *   @return void
+ */
+    virtual void next() = 0;
+
+/** 
+ *   @brief  moves to the first matching document with docID equal or greater than the target. 
+ *           The iterator doesn't move if it's already there.
+ *  
+ *   @param  target docID to move to
+ *   @return void
+ */
+    virtual void advance(unsigned int target) = 0;
+
+/** 
+ *   @brief  estimates cost of the iteration, conjunctions let the cheapest iterator propose candidates 
+ *  
+ *   @return upper bound of the number of matching documents
+ */
+    virtual unsigned long cost() const = 0;
+
+/** 
+ *   @brief  actual cost of the iteration so far: moves of posting cursors, comparisons of docIDs of 
+ *           disjunctions and bitmap probes, made by the iterator and its children (see QueryNode)
+ *  
+ *   @return number of operations
+ */
+    virtual unsigned long operations() const = 0;
+
+private:
+    DocIterator(const DocIterator&);
+    DocIterator& operator=(const DocIterator&);
+};
+
+typedef vector<DocIterator*> DOC_ITERATOR_LIST;
+
+/**
+ *  @brief Documents of a posting list
+ */
+class TermIterator : public DocIterator{
+public:
+/** 
+ *   @param  list posting list to iterate, NULL (term not in the index) matches no documents
+ */
+    explicit TermIterator(const CompactPostingList* list): m_cursor(list), m_operations(0){}
+
+    virtual bool valid() const {return m_cursor.valid();}
+    virtual unsigned int docID() const {return m_cursor.docID();}
+    virtual void next(){m_operations++; m_cursor.next();}
+    virtual void advance(unsigned int target){m_operations++; m_cursor.advance(target);}
+    virtual unsigned long cost() const {return m_cursor.size();}
+    virtual unsigned long operations() const {return m_operations;}
+
+private:
+    PostingCursor m_cursor;
+    unsigned long m_operations;
+};
+
+/**
+ *  @brief Documents of a list of docIDs, in the order of the list. advance() expects the list to be sorted.
+ */
+class DocListIterator : public DocIterator{
+public:
+    explicit DocListIterator(const vector<unsigned long>& docIDs): m_docIDs(docIDs), m_index(0), m_operations(0){}
+
+    virtual bool valid() const {return m_index < m_docIDs.size();}
+    virtual unsigned int docID() const {return static_cast<unsigned int>(m_docIDs[m_index]);}
+    virtual void next(){m_operations++; m_index++;}
+    virtual void advance(unsigned int target);
+    virtual unsigned long cost() const {return m_docIDs.size();}
+    virtual unsigned long operations() const {return m_operations;}
+
+private:
+    const vector<unsigned long>& m_docIDs;
+    unsigned long m_index;
+    unsigned long m_operations;
+};
+
+/**
+ *  @brief Documents matching all the child iterators. The first child proposes candidates, the others are 
+ *         moved to them (see INTERSECTION_ALGORITHM). Conjunction of no iterators matches no documents.
+ */
+class AndIterator : public DocIterator{
+public:
+/** 
+ *   @param  children iterators to intersect, the cheapest one should go first
+ *   @param  algorithm how the other children are moved to the candidates, INTERSECTION_BITMAP expects
+ *                     them to be BitmapIterator
+ */
+    explicit AndIterator(const DOC_ITERATOR_LIST& children, INTERSECTION_ALGORITHM algorithm = INTERSECTION_GALLOP);
+    virtual ~AndIterator();
+
+    virtual bool valid() const {return m_valid;}
+    virtual unsigned int docID() const {return m_children[0]->docID();}
+    virtual void next();
+    virtual void advance(unsigned int target);
+    virtual unsigned long cost() const {return m_children.empty() ? 0 : m_children[0]->cost();}
+    virtual unsigned long operations() const;
+
+private:
+/** 
+ *   @brief  moves the children from the current candidate of the first child to the first document 
+ *           matching all of them
+ *  
+ *   @return void
+ */
+    void findMatch();
+
+    DOC_ITERATOR_LIST m_children;
+    INTERSECTION_ALGORITHM m_algorithm;
+    bool m_valid;
+};
+
+/**
+ *  @brief Documents matching at least one of the child iterators
+ */
+class OrIterator : public DocIterator{
+public:
+    explicit OrIterator(const DOC_ITERATOR_LIST& children);
+    virtual ~OrIterator();
+
+    virtual bool valid() const {return m_valid;}
+    virtual unsigned int docID() const {return m_docID;}
+    virtual void next();
+    virtual void advance(unsigned int target);
+    virtual unsigned long cost() const;
+    virtual unsigned long operations() const;
+
+private:
+/** 
+ *   @brief  finds the smallest docID among the children 
+ *  
+ *   @return void
+ */
+    void findMatch();
+
+    DOC_ITERATOR_LIST m_children;
+    bool m_valid;
+    unsigned int m_docID;
+    unsigned long m_comparisons;
+};
+
+/**
+ *  @brief Documents matching the included iterator but not the excluded one
+ */
+class NotIterator : public DocIterator{
+public:
+    NotIterator(DocIterator* included, DocIterator* excluded);
+    virtual ~NotIterator();
+
+    virtual bool valid() const {return m_included->valid();}
+    virtual unsigned int docID() const {return m_included->docID();}
+    virtual void next();
+    virtual void advance(unsigned int target);
+    virtual unsigned long cost() const {return m_included->cost();}
+    virtual unsigned long operations() const {return m_included->operations() + m_excluded->operations();}
+
+private:
+/** 
+ *   @brief  moves the included iterator from its current document to the first one the excluded iterator doesn't match 
+ *  
+ *   @return void
+ */
+    void findMatch();
+
+    DocIterator* m_included;
+    DocIterator* m_excluded;
+};
+
+/**
+ *  @brief Documents of the source iterators, loaded into a bitmap of docIDs when the iterator is created. 
+ *         Moving to a target is a scan of the bitmap words from the target, so conjunctions probing 
+ *         a dense disjunction many times don't pay for moving all its children on every probe.
+ */
+class BitmapIterator : public DocIterator{
+public:
+/** 
+ *   @param  sources iterators whose documents are loaded (their union), deleted once loaded 
+ */
+    explicit BitmapIterator(const DOC_ITERATOR_LIST& sources);
+
+    virtual bool valid() const {return m_valid;}
+    virtual unsigned int docID() const {return m_docID;}
+    virtual void next();
+    virtual void advance(unsigned int target);
+    virtual unsigned long cost() const {return m_docs;}
+    virtual unsigned long operations() const {return m_operations;}
+
+private:
+/** 
+ *   @brief  moves to the first document with docID equal or greater than the given one 
+ *  
+ *   @param  from docID to start at
+ *   @return void
+ */
+    void findMatch(unsigned long from);
+
+    vector<unsigned long long> m_bits;  // bit of every docID of the sources
+    unsigned long m_docs;
+    bool m_valid;
+    unsigned int m_docID;
+    unsigned long m_operations;         // operations of loading the sources and of the probes
+};
+
+/**
+ *  @brief Documents containing all the units of a proximity query (terms, or pairs of adjacent terms from the 
+ *         pair index) positioned as the query requires. The shortest posting list proposes candidates, and 
+ *         positions are only decoded for documents containing all the units.
+ */
+class PositionalIterator : public DocIterator{
+public:
+/** 
+ *   @param  lists posting list of every unit, in the query order (a list may repeat)
+ *   @param  query query to count candidate and verified documents of, may be NULL
+ */
+    PositionalIterator(const vector<const CompactPostingList*>& lists, ProximityQuery* query);
+
+    virtual bool valid() const {return m_valid;}
+    virtual unsigned int docID() const {return m_cursors[0].docID();}
+    virtual void next();
+    virtual void advance(unsigned int target);
+    virtual unsigned long cost() const {return m_cursors[0].size();}
+    virtual unsigned long operations() const {return m_operations;}
+
+protected:
+/** 
+ *   @brief  checks positions of the units in the current candidate document 
+ *  
+ *   @param  positions positions of every unit in the document
+ *   @return true if the document matches
+ */
+    virtual bool matchPositions(const vector<const POSITIONS_LIST*>& positions) = 0;
+
+/** 
+ *   @brief  moves from the current candidate of the shortest list to the first matching document. 
+ *           Called by the constructors of derived classes, to find the first document.
+ *  
+ *   @return void
+ */
+    void findMatch();
+
+private:
+    vector<PostingCursor> m_cursors;        // cursors of the distinct posting lists, the shortest first
+    vector<unsigned int> m_unitCursors;     // cursor of each unit
+    vector<const POSITIONS_LIST*> m_positions;
+    ProximityQuery* m_query;
+    bool m_valid;
+    unsigned long m_operations;
+};
+
+/**
+ *  @brief Documents containing the units of a phrase at their offsets in the phrase (see findPhrase())
+ */
+class PhraseIterator : public PositionalIterator{
+public:
+/** 
+ *   @param  lists posting list of every unit of the phrase
+ *   @param  offsets position of every unit in the phrase
+ *   @param  query query to count candidate and verified documents of, may be NULL
+ */
+    PhraseIterator(const vector<const CompactPostingList*>& lists, const vector<unsigned long>& offsets, ProximityQuery* query);
+
+protected:
+    virtual bool matchPositions(const vector<const POSITIONS_LIST*>& positions);
+
+private:
+    vector<unsigned long> m_offsets;
+};
+
+/**
+ *  @brief Documents containing the terms of a proximity query within its window (see findProximityWindow())
+ */
+class WindowIterator : public PositionalIterator{
+public:
+/** 
+ *   @param  lists posting list of every term of the query
+ *   @param  proximityWnd maximal number of other words among the terms
+ *   @param  ordered true if the terms must occur in the query order
+ *   @param  query query to count candidate and verified documents of, may be NULL
+ */
+    WindowIterator(const vector<const CompactPostingList*>& lists, unsigned long proximityWnd, bool ordered, ProximityQuery* query);
+
+protected:
+    virtual bool matchPositions(const vector<const POSITIONS_LIST*>& positions);
+
+private:
+    unsigned long m_proximityWnd;
+    bool m_ordered;
+};
+
+/**
+ *  @brief Node of a boolean query plan, built by QueryParser and estimated by SearchEngine::planQuery(). Costs 
+ *         are counted in operations: moves of posting cursors, docID comparisons of disjunctions and bitmap probes.
+ *         A node owns its children.
+ */
+class QueryNode{
+public:
+    explicit QueryNode(QUERY_NODE_TYPE nodeType);
+    ~QueryNode();
+
+    QUERY_NODE_TYPE type;
+    string          text;               // term (TERM), or text of the proximity query (PROXIMITY)
+    unsigned int    termID;             // ID of the term (TERM), INVALID_TERM_ID if it's not in the index
+    ProximityQuery* proxQuery;          // proximity query (PROXIMITY), owned by the node
+    vector<QueryNode*> children;        // operands (AND, OR, NOT), the positive operands of AND go first
+    INTERSECTION_ALGORITHM algorithm;   // how the positive operands of AND are intersected
+    double          estimatedDocs;      // estimated number of matching documents
+    double          estimatedCost;      // estimated operations to find all the matching documents
+    double          probeCost;          // estimated operations of moving to a target document
+    bool            evaluated;          // whether the node had its own iterator, which measured the values below
+    unsigned long   actualDocs;         // documents found by the iterator of the node
+    unsigned long   actualCost;         // operations made by the iterator of the node
+
+private:
+    QueryNode(const QueryNode&);
+    QueryNode& operator=(const QueryNode&);
+};
+
+/**
+ *  @brief Forwards to the iterator of a query plan node, and records the documents found and 
+ *         operations made by the iterator into the node (see SearchEngine::setExplain())
+ */
+class ExplainIterator : public DocIterator{
+public:
+/** 
+ *   @param  iterator iterator of the node, owned by the explain iterator
+ *   @param  node plan node to record the values into
+ */
+    ExplainIterator(DocIterator* iterator, QueryNode* node);
+    virtual ~ExplainIterator();
+
+    virtual bool valid() const {return m_iterator->valid();}
+    virtual unsigned int docID() const {return m_iterator->docID();}
+    virtual void next(){m_iterator->next(); countDocument();}
+    virtual void advance(unsigned int target){m_iterator->advance(target); countDocument();}
+    virtual unsigned long cost() const {return m_iterator->cost();}
+    virtual unsigned long operations() const {return m_iterator->operations();}
+
+private:
+/** 
+ *   @brief  counts the current document of the iterator, unless it was already counted
+ *  
+ *   @return void
+ */
+    void countDocument();
+
+    DocIterator* m_iterator;
+    QueryNode* m_node;
+    bool m_counted;             // whether any document was counted yet
+    unsigned int m_lastDocID;   // the last counted document
+};
+
+/**
+ *  @brief Parses boolean queries into a tree of QueryNode. The grammar, from the lowest precedence:
+ *           query   := and { "OR" and }
+ *           and     := unary { ["AND"] unary }     (adjacent operands are ANDed)
+ *           unary   := "NOT" unary | primary
+ *           primary := "(" query ")" | "term1 term2 ..." | N(term1 term2 ...) | N[term1 term2 ...] | word
+ *         Operators are only recognized in upper case, so that "and", "or" and "not" stay ordinary words. 
+ *         Malformed queries are parsed leniently: missing parentheses are closed at the end of the query, 
+ *         and operators without operands are ignored, as well as words without terms (stop-words). 
+ */
+class QueryParser{
+public:
+    explicit QueryParser(const string& query);
+
+/** 
+ *   @brief  parses the query 
+ *  
+ *   @return root of the query tree, owned by the caller, NULL if the query has no terms
+ */
+    QueryNode* parse();
+
+private:
+/**
+ *  @brief Token of the query: operator, parenthesis, word, phrase or proximity query
+ */
+    class Token{
+    public:
+        Token(QUERY_TOKEN_TYPE t, const string& s, unsigned long wnd = 0, bool isOrdered = true):
+            type(t), text(s), proximityWnd(wnd), ordered(isOrdered){}
+
+        QUERY_TOKEN_TYPE type;
+        string           text;          // word, or text of the phrase or proximity query
+        unsigned long    proximityWnd;
+        bool             ordered;
+    };
+
+/** 
+ *   @brief  splits the query into tokens 
+ *  
+ *   @param  query query text
+ *   @return void
+ */
+    void tokenize(const string& query);
+
+    QueryNode* parseOr();
+    QueryNode* parseAnd();
+    QueryNode* parseUnary();
+    QueryNode* parsePrimary();
+
+/** 
+ *   @brief  builds node of a word, or of a phrase or proximity query
+ *  
+ *   @param  token the word, phrase or proximity query
+ *   @return node, NULL if the token has no terms
+ */
+    QueryNode* operandNode(const Token& token);
+
+    bool atOperand() const;
+
+    vector<Token> m_tokens;
+    unsigned long m_next;       // index of the next token to parse
+};
+
+/**
+ *  @brief Singleton class used for tokenization and normalizations of free text
+ */
+class Tokenizer{
+public: 
+    static Tokenizer& singleton();
+
+/** 
+ *   @brief  creates tokenizer for a worker thread, the stemmer keeps state between calls, 
+ *           so threads can't share a tokenizer 
+ */
+    Tokenizer(){}
+
+ /** 
+ *   @brief  breaks free text into normlized tokens 
+ *  
+ *   @param  text free text (can be a user query or text from document)
+ *   @return void
+ */ 
+    vector<string> tokenize(string& text);
+
+protected:
+ /** 
+ *   @brief  applies stemming to the term.
+ *           (uses Krovetz stemmer) 
+ *  
+ *   @param  term term to stem, modified upon return 
+ *   @return void
+ */   
+    void stemTerm(string& term);
+
+ /** 
+ *   @brief  determines whether a word is a stop-word
+ *  
+ *   @param  word word to check 
+ *   @return true if stop-word, false otherwise
+ */     
+    bool isStopWord(string& word);
+
+private: 
+    Tokenizer(const Tokenizer&);
+    Tokenizer& operator=(const Tokenizer&);
+
+    KrovetzStemmer m_stemmer;    // 3rd party stemmer
+};
+
+/**
+ *  @brief Documents inverted together by a worker thread of the parallel index build (see 
+ *         SearchEngine::setIndexThreads()), into postings private to the batch. Terms of the batch get
+ *         IDs of their own, in the order of their first occurrence, which Index::addBatches() maps
+ *         to the term IDs of the index.
+ */
+class DocumentBatch{
+public:
+
+/** 
+ *   @brief  adds document to the batch 
+ *  
+ *   @param  docID ID of the document
+ *   @param  tokens words of the document, as read from the collection file
+ *   @return void
+ */
+    void addDocument(unsigned long docID, const vector<string>& tokens);
+
+/** 
+ *   @brief  creates the documents of the batch and inverts them, the way SearchEngine::buildFromFile()
+ *           adds them to the index 
+ *  
+ *   @param  tokenizer tokenizer of the calling thread
+ *   @return void
+ */
+    void invert(Tokenizer& tokenizer);
+
+/** 
+ *   @brief  maps terms of the batch to term IDs of the index 
+ *  
+ *   @param  termIDs index term ID of each term of the batch, in the order of their batch IDs
+ *   @return void
+ */
+    void setTermIDs(const vector<unsigned int>& termIDs);
+
+/** 
+ *   @brief  finds the first term of the batch with index term ID equal or greater than the given one
+ *  
+ *   @param  termID index term ID
+ *   @return position of the term in the terms ordered by their index term IDs (see termID())
+ */
+    unsigned long findTerm(unsigned int termID) const;
+
+    unsigned long termsCount() const {return m_postings.size();}
+    string term(unsigned int batchTermID) const {return m_dictionary.term(batchTermID);}
+
+    // i-th term ordered by index term IDs, see setTermIDs()
+    unsigned int termID(unsigned long i) const {return m_termIDs[i].first;}
+    POSTING_LIST& postings(unsigned long i){return m_postings[m_termIDs[i].second];}
+
+    const vector<unsigned long>& docIDs() const {return m_docIDs;}
+    const vector<TextDocument*>& documents() const {return m_documents;}
+
+private:
+    vector<unsigned long>      m_docIDs;
+    vector<vector<string> >    m_tokens;            // words of each document, released once it is inverted
+    vector<TextDocument*>      m_documents;         // created by invert(), owned by the collection afterwards
+    TermDictionary             m_dictionary;        // maps term to its batch ID
+    vector<POSTING_LIST>       m_postings;          // posting list of each term, indexed by batch ID
+    vector<pair<unsigned int, unsigned int> > m_termIDs; // index term ID and batch ID of each term, ordered by index term IDs
+};
+
+/**
+ *  @brief Immutable part of the index: compressed posting lists of the terms of some of the documents.
+ *         Segments are created by flushing the postings of recently added documents, and by merging
+ *         smaller segments (see Index). Only the impacts of the lists change, whenever the collection does.
+ */
+class IndexSegment{
+public:
+    IndexSegment():
+        m_postingsCount(0),
+        m_firstDocID(MAX_DOC_ID),
+        m_lastDocID(0),
+        m_merging(false){}
+
+/** 
+ *   @brief  builds the segment from postings of recently added documents 
+ *  
+ *   @param  postings posting list of each term (indexed by term ID), emptied by the call
+ *   @return void
+ */
+    void build(vector<POSTING_LIST>& postings);
+
+/** 
+ *   @brief  builds the segment from postings of inverted document batches, in parallel: threads take 
+ *           INDEX_MERGE_CHUNK terms at a time, and concatenate and compress their lists from all the batches.
+ *           The lists are the same as those built from postings of the documents added one after another.
+ *  
+ *   @param  batches the batches, in the order of their documents, with their terms mapped to term IDs of 
+ *           the index (see Index::addBatches()), their postings are emptied by the call
+ *   @param  threadsCount number of threads
+ *   @return void
+ */
+    void build(const vector<DocumentBatch*>& batches, unsigned int threadsCount);
+
+/** 
+ *   @brief  builds the segment from postings of other segments, postings of a document present in several
+ *           of them are combined (see CompactPostingList::decode()). Postings of the documents deleted
+ *           when the merge was started (see startMerge()) are left out.
+ *  
+ *   @param  segments segments to merge
+ *   @return void
+ */
+    void merge(const vector<IndexSegment*>& segments);
+
+/** 
+ *   @brief  makes the segment read the posting lists of all the terms from a memory-mapped index file
+ *  
+ *   @param  file the index file, must stay mapped for the lifetime of the segment
+ *   @param  entries location of the list of each term in the file
+ *   @param  termsCount number of terms
+ *   @return false if an entry points out of the file
+ */
+    bool load(const MappedFile& file, const PostingListEntry* entries, unsigned long termsCount);
+
+/** 
+ *   @brief  looks up posting list of a term in the segment 
+ *  
+ *   @param  termID ID of the term
+ *   @return pointer to the posting list, NULL if no document of the segment contains the term
+ */
+    CompactPostingList* find(unsigned int termID);
+
+    unsigned long termsCount() const {return m_termIDs.size();}
+    unsigned int termID(unsigned long i) const {return m_termIDs[i];}
+    unsigned long postingsCount() const {return m_postingsCount;}
+    unsigned long memoryUsage() const;
+
+/** 
+ *   @brief  finds the terms of a document which isn't deleted from the segment
+ *  
+ *   @param  docID the document
+ *   @param  termIDs receives IDs of the terms with a posting of the document in the segment
+ *   @return length of the document in the segment, the sum of the term frequencies
+ */
+    unsigned long documentTerms(unsigned int docID, vector<unsigned int>& termIDs) const;
+
+/** 
+ *   @brief  checks whether the document is within the range of docIDs of the segment, 
+ *           i.e. whether the segment may contain it
+ *  
+ *   @param  docID the document
+ *   @return false if the segment doesn't contain the document
+ */
+    bool mayContain(unsigned int docID) const {return docID >= m_firstDocID && docID <= m_lastDocID;}
+
+/** 
+ *   @brief  marks document as deleted, cursors over the segment's lists then skip its postings
+ *  
+ *   @param  docID the document
+ *   @return void
+ */
+    void deleteDocument(unsigned int docID){m_deletedDocs.add(docID);}
+
+    const DeletedDocs& deletedDocs() const {return m_deletedDocs;}
+
+/** 
+ *   @brief  marks the segment as being merged, and takes a copy of its deleted documents, 
+ *           which the merge leaves out
+ *  
+ *   @return void
+ */
+    void startMerge(){
+        m_merging = true;
+        m_purgedDocs = m_deletedDocs;
+    }
+
+    bool merging() const {return m_merging;}
+    const DeletedDocs& purgedDocs() const {return m_purgedDocs;}
+
+private:
+    // lists point to the segment's deleted documents, so the segment isn't copied
+    IndexSegment(const IndexSegment&);
+    IndexSegment& operator=(const IndexSegment&);
+
+/** 
+ *   @brief  body of the threads of the parallel build(): merges chunks of terms until all of them are taken
+ *  
+ *   @param  build state of the build shared by the threads
+ *   @return NULL
+ */
+    static void* buildThread(void* build);
+
+/** 
+ *   @brief  extends range of docIDs of the segment (see mayContain()) to include the given one
+ *  
+ *   @param  firstDocID lowest docID to include
+ *   @param  lastDocID highest docID to include
+ *   @return void
+ */
+    void extendDocRange(unsigned int firstDocID, unsigned int lastDocID){
+        m_firstDocID = min(m_firstDocID, firstDocID);
+        m_lastDocID = max(m_lastDocID, lastDocID);
+    }
+
+    vector<unsigned int>       m_termIDs;           // terms with postings in the segment, sorted
+    vector<CompactPostingList> m_lists;             // posting list of each of the terms
+    unsigned long              m_postingsCount;
+    unsigned int               m_firstDocID;        // range of docIDs of the segment's postings
+    unsigned int               m_lastDocID;
+    bool                       m_merging;           // segment is being merged by the merge thread (see Index)
+    DeletedDocs                m_deletedDocs;       // documents deleted from the segment
+    DeletedDocs                m_purgedDocs;        // documents deleted when the segment's merge was started
+};
+
+/**
+ *  @brief Implements indexing of the documents including 
+ *   tokenization, stemming, and normalization (i.e. lower-case conversion).
+ *   Postings of new documents are kept in an in-memory segment, which is flushed into an immutable 
+ *   IndexSegment when the index is frozen. Once the index has segments, the in-memory segment of the documents
+ *   added to it is also flushed whenever it holds the segment size of postings. A background thread merges segments of the 
+ *   same size tier, SEGMENT_MERGE_FACTOR at a time, and freeze() completes the merges it hasn't done yet.
+ *   Queries read a view of each term's lists in all the segments (see CompactPostingList::setParts()), 
+ *   so their results don't depend on the segments.
+ */
+class Index{
+public:
+    explicit Index(RANKING_MODEL rankingModel = RANKING_MODEL_TFIDF):
+        m_rankingModel(rankingModel),
+        m_minLengthNorm(0),
+        m_impactScale(0),
+        m_collectionSize(0),
+        m_lengthSum(0),
+        m_minLengthCode(LENGTH_CODES - 1),
+        m_statisticsVersion(0),
+        m_impactOrdered(false),
+        m_pairIndex(false),
+        m_pairMinFrequency(0),
+        m_pairMemoryBudget(0),
+        m_pairsCount(0),
+        m_file(NULL),
+        m_segmentSize(SEGMENT_SIZE),
+        m_bufferedPostings(0),
+        m_mergeThreadRunning(false),
+        m_stopMerging(false),
+        m_memoryBudget(0),
+        m_spillDir(SPILL_DIR),
+        m_runMemory(0),
+        m_runsCount(0){
+        pthread_mutex_init(&m_segmentsMutex, NULL);
+        pthread_cond_init(&m_segmentsChanged, NULL);
+    }
+    ~Index();
+    
+/** 
+ *   @brief  adds new text into the index by performing  
+ *           tokenization, stemming, and normalization  
+ *  
+ *   @param  text text to add, can contain multiple words 
+ *   @param  docID document ID where text resides 
+ *   @pos    position of the term in the document
+ *   @return void
+ */  
+    void addText(string& text, unsigned long& docID, unsigned long& pos);
+
+/** 
+ *   @brief  prints index terms to the screen, including document frequency and posting lists 
+ *  
+ *   @return void
+ */
+    void print(bool includePostings = true);
+
+/** 
+ *   @brief  looks up ID of a term in the index 
+ *  
+ *   @param  term term to look for 
+ *   @return ID of the term, or INVALID_TERM_ID if the term is not in the index
+ */  
+    unsigned int getTermID(const string& term) const;
+
+/** 
+ *   @brief  retrieves posting list for a give term in the index.
+ *           Only includes documents added before the last call to freeze(). 
+ *  
+ *   @param  termID ID of the term for which posting list is desired 
+ *   @return pointer to CompactPostingList, NULL for INVALID_TERM_ID
+ */  
+    const CompactPostingList* getPostings(unsigned int termID) const;
+
+/** 
+ *   @brief  retrieves document frequency of a term, i.e. in how many documents in the collection this term is present
+ *  
+ *   @param  termID ID of the term (must be valid)
+ *   @return document frequency
+ */  
+    unsigned long df(unsigned int termID) const {return m_df[termID];}
+
+    RANKING_MODEL rankingModel() const {return m_rankingModel;}
+
+    unsigned int termsCount() const {return m_df.size();}
+
+/** 
+ *   @brief  retrieves inverse document frequency of a term, calculated by finalize() and update(): 
+ *           log2(N/df) for TF.IDF, log(1 + (N - df + 0.5) / (df + 0.5)) for BM25
+ *  
+ *   @param  termID ID of the term (must be valid)
+ *   @return inverse document frequency
+ */  
+    double idf(unsigned int termID) const {return m_idf[termID];}
+
+/** 
+ *   @brief  weight of a term in a document under the ranking model of the index
+ *  
+ *   @param  termID ID of the term (must be valid)
+ *   @param  tf term frequency in the document
+ *   @param  docID document (its length matters for BM25)
+ *   @return weight
+ */  
+    double weight(unsigned int termID, unsigned int tf, unsigned int docID) const{
+        if(m_rankingModel == RANKING_MODEL_BM25)
+            return bm25Weight(tf, m_idf[termID], m_lengthNorms[m_lengthCodes[docID]]);
+        return termWeight(tf, m_idf[termID]);
+    }
+
+/** 
+ *   @brief  highest weight of a term in any document with the given term frequency (BM25 weight is the highest
+ *           in the shortest document), used as a score upper bound
+ *  
+ *   @param  termID ID of the term (must be valid)
+ *   @param  tf term frequency in the document
+ *   @return weight
+ */  
+    double maxWeight(unsigned int termID, unsigned int tf) const{
+        if(m_rankingModel == RANKING_MODEL_BM25)
+            return bm25Weight(tf, m_idf[termID], m_minLengthNorm);
+        return termWeight(tf, m_idf[termID]);
+    }
+
+/** 
+ *   @brief  quantizes weight of a term in a document into an impact, the way finalize() does for every posting.
+ *           Impacts are proportional to the weights, i.e. weight = impact / impactScale(), up to rounding.
+ *           Quantization is monotone, so the impact of maxWeight() bounds impacts of all the postings with the tf.
+ *  
+ *   @param  weight weight of the term in the document (see weight() and maxWeight())
+ *   @return impact, from 0 to IMPACT_MAX
+ */  
+    unsigned int impact(double weight) const;
+
+    double impactScale() const {return m_impactScale;}
+
+/** 
+ *   @brief  quantized length of each document (see lengthCode()) and BM25 length norm of each quantized 
+ *           length, k1 * (1 - b + b * length / average length), filled by finalize() for BM25 index
+ *  
+ *   @return array indexed by docID, array indexed by length code
+ */  
+    const unsigned char* lengthCodes() const {return m_lengthCodes.data();}
+    const double* lengthNorms() const {return m_lengthNorms;}
+
+/** 
+ *   @brief weight of a term in a document, TF.IDF 
+ *  
+ *   @param  tf term frequency in the document
+ *   @param  idf inverse document frequency of the term
+ *   @return weight
+ */
+    static double termWeight(unsigned int tf, double idf){
+        return (1 + log2(static_cast<double>(tf))) * idf;
+    }
+
+/** 
+ *   @brief weight of a term in a document, BM25 
+ *  
+ *   @param  tf term frequency in the document
+ *   @param  idf BM25 inverse document frequency of the term
+ *   @param  lengthNorm length norm of the document (see lengthNorms())
+ *   @return weight
+ */
+    static double bm25Weight(unsigned int tf, double idf, double lengthNorm){
+        double freq = static_cast<double>(tf);
+        return idf * freq * (BM25_K1 + 1) / (freq + lengthNorm);
+    }
+
+/** 
+ *   @brief quantizes document length into one byte: lengths below LENGTH_EXACT_CODES are kept exactly, 
+ *          longer ones are rounded down to a power of LENGTH_CODE_GROWTH (times LENGTH_EXACT_CODES)
+ *  
+ *   @param  length number of term occurrences in the document
+ *   @return length code, below LENGTH_CODES
+ */
+    static unsigned int lengthCode(unsigned long length);
+
+/** 
+ *   @brief shortest document length quantized into the code (see lengthCode())
+ *  
+ *   @param  code length code
+ *   @return document length
+ */
+    static double codeLength(unsigned int code);
+
+/** 
+ *   @brief  adds term into index if not already there. If already there, just adds a document ID to the posting list. 
+ *  
+ *   @param  term term being added 
+ *   @param  docID id of the document where the term is from
+ *   @pos    position of the term in the document
+ *   @return void
+ */
+    void addTerm(string& term,unsigned long& docID, unsigned long& pos);
+
+/** 
+ *   @brief  deletes all documents with the ID from the index. Postings in the in-memory segment are dropped from 
+ *           the lists of the terms addTerm() recorded for the document (and so are occurrences in the run buffers
+ *           and in the runs spilled so far, see setMemoryBudget()), and the document is marked as deleted in the immutable segments which contain it (only segments 
+ *           whose range of docIDs includes the document are searched for its terms), so that cursors
+ *           skip its postings until merges purge them. Terms of the document are updated by the next freeze(),
+ *           a document with the same ID added afterwards is a new one.
+ *  
+ *   @param  docID ID of the document
+ *   @return void
+ */
+    void deleteDocument(unsigned long docID);
+
+/** 
+ *   @brief  adds documents inverted by the parallel index build (see DocumentBatch), as a new immutable 
+ *           segment built by several threads. Terms new to the index get IDs in the order of their first 
+ *           occurrence in the batches, as if their documents were added one after another.
+ *  
+ *   @param  batches inverted batches, in the order of their documents
+ *   @param  threadsCount number of threads building the segment
+ *   @return void
+ */
+    void addBatches(const vector<DocumentBatch*>& batches, unsigned int threadsCount);
+
+/** 
+ *   @brief  marks the end of a document added with addText() and addTerm(), and flushes the in-memory segment
+ *           into an immutable segment if it holds the segment size of postings (see setSegmentSize()) and
+ *           the index has segments already, so that the first build of the index flushes a single segment
+ *  
+ *   @return void
+ */
+    void endDocument();
+
+/** 
+ *   @brief  flushes postings added since the previous call into an immutable segment, completes the merges
+ *           the background thread hasn't done yet (see completeMerges()), and updates the posting lists read
+ *           by queries and document frequencies of the terms whose documents were added or deleted. 
+ *           Must be called after documents were added or deleted and before the index is queried. 
+ *  
+ *   @return void
+ */
+    void freeze();
+
+/** 
+ *   @brief  replaces segments merged by the background thread since the previous call with the merged ones.
+ *           Results of queries don't change, only the number of lists they read. Called before every query.
+ *  
+ *   @return void
+ */
+    void refresh();
+
+/** 
+ *   @brief  waits for the background merges and merges all the segments into one
+ *  
+ *   @return void
+ */
+    void mergeSegments();
+
+/** 
+ *   @brief  sets how many postings the in-memory segment of the documents added to an index which has segments
+ *           holds before it is flushed (SEGMENT_SIZE by default), see endDocument()
+ *  
+ *   @param  segmentSize number of postings, 0 flushes only when the index is frozen
+ *   @return void
+ */
+    void setSegmentSize(unsigned long segmentSize){m_segmentSize = segmentSize;}
+    unsigned long segmentSize() const {return m_segmentSize;}
+
+/** 
+ *   @brief  prepares the frozen index for scoring: calculates idf of every term (and BM25 length norms of
+ *           the documents, from the term frequencies in the index) and stores quantized weight (impact) of
+ *           every posting. The index-wide scale maps the highest weight to IMPACT_MAX. 
+ *           Must be called after freeze(), whenever the collection changes.
+ *  
+ *   @param  collectionSize number of documents in the collection (N)
+ *   @return void
+ */
+    void finalize(unsigned long collectionSize);
+
+/** 
+ *   @brief  brings the finalized index up to date with the documents added and deleted since the previous call,
+ *           without finalizing it again: freezes the index, which updates df of the terms the documents touch, 
+ *           the BM25 length norms from the running sum of the document lengths and N, and idf of every term (a pass
+ *           over the dictionary, not the postings). Lists of the indexed pairs of those terms are patched for the
+ *           documents (the pairs to index are only chosen again by finalize()). Impacts of the terms (and 
+ *           impact-ordered lists) are updated lazily by updateTermWeights().
+ *           Within a memory budget the buffered occurrences become the in-memory segment, so the index file 
+ *           isn't written again; once a run was spilled (see runsCount()) mergeRuns() must be called instead.
+ *  
+ *   @param  collectionSize number of documents in the collection (N)
+ *   @return void
+ */
+    void update(unsigned long collectionSize);
+
+/** 
+ *   @brief  updates impacts of a term (and its impact-ordered list) if the statistics changed since they were
+ *           calculated (see update()). Called for the terms of every ranked query before they are scored.
+ *  
+ *   @param  termID ID of the term, INVALID_TERM_ID is ignored
+ *   @return void
+ */
+    void updateTermWeights(unsigned int termID);
+
+/** 
+ *   @brief  builds the index within a memory budget by single-pass in-memory inversion (SPIMI): occurrences of
+ *           the terms of added documents are appended to compact buffers kept per term ID, instead of the in-memory
+ *           segment, and once the buffers use up the budget they are spilled into a run file, with terms and postings
+ *           sorted. mergeRuns() merges the runs into the index file, which queries then read memory-mapped (see load()).
+ *           The terms recorded for each buffered document (see deleteDocument()) count into the budget too.
+ *           The dictionary, the per-term and per-document arrays (e.g. document lengths) and the compressed posting
+ *           list of the term being merged aren't counted in the budget, and the pair index isn't built.
+ *  
+ *   @param  memoryBudget highest size of the buffers in bytes, 0 keeps postings in memory (default)
+ *   @param  spillDir existing directory for the run files and the index file
+ *   @return void
+ */
+    void setMemoryBudget(unsigned long memoryBudget, const string& spillDir);
+    unsigned long memoryBudget() const {return m_memoryBudget;}
+    const string& spillDir() const {return m_spillDir;}
+    unsigned long runsCount() const {return m_runFiles.size();}  // runs spilled since the last mergeRuns()
+
+/** 
+ *   @brief  spills the buffered occurrences into a run, and merges all the runs and the segments (e.g. of the index merged
+ *           before) into a new index file in the spill directory, with a k-way merge of their terms read twice: first for
+ *           the statistics finalize() calculates, then for the posting lists. Postings of a term are merged from its
+ *           runs and segments one at a time, and encoded as they are merged, so only one compressed list is in memory. 
+ *           The new file replaces the index, postings of the deleted documents are left out. Replaces freeze() and 
+ *           finalize() when the memory budget is set.
+ *  
+ *   @param  documents docIDs of the collection documents, stored as the document metadata
+ *   @return false if a file can't be written or read
+ */
+    bool mergeRuns(const vector<unsigned long>& documents);
+
+/** 
+ *   @brief  enables secondary, impact-ordered layout of the posting lists (see ImpactOrderedList), which
+ *           is then built by finalize(). If the index is finalized already, the layout is built right away.
+ *  
+ *   @param  impactOrdered true to keep impact-ordered posting lists
+ *   @return void
+ */
+    void setImpactOrdered(bool impactOrdered);
+
+    bool impactOrdered() const {return m_impactOrdered;}
+
+/** 
+ *   @brief  retrieves impact-ordered posting list of a term (see setImpactOrdered())
+ *  
+ *   @param  termID ID of the term (must be valid)
+ *   @return pointer to ImpactOrderedList
+ */
+    const ImpactOrderedList* getImpactOrderedPostings(unsigned int termID) const {return &m_impactOrderedPostings[termID];}
+
+/** 
+ *   @brief  enables auxiliary index of adjacent term pairs (next-word index), which answers phrases without 
+ *           checking positions of the single terms. When the index is built, finalize() collects the adjacent pairs from
+ *           positions of all the terms, ordered by document and position, and stores posting lists
+ *           of the frequent pairs and of the pairs added with addPairCandidate(), the most frequent ones first,
+ *           until the memory budget is used up. Must be called before the index is finalized.
+ *  
+ *   @param  minFrequency pairs occurring at least this many times in the collection are indexed,
+ *                        0 indexes only the pairs added with addPairCandidate()
+ *   @param  memoryBudget highest size of the pair posting lists in bytes, 0 means no limit
+ *   @return void
+ */
+    void setPairIndex(unsigned long minFrequency, unsigned long memoryBudget);
+
+/** 
+ *   @brief  requests pair of terms to be indexed by the pair index regardless of its frequency (see setPairIndex()),
+ *           e.g. a pair found in a query log
+ *  
+ *   @param  term1 first term (normalized, see Tokenizer)
+ *   @param  term2 term following the first one
+ *   @return void
+ */
+    void addPairCandidate(const string& term1, const string& term2);
+
+/** 
+ *   @brief  retrieves posting list of a pair of adjacent terms from the pair index. Positions of the 
+ *           postings are positions of the first term.
+ *  
+ *   @param  termID1 ID of the first term
+ *   @param  termID2 ID of the term following the first one
+ *   @return pointer to CompactPostingList, NULL if the pair is not indexed
+ */
+    const CompactPostingList* getPairPostings(unsigned int termID1, unsigned int termID2) const;
+
+/** 
+ *   @brief  prints number of terms and postings and the size of the posting lists 
+ *           before and after compression 
+ *  
+ *   @return void
+ */
+    void printStats();
+
+/** 
+ *   @brief  writes the frozen and finalized index into a file (see IndexFile.h), including the pair index.
+ *           The segments are merged into one first (see mergeSegments()).
+ *  
+ *   @param  path path to the file
+ *   @param  documents docIDs of the collection documents, stored as the document metadata
+ *   @return false if the file can't be written
+ */
+    bool save(const string& path, const vector<unsigned long>& documents);
+
+/** 
+ *   @brief  replaces the index with one written by save(). The file is memory-mapped, and the dictionary, 
+ *           per-term arrays and posting lists read their data from the mapping, so only the pages touched by
+ *           queries are ever read. The ranking model the index was built with replaces the current one.
+ *           Impact-ordered posting lists (if enabled) are rebuilt from the loaded lists.
+ *  
+ *   @param  path path to the file
+ *   @param  documents receives docIDs of the collection documents
+ *   @return false if the file can't be opened or isn't a valid index file
+ */
+    bool load(const string& path, vector<unsigned long>& documents);
+
+protected:
+    Index(const Index&);
+    Index& operator=(const Index&);
+
+/** 
+ *   @brief  prints a single term, including document frequency and (optionally) posting list 
+ *  
+ *   @return void
+ */
+    void printTerm(unsigned int termID, bool includePostings);
+
+/** 
+ *   @brief  (re)builds posting lists of the pair index (see setPairIndex()) from positions of the single terms
+ *  
+ *   @return void
+ */
+    void buildPairIndex();
+
+/** 
+ *   @brief  flushes the in-memory segment into an immutable segment 
+ *  
+ *   @return void
+ */
+    void flush();
+
+/** 
+ *   @brief  terms recorded for a document of the in-memory segment (or of the run buffers), so that deleteDocument() 
+ *           touches only their lists
+ *  
+ *   @param  docID the document, added to the buffered documents if it isn't there
+ *   @return IDs of the terms
+ */
+    vector<unsigned int>& bufferedTerms(unsigned long docID);
+
+/** 
+ *   @brief  decodes occurrences of a term buffered within a memory budget into postings, combining occurrences 
+ *           of the same document as addTerm() combines them
+ *  
+ *   @param  buffer VByte encoded docID and position of each occurrence
+ *   @param  postings list the postings are appended to
+ *   @return void
+ */
+    static void decodeOccurrences(const vector<unsigned char>& buffer, POSTING_LIST& postings);
+
+/** 
+ *   @brief  writes the occurrences buffered since the previous call into a new run file (see setMemoryBudget()). 
+ *           A run holds a record of each term in term ID order: term ID and size of the rest of the record 
+ *           (two unsigned ints), then VByte encoded number of postings and each posting ordered by docID: 
+ *           docID, tf and tf positions.
+ *  
+ *   @return false if the file can't be written
+ */
+    bool spill();
+
+/** 
+ *   @brief  calculates idf of every term, BM25 length norms and the index-wide impact scale (see finalize())
+ *  
+ *   @param  collectionSize number of documents in the collection (N)
+ *   @param  lengths length of each document (BM25 only), indexed by docID
+ *   @param  maxTfs highest term frequency of each term
+ *   @return void
+ */
+    void computeWeights(unsigned long collectionSize, const vector<unsigned long>& lengths, const vector<unsigned int>& maxTfs);
+
+/** 
+ *   @brief  calculates idf of every term from its df and N, and the index-wide impact scale
+ *  
+ *   @param  maxTfs highest term frequency of each term
+ *   @return void
+ */
+    void updateIdf(const vector<unsigned int>& maxTfs);
+
+/** 
+ *   @brief  calculates BM25 length norms from the sum of the document lengths and N (see computeWeights())
+ *  
+ *   @return void
+ */
+    void updateLengthNorms();
+
+/** 
+ *   @brief  patches lists of the indexed pairs of two changed terms for the documents added or deleted
+ *           since the previous update() (see update())
+ *  
+ *   @param  changedTerms terms of the documents, sorted
+ *   @return void
+ */
+    void updatePairPostings(const vector<unsigned int>& changedTerms);
+
+/** 
+ *   @brief  writes the dictionary, per-term arrays and document metadata sections of the index file (see save())
+ *  
+ *   @param  writer the index file
+ *   @param  documents docIDs of the collection documents
+ *   @return void
+ */
+    void saveTerms(IndexFileWriter& writer, const vector<unsigned long>& documents) const;
+
+/** 
+ *   @brief  finishes the index file with the header
+ *  
+ *   @param  writer the index file
+ *   @param  pairsCount number of indexed pairs
+ *   @return false if the file wasn't written successfully
+ */
+    bool saveHeader(IndexFileWriter& writer, unsigned long pairsCount) const;
+
+/** 
+ *   @brief  adds new immutable segment to the segments read by queries, and starts the merge thread
+ *           if it isn't running
+ *  
+ *   @param  segment the segment
+ *   @return void
+ */
+    void addSegment(IndexSegment* segment);
+
+/** 
+ *   @brief  updates the posting list read by queries of a term from its lists in the segments, and its df,
+ *           which only counts documents which aren't deleted
+ *  
+ *   @param  termID ID of the term
+ *   @return void
+ */
+    void updateTermPostings(unsigned int termID);
+
+/** 
+ *   @brief  stores impacts of the postings of a term into its lists in the segments (see finalize())
+ *  
+ *   @param  termID ID of the term
+ *   @return void
+ */
+    void updateImpacts(unsigned int termID);
+
+/** 
+ *   @brief  selects segments for the next merge: SEGMENT_MERGE_FACTOR segments of the lowest size tier 
+ *           having that many segments which aren't being merged. Must be called with m_segmentsMutex locked.
+ *  
+ *   @param  segments receives the segments to merge
+ *   @return true if a merge was selected
+ */
+    bool selectMerge(vector<IndexSegment*>& segments);
+
+/** 
+ *   @brief  body of the merge thread: merges selected segments until stopMerges() is called
+ *  
+ *   @param  index the index
+ *   @return NULL
+ */
+    static void* mergeThread(void* index);
+
+/** 
+ *   @brief  stops the merge thread and merges segments on the calling thread until no size tier holds
+ *           SEGMENT_MERGE_FACTOR segments, so that every term is read from a few segments (at most 
+ *           SEGMENT_MERGE_FACTOR - 1 of each tier). The thread is started again by the next flush.
+ *  
+ *   @return void
+ */
+    void completeMerges();
+
+/** 
+ *   @brief  stops the merge thread once its current merge is completed
+ *  
+ *   @return void
+ */
+    void stopMerges();
+
+/** 
+ *   @brief  packs two 32-bit numbers into a 64-bit key ordered by the first and then by the second one,
+ *           e.g. pair of terms, or document and position of a term occurrence
+ */
+    static unsigned long long pairKey(unsigned long first, unsigned long second){
+        return (static_cast<unsigned long long>(first) << 32) | (second & 0xFFFFFFFF);
+    }
+
+    // per-term data, all arrays are indexed by term ID assigned by m_dictionary
+    TermDictionary             m_dictionary;        // maps term to its ID
+    MappedArray<unsigned long> m_df;                // document frequency of each term
+    vector<POSTING_LIST>       m_postings;          // in-memory segment: postings added since the last flush (posting is created for each document where the term is present)
+    map<unsigned long, vector<unsigned int> > m_bufferedDocs; // terms of each document with postings in the in-memory segment
+                                                    // (or with occurrences in the run buffers)
+    vector<const CompactPostingList*> m_termPostings;   // posting list of each term read by queries, updated by freeze(): the term's list
+                                                    // in the only segment containing it, or a view of its lists in several segments
+    map<unsigned int, CompactPostingList> m_termViews;  // views of the terms contained in several segments
+    vector<unsigned int>       m_changedTerms;      // terms whose documents were added or deleted since the last freeze()
+    CompactPostingList         m_emptyPostings;     // list of the terms contained in no segment
+    MappedArray<double>        m_idf;               // inverse document frequency of each term, see idf()
+    RANKING_MODEL              m_rankingModel;
+    MappedArray<unsigned char> m_lengthCodes;       // quantized length of each document (BM25 only), indexed by docID
+    double                     m_lengthNorms[LENGTH_CODES];    // BM25 length norm of each length code
+    double                     m_minLengthNorm;     // lowest length norm of a collection document
+    double                     m_impactScale;       // impact of a posting is its weight multiplied by this
+    unsigned long              m_collectionSize;    // N of the weights, running statistics are kept up to date by update()
+    double                     m_lengthSum;         // sum of the document lengths (BM25 only)
+    unsigned int               m_minLengthCode;     // lowest length code of a collection document (BM25 only)
+    unsigned long              m_statisticsVersion; // incremented whenever the statistics change
+    vector<unsigned long>      m_termVersions;      // statistics version of the impacts of each term (see updateTermWeights())
+    vector<unsigned long>      m_changedDocs;       // documents added to or deleted from the finalized index since the last update()
+    bool                       m_impactOrdered;
+    vector<ImpactOrderedList>  m_impactOrderedPostings; // impact-ordered posting list of each term, if enabled
+
+    // pair index, see setPairIndex()
+    bool                       m_pairIndex;
+    unsigned long              m_pairMinFrequency;
+    unsigned long              m_pairMemoryBudget;
+    vector<pair<string, string> > m_pairCandidates;    // pairs to index regardless of frequency
+    unsigned long              m_pairsCount;        // number of distinct adjacent pairs in the collection
+    map<pair<unsigned int, unsigned int>, CompactPostingList> m_pairPostings; // posting lists of the indexed pairs
+
+    MappedFile*                m_file;              // index file the index was loaded from, see load()
+
+    // segments, see IndexSegment
+    vector<IndexSegment*>      m_segments;          // segments read by queries
+    unsigned long              m_segmentSize;       // see setSegmentSize()
+    unsigned long              m_bufferedPostings;  // number of postings in the in-memory segment
+    vector<pair<vector<IndexSegment*>, IndexSegment*> > m_completedMerges;  // segments merged by the merge thread, 
+                                                    // with the segments they replace once refresh() is called
+    pthread_t                  m_mergeThread;
+    bool                       m_mergeThreadRunning;
+    bool                       m_stopMerging;
+    pthread_mutex_t            m_segmentsMutex;     // guards m_segments against the merge thread, merging flags of the segments, 
+                                                    // m_completedMerges and the merge thread state
+    pthread_cond_t             m_segmentsChanged;   // signalled when segments are added, merged or the merge thread is stopped
+
+    // index built within a memory budget, see setMemoryBudget()
+    unsigned long              m_memoryBudget;
+    string                     m_spillDir;
+    vector<vector<unsigned char> > m_runBuffers;    // VByte encoded docID and position of each occurrence of each term since the last spill()
+    unsigned long              m_runMemory;         // capacity of the buffers in bytes
+    vector<string>             m_runFiles;          // runs not merged yet
+    map<unsigned long, unsigned long> m_deletedRunDocs; // deleted documents, and the number of runs spilled before the 
+                                                    // deletion, which leave the document out when they are merged
+    unsigned long              m_runsCount;         // runs spilled so far, numbers the next one
+};
+
+/**
+ *  @brief Weight of the posting at a cursor under TF.IDF model. Scorers are the template parameter 
+ *         of the scoring loops of SearchEngine, so that the loops have no per-posting model branch.
+ */
+class TfIdfScorer{
+public:
+    double weight(const PostingCursor& cursor, double idf) const{
+        return Index::termWeight(cursor.tf(), idf);
+    }
+};
+
+/**
+ *  @brief Weight of the posting at a cursor under BM25 model, see TfIdfScorer
+ */
+class Bm25Scorer{
+public:
+    explicit Bm25Scorer(const Index& index):
+        m_lengthCodes(index.lengthCodes()),
+        m_lengthNorms(index.lengthNorms()){}
+
+    double weight(const PostingCursor& cursor, double idf) const{
+        return Index::bm25Weight(cursor.tf(), idf, m_lengthNorms[m_lengthCodes[cursor.docID()]]);
+    }
+
+private:
+    const unsigned char* m_lengthCodes;
+    const double*        m_lengthNorms;
+};
+
+/**
+ *  @brief Impact of the posting at a cursor (see Index::finalize()), see TfIdfScorer
+ */
+class ImpactScorer{
+public:
+    double weight(const PostingCursor& cursor, double) const{
+        return cursor.impact();
+    }
+};
+
+/**
+ *  @brief Implements search engine by building collection of the documents,
+ *         creating an index for it, and evaluating queries
+ */
+class SearchEngine{
+public:
+    explicit SearchEngine(RANKING_MODEL rankingModel = RANKING_MODEL_TFIDF):
+        m_rankingAlgorithm(RANKING_AUTO),
+        m_verifyRanking(false),
+        m_phraseStats(false),
+        m_explain(false),
+        m_impactScoring(false),
+        m_accumulatorLimit(0),
+        m_accumulatorLimitMode(ACCUMULATOR_LIMIT_QUIT),
+        m_postingsBudget(0),
+        m_collectionChanged(false),
+        m_indexThreads(1),
+        m_index(rankingModel){}
+
+/** 
+ *   @brief  builds document collection from XML file containing multiple documents separated by <DOC> tags  
+ *  
+ *   @param  xmlFilePath path to XML file with document entries 
+ *   @return void
+ */  
+    void buildFromFile(string xmlFilePath);
+
+    void buildFromSquadData(string jsonFilePath, bool tokenizeCollection = false);
+
+/** 
+ *   @brief  writes the index and the docIDs of the collection into a directory (see Index::save()),
+ *           which is created if needed
+ *  
+ *   @param  indexDirPath path to the index directory
+ *   @return void
+ */
+    void saveIndex(string indexDirPath);
+
+/** 
+ *   @brief  serves the collection from an index written by saveIndex() instead of building it, 
+ *           the index file is memory-mapped (see Index::load())
+ *  
+ *   @param  indexDirPath path to the index directory
+ *   @return void
+ */
+    void loadIndex(string indexDirPath);
+
+/** 
+ *   @brief  deletes all documents with the ID from the collection (see Index::deleteDocument()). The index
+ *           statistics (N, df and the weights depending on them) are updated before the next search.
+ *  
+ *   @param  docID ID of the document
+ *   @return false if the collection has no document with the ID
+ */
+    bool deleteDocument(unsigned long docID);
+
+/** 
+ *   @brief  replaces all documents with the ID by a new document, or adds the document if there are none
+ *  
+ *   @param  docID ID of the document, from FIRST_DOC_ID to MAX_DOC_ID - 1
+ *   @param  text body of the new document
+ *   @return false if the ID is out of range
+ */
+    bool updateDocument(unsigned long docID, string text);
+
+
+/** 
+ *   @brief  prints index of the seach engine to the screen
+ *  
+ *   @return void
+ */
+    void printIndex(bool includePostings = true);
+
+/** 
+ *   @brief  prints index statistics, including memory taken by compressed and uncompressed postings
+ *  
+ *   @return void
+ */
+    void printIndexStats();
+
+/** 
+ *   @brief  performs boolean search against the document collection. The query may combine words, phrases
+ *           and proximity queries with AND (also implied between adjacent operands), OR, NOT and parentheses
+ *           (see QueryParser). The operands of every operator are reordered and intersected based on 
+ *           their estimated cost (see planQuery()).
+ *  
+ *   @param  query a text query
+ *   @return vector<unsigned long> list of documents mating the search criteria
+ */
+    vector<unsigned long> booleanSearch(string query);
+
+ /** 
+ *   @brief  performs ranked search against the document collection. When only the best documents
+ *           are requested and the query has no proximity part, documents are evaluated with the selected
+ *           ranking algorithm (see setRankingAlgorithm()), which may skip documents that can't make it into the result.  
+ *  
+ *   @param  query a text query
+ *   @param  maxResults number of best documents to return, 0 returns all the matching documents
+ *   @return documents with non-zero ranking, sorted from the highest to the lowest score
+ */   
+    SCORED_DOC_LIST rankedSearch(string query, unsigned long maxResults = 0);
+
+/** 
+ *   @brief  selects algorithm used by rankedSearch() to find the best documents (RANKING_AUTO by default)
+ *  
+ *   @param  algorithm ranking algorithm
+ *   @return void
+ */
+    void setRankingAlgorithm(RANKING_ALGORITHM algorithm){m_rankingAlgorithm = algorithm;}
+
+/** 
+ *   @brief  enables verification of ranked search: results of the selected ranking algorithm are compared 
+ *           with exhaustive evaluation of the query and any difference is reported on the screen
+ *  
+ *   @param  verify true to verify every ranked search
+ *   @return void
+ */
+    void setVerifyRanking(bool verify){m_verifyRanking = verify;}
+
+/** 
+ *   @brief  enables printing of phrase query counters: for every phrase of a search, the number of documents 
+ *           containing all its terms (candidates) and the number of those where the terms form the phrase 
+ *  
+ *   @param  phraseStats true to print the counters
+ *   @return void
+ */
+    void setPhraseStats(bool phraseStats){m_phraseStats = phraseStats;}
+
+/** 
+ *   @brief  enables printing of boolean query plans: every operator with the intersection algorithm chosen 
+ *           for it, and the estimated and actual number of documents and cost of every node
+ *  
+ *   @param  explain true to print the plans
+ *   @return void
+ */
+    void setExplain(bool explain){m_explain = explain;}
+
+/** 
+ *   @brief  enables auxiliary index of adjacent term pairs, which then answers phrases (and proximity queries 
+ *           with zero window) containing the pairs (see Index::setPairIndex()). Must be called before 
+ *           the collection is built.
+ *  
+ *   @param  minFrequency pairs occurring at least this many times are indexed, 0 only indexes pairs from the query log
+ *   @param  memoryBudget highest size of the pair posting lists in bytes, 0 means no limit
+ *   @param  queryLog queries whose adjacent terms are indexed as pairs regardless of their frequency
+ *   @return void
+ */
+    void setPairIndex(unsigned long minFrequency, unsigned long memoryBudget, const vector<string>& queryLog);
+
+/** 
+ *   @brief  selects how ranked search scores documents: by summing exact weights of the ranking model (default), or
+ *           by summing integer impacts precomputed for every posting (see Index::finalize()), which is faster but 
+ *           approximate. Impact scores are reported scaled back to the weights of the ranking model.
+ *  
+ *   @param  impactScoring true to score with impacts
+ *   @return void
+ */
+    void setImpactScoring(bool impactScoring){m_impactScoring = impactScoring;}
+
+/** 
+ *   @brief  limits number of documents scored by term-at-a-time evaluation (RANKING_TAAT). With a limit, terms are
+ *           processed from the rarest one, and once the limit of accumulators is reached, the rest of the postings
+ *           is either ignored (quit) or only added to the existing accumulators (continue). Results are approximate.
+ *  
+ *   @param  limit highest number of accumulators, 0 means no limit (default)
+ *   @param  mode what to do once the limit is reached
+ *   @return void
+ */
+    void setAccumulatorLimit(unsigned long limit, ACCUMULATOR_LIMIT_MODE mode){
+        m_accumulatorLimit = limit;
+        m_accumulatorLimitMode = mode;
+    }
+
+/** 
+ *   @brief  enables impact-ordered index, needed by score-at-a-time evaluation (RANKING_SAAT). Should be called
+ *           before the collection is built, otherwise the index is built by the first call.
+ *  
+ *   @param  impactOrdered true to keep impact-ordered posting lists
+ *   @return void
+ */
+    void setImpactOrderedIndex(bool impactOrdered){m_index.setImpactOrdered(impactOrdered);}
+
+/** 
+ *   @brief  sets how many postings of the documents added to a built index are kept in memory before they are
+ *           flushed into an immutable index segment, which background merges then combine with other segments
+ *           (see Index). The collection file is indexed into a single segment.
+ *  
+ *   @param  segmentSize number of postings, 0 flushes only when the index is refreshed
+ *   @return void
+ */
+    void setSegmentSize(unsigned long segmentSize){m_index.setSegmentSize(segmentSize);}
+
+/** 
+ *   @brief  sets number of threads building the index from an XML collection file. The file is read
+ *           by the calling thread in batches of INDEX_BATCH_SIZE documents, which the threads invert
+ *           into postings of their own, and the posting lists of the batches are then merged by the
+ *           threads in ranges of terms. The index is the same as the one built by a single thread.
+ *  
+ *   @param  threadsCount number of threads, 1 (default) builds the index in the calling thread
+ *   @return void
+ */
+    void setIndexThreads(unsigned int threadsCount){m_indexThreads = threadsCount > 0 ? threadsCount : 1;}
+
+/** 
+ *   @brief  builds the index within a memory budget (see Index::setMemoryBudget()): postings are spilled into
+ *           sorted runs whenever their buffers use up the budget, and the runs are merged into the index file 
+ *           in the spill directory, which is then served memory-mapped. Text of the documents isn't kept, 
+ *           the index is built by a single thread and without the pair index. Must be called before 
+ *           the collection is built.
+ *  
+ *   @param  memoryBudget highest size of the posting buffers in bytes, 0 keeps the index in memory (default)
+ *   @param  spillDir directory for the runs and the index file, created if needed
+ *   @return void
+ */
+    void setMemoryBudget(unsigned long memoryBudget, string spillDir = SPILL_DIR);
+
+/** 
+ *   @brief  limits number of postings processed by score-at-a-time evaluation, which bounds the time of a query. 
+ *           Postings with the highest impacts are processed first, so the higher the budget, the closer 
+ *           the results are to exact ranking by impacts. With RANKING_AUTO and impact-ordered index enabled, 
+ *           queries with more postings than the budget are evaluated score-at-a-time.
+ *  
+ *   @param  budget highest number of postings per query, 0 means no limit (default)
+ *   @return void
+ */
+    void setPostingsBudget(unsigned long budget){m_postingsBudget = budget;}
+
+/** 
+ *   @brief  measures quality loss of impact scoring: every query is evaluated with exact and with impact scores,
+ *           and their best documents are compared. Prints the overlap of the results and the score error.
+ *  
+ *   @param  queries queries to evaluate
+ *   @param  maxResults number of best documents to compare
+ *   @return void
+ */
+    void printImpactQuality(const vector<string>& queries, unsigned long maxResults);
+
+/** 
+ *   @brief  measures speed of the proximity check (see findProximityPair()) on the documents shared by pairs of
+ *           the most frequent terms (see PROXIMITY_BENCHMARK_TERMS): the former nested loops over positions,
+ *           the linear merge and its SIMD variant. Prints the time of each and the number of matching documents.
+ *  
+ *   @param  proximityWnd proximity window
+ *   @return void
+ */
+    void printProximityBenchmark(unsigned long proximityWnd);
+
+protected:
+/** 
+ *   @brief checks that a document can be indexed with the ID, postings store docIDs in 32 bits (see MAX_DOC_ID)
+ *  
+ *   @param  docID ID of the document
+ *   @return true if the ID is from FIRST_DOC_ID to MAX_DOC_ID - 1
+ */
+    static bool validDocID(unsigned long docID){return docID >= FIRST_DOC_ID && docID < MAX_DOC_ID;}
+
+/** 
+ *   @brief parses user query and builds 2 separate lists holding 'proximity' and 'free text' queries  
+ *  
+ *   @param  userQuestion user question (can be a mixed of 'free text' and 'proximity' query)
+ *   @param  proxQueries list of 'proximity' queries, populated by the function
+ *   @param  freeTextQueries list of 'free text' queries, populated by the function
+ *   @return intersection set
+ */     
+    void buildQueries(string userQuestion, PROXIMITY_QUERY_LIST& proxQueries, FREETEXT_QUERY_LIST& freeTextQueries);
+
+/** 
+ *   @brief builds iterator over documents matching a proximity query (or phrase). Phrases and ordered windows
+ *          of size 0 are evaluated with pairs of adjacent terms from the pair index where possible (see planPhrase()).
+ *  
+ *   @param  proxQuery proximity query, counts its candidate documents during the iteration
+ *   @return iterator, owned by the caller
+ */
+    DocIterator* proximityIterator(ProximityQuery& proxQuery);
+
+/** 
+ *   @brief estimates the number of matching documents and the cost of every node of a boolean query, from
+ *          document frequencies of the terms. Nested operators of the same kind are merged, positive operands 
+ *          of AND are ordered from the fewest documents and NOT operands are moved to the end, where they 
+ *          exclude documents of the conjunction. Every AND gets the cheapest intersection algorithm.
+ *  
+ *   @param  node root of the (sub)query, may be replaced
+ *   @return root of the planned (sub)query
+ */
+    QueryNode* planQuery(QueryNode* node);
+
+/** 
+ *   @brief builds iterator over documents matching a planned boolean query (see planQuery())
+ *  
+ *   @param  node root of the (sub)query
+ *   @return iterator, owned by the caller
+ */
+    DocIterator* queryIterator(QueryNode* node);
+
+/** 
+ *   @brief wraps iterator of a plan node so that it records actual values into the node, if enabled by setExplain()
+ *  
+ *   @param  iterator iterator of the node
+ *   @param  node plan node
+ *   @return the iterator to use for the node
+ */
+    DocIterator* explainIterator(DocIterator* iterator, QueryNode* node);
+
+/** 
+ *   @brief prints plan of a boolean query, one node per line (see setExplain())
+ *  
+ *   @param  node root of the (sub)query
+ *   @param  depth depth of the node in the plan
+ *   @return void
+ */
+    void printPlan(const QueryNode* node, unsigned int depth);
+
+/** 
+ *   @brief collects proximity queries of a boolean query, in the query order
+ *  
+ *   @param  node root of the (sub)query
+ *   @param  proxQueries list of the queries, appended by the function
+ *   @return void
+ */
+    void collectProximityQueries(QueryNode* node, vector<ProximityQuery*>& proxQueries);
+
+/** 
+ *   @brief prints numbers of candidate and verified documents of a phrase, if enabled by setPhraseStats()
+ *  
+ *   @param  proxQuery evaluated proximity query, ignored if it's not a phrase
+ *   @return void
+ */
+    void printPhraseStats(ProximityQuery& proxQuery);
+
+/** 
+ *   @brief  builds the index from XML collection file with multiple threads (see setIndexThreads())
+ *  
+ *   @param  xmlFilePath path to XML file with document entries 
+ *   @return void
+ */
+    void buildFromFileParallel(string& xmlFilePath);
+
+/** 
+ *   @brief  prepares the index for queries once documents were added or deleted: freezes and finalizes it,
+ *           or merges its runs into the index file if it is built within a memory budget
+ *  
+ *   @return void
+ */
+    void finalizeIndex();
+
+/** 
+ *   @brief updates the sorted list of distinct docIDs of the collection, which NOT operands exclude documents from
+ *          and exhaustive evaluation scores (deleteDocument() and updateDocument() keep it up to date)
+ *  
+ *   @return void
+ */
+    void updateDocumentIDs();
+
+/** 
+ *   @brief makes the index ready for a search: swaps in completed merges and, if documents were deleted
+ *          or updated since the previous search, updates the statistics of the terms they touch (see Index::update())
+ *  
+ *   @return void
+ */
+    void refreshIndex();
+
+/** 
+ *   @brief detects whether 2 terms are located from each other with-in proximity window (order is important).
+ *          Sorted positions of both terms are merged in linear time; long position lists of the second term
+ *          (see PROXIMITY_SIMD_MIN_POSITIONS) are scanned with SSE2, several positions per comparison.
+ *  
+ *   @param  positions1 positions of term1 in the document
+ *   @param  positions2 positions of term2 in the document
+ *   @param  proximityWnd proximity window
+ *   @return true if there is a least one instance of correct proximity, otherwise - false.
+ */
+    bool findProximityPair(const POSITIONS_LIST& positions1, const POSITIONS_LIST& positions2, unsigned long proximityWnd );
+
+/** 
+ *   @brief plans evaluation of a phrase: its terms are covered by pairs of adjacent terms which are in the pair 
+ *          index (see Index::setPairIndex()), and by single terms where there is no such pair
+ *  
+ *   @param  terms IDs of the phrase terms (must be valid)
+ *   @param  lists posting list of every unit of the phrase, populated by the function
+ *   @param  offsets position of every unit in the phrase, populated by the function
+ *   @return number of pair posting lists used
+ */
+    unsigned int planPhrase(const vector<unsigned int>& terms, vector<const CompactPostingList*>& lists, vector<unsigned long>& offsets);
+
+/** 
+ *   @brief collects IDs of all the terms from proximity and free text queries into a single list  
+ *  
+ *   @param  proxQueries list of 'proximity' queries extracted from original user query (see buildQueries() function)
+ *   @param  freeTextQueries list of 'free text' queries extracted from original user query (see buildQueries() function)
+ *   @param  termIDs list of term IDs, populated by the function (terms not present in the index are skipped)
+ *   @return void
+ */
+    void collectTermIDs(PROXIMITY_QUERY_LIST& proxQueries, FREETEXT_QUERY_LIST& freeTextQueries, vector<unsigned int>& termIDs);
+
+/** 
+ *   @brief scores a document based on the query. Uses the ranking model of the index for scoring
+ *  
+ *   @param  scorer weight of a posting (TfIdfScorer, Bm25Scorer or ImpactScorer)
+ *   @param  termIDs IDs of all query terms (see collectTermIDs() function)
+ *   @param  cursors posting cursor of each term in termIDs, positioned before or at docID. 
+ *                   Cursors are advanced by the function, so documents must be scored in increasing docID order.
+ *   @param  docID document to score
+ *   @param  score will hold the value when function returns
+ *  
+ *   @return true if score was calculated, false if not (i.e. this document does not contain any terms in the provided queries).
+ */
+    template<class Scorer>
+    bool score(const Scorer& scorer, const vector<unsigned int>& termIDs, vector<PostingCursor>& cursors, unsigned long docID, double& score);
+
+/** 
+ *   @brief highest weight of a query term in a document with the given term frequency: weight of the ranking
+ *          model (see Index::maxWeight()), or its impact when scoring with impacts (see setImpactScoring())
+ *  
+ *   @param  term query term
+ *   @param  tf term frequency in the document
+ *   @return weight
+ */
+    double maxTermWeight(const QueryTerm& term, unsigned int tf) const{
+        double weight = m_index.maxWeight(term.termID, tf);
+        return m_impactScoring ? m_index.impact(weight) : weight;
+    }
+
+/** 
+ *   @brief prepares distinct query terms for document-at-a-time evaluation: opens posting cursors 
+ *          (positioned at the first collection document) and calculates idf and score upper bounds 
+ *  
+ *   @param  termIDs IDs of all query terms (see collectTermIDs() function)
+ *   @param  queryTerms list of distinct query terms, populated by the function
+ *   @param  occurrences index in queryTerms of every term in termIDs, populated by the function
+ *   @return void
+ */
+    void prepareQueryTerms(const vector<unsigned int>& termIDs, QUERY_TERM_LIST& queryTerms, vector<unsigned int>& occurrences);
+
+/** 
+ *   @brief scores a document using the query terms whose cursors are positioned at it. Term weights are 
+ *          summed up in the query order, so the result is identical to the one of score() function.
+ *  
+ *   @param  scorer weight of a posting (see score())
+ *   @param  queryTerms distinct query terms (see prepareQueryTerms())
+ *   @param  occurrences query occurrences of the terms (see prepareQueryTerms())
+ *   @param  docID document to score
+ *   @return document score
+ */
+    template<class Scorer>
+    double scoreAtCursors(const Scorer& scorer, QUERY_TERM_LIST& queryTerms, const vector<unsigned int>& occurrences, unsigned int docID);
+
+/** 
+ *   @brief finds best scoring documents containing any of the query terms using WAND algorithm
+ *          (document-at-a-time evaluation which only fully scores documents whose score upper bound 
+ *          can beat the current k-th best score). With Block-Max WAND, the candidate is also checked 
+ *          against upper bounds of the posting blocks containing it, and when these can't beat the k-th 
+ *          best score, the rest of the blocks is skipped without decoding.
+ *  
+ *   @param  scorer weight of a posting (see score())
+ *   @param  queryTerms distinct query terms (see prepareQueryTerms())
+ *   @param  occurrences query occurrences of the terms (see prepareQueryTerms())
+ *   @param  blockMax true to use Block-Max WAND
+ *   @param  topDocs collector of the best documents, its size limits the number of documents to find
+ *   @return void
+ */
+    template<class Scorer>
+    void wandSearch(const Scorer& scorer, QUERY_TERM_LIST& queryTerms, const vector<unsigned int>& occurrences, bool blockMax, TopDocs& topDocs);
+
+/** 
+ *   @brief finds best scoring documents containing any of the query terms using MaxScore algorithm.
+ *          Terms are sorted by their score upper bounds, and the terms with the lowest bounds which together
+ *          can't beat the current k-th best score are non-essential: a document containing only those can't 
+ *          make it into the result. Candidates are taken from the lists of essential terms only, and the 
+ *          non-essential lists are only probed for them, until the candidate can't beat the k-th best score.
+ *          Avoids the per-document sorting of WAND, which gets expensive for queries with many terms.
+ *  
+ *   @param  scorer weight of a posting (see score())
+ *   @param  queryTerms distinct query terms (see prepareQueryTerms())
+ *   @param  occurrences query occurrences of the terms (see prepareQueryTerms())
+ *   @param  topDocs collector of the best documents, its size limits the number of documents to find
+ *   @return void
+ */
+    template<class Scorer>
+    void maxScoreSearch(const Scorer& scorer, QUERY_TERM_LIST& queryTerms, const vector<unsigned int>& occurrences, TopDocs& topDocs);
+
+/** 
+ *   @brief finds best scoring documents containing any of the query terms with term-at-a-time evaluation: 
+ *          postings of each term are streamed into accumulators (indexed by docID, see m_accumulators) and 
+ *          the best documents are selected by a scan of the accumulators afterwards. Accumulators are float, 
+ *          so scores are rounded to float precision. See also setAccumulatorLimit().
+ *  
+ *   @param  scorer weight of a posting (see score())
+ *   @param  queryTerms distinct query terms (see prepareQueryTerms())
+ *   @param  topDocs collector of the best documents, its size limits the number of documents to find (0 finds all)
+ *   @return void
+ */
+    template<class Scorer>
+    void taatSearch(const Scorer& scorer, QUERY_TERM_LIST& queryTerms, TopDocs& topDocs);
+
+/** 
+ *   @brief finds best scoring documents with score-at-a-time evaluation: segments of impact-ordered posting lists
+ *          of all query terms are processed from the highest contribution to the score, and their postings are 
+ *          added into accumulators, until the postings budget (see setPostingsBudget()) is used up. Scores are 
+ *          sums of impacts.
+ *  
+ *   @param  queryTerms distinct query terms (see prepareQueryTerms())
+ *   @param  topDocs collector of the best documents, its size limits the number of documents to find (0 finds all)
+ *   @return void
+ */
+    void saatSearch(const QUERY_TERM_LIST& queryTerms, TopDocs& topDocs);
+
+/** 
+ *   @brief chooses ranking algorithm to evaluate a query with (see setRankingAlgorithm())
+ *  
+ *   @param  queryTerms distinct query terms (see prepareQueryTerms())
+ *   @return ranking algorithm, never RANKING_AUTO
+ */
+    RANKING_ALGORITHM chooseRankingAlgorithm(const QUERY_TERM_LIST& queryTerms);
+
+/** 
+ *   @brief collects documents with accumulated score into topDocs, in docID order. Accumulators are reset 
+ *          to ACCUMULATOR_EMPTY while scanned, so that they can be reused by the next query. 
+ *  
+ *   @param  lastDocID highest docID which may have accumulated score
+ *   @param  topDocs collector of the best documents
+ *   @return void
+ */
+    void selectTopDocs(unsigned int lastDocID, TopDocs& topDocs);
+
+/** 
+ *   @brief evaluates the query terms with a document-at-a-time or term-at-a-time ranking algorithm
+ *  
+ *   @param  scorer weight of a posting (see score())
+ *   @param  algorithm ranking algorithm (see chooseRankingAlgorithm()), other than RANKING_SAAT
+ *   @param  queryTerms distinct query terms (see prepareQueryTerms())
+ *   @param  occurrences query occurrences of the terms (see prepareQueryTerms())
+ *   @param  topDocs collector of the best documents
+ *   @return void
+ */
+    template<class Scorer>
+    void evaluateQuery(const Scorer& scorer, RANKING_ALGORITHM algorithm, QUERY_TERM_LIST& queryTerms, 
+                       const vector<unsigned int>& occurrences, TopDocs& topDocs);
+
+/** 
+ *   @brief scores documents of the search set one by one, with the scorer selected by the ranking model 
+ *          of the index and setImpactScoring()
+ *  
+ *   @param  searchSet documents to score (see proximityIterator())
+ *   @param  termIDs IDs of all query terms (see collectTermIDs() function)
+ *   @param  topDocs collector of the scored documents
+ *   @return void
+ */
+    void exhaustiveSearch(DocIterator& searchSet, const vector<unsigned int>& termIDs, TopDocs& topDocs);
+
+/** 
+ *   @brief implements exhaustiveSearch() 
+ *  
+ *   @param  scorer weight of a posting (see score())
+ *   @param  searchSet documents to score (see proximityIterator())
+ *   @param  termIDs IDs of all query terms (see collectTermIDs() function)
+ *   @param  topDocs collector of the scored documents
+ *   @return void
  */
-    bool score(PROXIMITY_QUERY_LIST& proxQueries, FREETEXT_QUERY_LIST& freeTextQueries , unsigned long docID, double& score);
+    template<class Scorer>
+    void scoreDocuments(const Scorer& scorer, DocIterator& searchSet, const vector<unsigned int>& termIDs, TopDocs& topDocs);
 
 private:
+    RANKING_ALGORITHM m_rankingAlgorithm;
+    bool m_verifyRanking;
+    bool m_phraseStats;
+    bool m_explain;
+    bool m_impactScoring;   // score documents with precomputed impacts instead of TF.IDF weights
+    unsigned long m_accumulatorLimit;
+    ACCUMULATOR_LIMIT_MODE m_accumulatorLimitMode;
+    vector<float> m_accumulators;   // score of each document accumulated by taatSearch() and saatSearch(), ACCUMULATOR_EMPTY between queries
+    unsigned long m_postingsBudget;
+    vector<unsigned int> m_segmentDocIDs;   // buffer for docIDs decoded by saatSearch()
     vector<Document*> m_collection;
     vector<unsigned long> m_collectionDocIDs;
+    vector<unsigned long> m_documentIDs;    // distinct docIDs of the collection, sorted (see updateDocumentIDs())
+    bool m_collectionChanged;               // documents were deleted or updated since the index was finalized
+    unsigned int m_indexThreads;            // see setIndexThreads()
     Index m_index;
 };
 
@@ -0,0 +1,136 @@
+/** 
+ *  @file    TermDictionary.cpp
+ *  
+ *  @brief Term dictionary implementation
+ *
+ *  @section DESCRIPTION
+ *  
+ *  Linear probing hash table with FNV-1a hashing. The table is kept
+ *  at most half full, so lookups usually touch a single slot.
+ *  Mapped dictionaries keep no hash table, so that loading an index
+ *  doesn't touch every term.
+ *  
+ */
+
+#include "TermDictionary.h"
+
+#define INITIAL_TABLE_SIZE  1024
+
+TermDictionary::TermDictionary():
+    m_slots(INITIAL_TABLE_SIZE, 0),
+    m_mask(INITIAL_TABLE_SIZE - 1),
+    m_mappedText(NULL),
+    m_mappedOffsets(NULL),
+    m_mappedOrder(NULL),
+    m_mappedCount(0){
+}
+
+unsigned int TermDictionary::hash(const string& term){
+    unsigned int h = 2166136261u;
+
+    for(unsigned int i = 0; i < term.length(); i++){
+        h ^= static_cast<unsigned char>(term[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+unsigned int TermDictionary::find(const string& term) const{
+    if(m_mappedCount > 0)
+        return findMapped(term);
+
+    unsigned int h = hash(term);
+
+    for(unsigned int slot = h & m_mask; m_slots[slot] != 0; slot = (slot + 1) & m_mask){
+        unsigned int termID = m_slots[slot] - 1;
+        if(m_hashes[termID] == h && m_terms[termID] == term)
+            return termID;
+    }
+    return INVALID_TERM_ID;
+}
+
+unsigned int TermDictionary::insert(const string& term){
+    if(m_mappedCount > 0)
+        unmap();
+
+    unsigned int h = hash(term);
+    unsigned int slot = h & m_mask;
+
+    for(; m_slots[slot] != 0; slot = (slot + 1) & m_mask){
+        unsigned int termID = m_slots[slot] - 1;
+        if(m_hashes[termID] == h && m_terms[termID] == term)
+            return termID;
+    }
+
+    // not found, 'slot' points to the first empty slot of the probe sequence
+    unsigned int termID = m_terms.size();
+    m_terms.push_back(term);
+    m_hashes.push_back(h);
+    m_slots[slot] = termID + 1;
+
+    if(m_terms.size() * 2 > m_slots.size())
+        grow();
+
+    return termID;
+}
+
+void TermDictionary::grow(){
+    m_slots.assign(m_slots.size() * 2, 0);
+    m_mask = m_slots.size() - 1;
+
+    for(unsigned int termID = 0; termID < m_terms.size(); termID++){
+        unsigned int slot = m_hashes[termID] & m_mask;
+        while(m_slots[slot] != 0)
+            slot = (slot + 1) & m_mask;
+        m_slots[slot] = termID + 1;
+    }
+}
+
+void TermDictionary::map(const char* text, const unsigned int* offsets, const unsigned int* order, unsigned int count){
+    m_slots.assign(INITIAL_TABLE_SIZE, 0);
+    m_mask = INITIAL_TABLE_SIZE - 1;
+    vector<unsigned int>().swap(m_hashes);
+    vector<string>().swap(m_terms);
+
+    m_mappedText = text;
+    m_mappedOffsets = offsets;
+    m_mappedOrder = order;
+    m_mappedCount = count;
+}
+
+unsigned int TermDictionary::findMapped(const string& term) const{
+    unsigned int low = 0, high = m_mappedCount;
+
+    while(low < high){
+        unsigned int middle = low + (high - low) / 2;
+        unsigned int termID = m_mappedOrder[middle];
+        unsigned int offset = m_mappedOffsets[termID];
+        int cmp = term.compare(0, string::npos, m_mappedText + offset, m_mappedOffsets[termID + 1] - offset);
+
+        if(cmp == 0)
+            return termID;
+        if(cmp < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return INVALID_TERM_ID;
+}
+
+void TermDictionary::unmap(){
+    unsigned int count = m_mappedCount;
+
+    m_terms.reserve(count);
+    m_hashes.reserve(count);
+    for(unsigned int termID = 0; termID < count; termID++){
+        m_terms.push_back(term(termID));
+        m_hashes.push_back(hash(m_terms.back()));
+    }
+    m_mappedCount = 0;
+
+    unsigned int tableSize = INITIAL_TABLE_SIZE;
+    while(m_terms.size() * 2 > tableSize)
+        tableSize *= 2;
+    m_slots.assign(tableSize / 2, 0);
+    grow();     // doubles the table to tableSize and inserts all terms
+}
@@ -0,0 +1,102 @@
+/** 
+ *  @file    TermDictionary.h
+ *  
+ *  @brief Term dictionary of the search engine index
+ *
+ *  @section DESCRIPTION
+ *  
+ *  Open-addressing hash table which maps each term to a dense 32-bit term ID.
+ *  IDs are assigned in the order terms are first seen (0, 1, 2, ...), so that
+ *  per-term data can be kept in plain arrays indexed by the ID.
+ *  A dictionary loaded from an index file reads its terms from the mapped
+ *  file instead, and looks them up by binary search over the sorted terms.
+ *  
+ */
+
+#ifndef _TERM_DICTIONARY_H
+#define _TERM_DICTIONARY_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define INVALID_TERM_ID     0xFFFFFFFF
+
+class TermDictionary{
+public:
+    TermDictionary();
+
+/** 
+ *   @brief  looks up ID of a term 
+ *  
+ *   @param  term term to look for
+ *   @return ID of the term, or INVALID_TERM_ID if term is not in the dictionary
+ */
+    unsigned int find(const string& term) const;
+
+/** 
+ *   @brief  adds term to the dictionary if not already there
+ *  
+ *   @param  term term to add
+ *   @return ID of the term (existing or newly assigned)
+ */
+    unsigned int insert(const string& term);
+
+    string term(unsigned int termID) const{
+        if(m_mappedCount > 0)
+            return string(m_mappedText + m_mappedOffsets[termID], m_mappedOffsets[termID + 1] - m_mappedOffsets[termID]);
+        return m_terms[termID];
+    }
+    unsigned int size() const {return m_mappedCount > 0 ? m_mappedCount : m_terms.size();}
+
+/** 
+ *   @brief  makes the dictionary read its terms from arrays of a memory-mapped index file. The hash table
+ *           is rebuilt from the arrays if a term is inserted later. 
+ *  
+ *   @param  text all terms, concatenated in term ID order
+ *   @param  offsets offset of each term in the text, followed by the end of the text (count+1 entries)
+ *   @param  order term IDs sorted by their terms
+ *   @param  count number of terms
+ *   @return void
+ */
+    void map(const char* text, const unsigned int* offsets, const unsigned int* order, unsigned int count);
+
+private:
+    static unsigned int hash(const string& term);
+
+/** 
+ *   @brief  looks up ID of a term in the mapped arrays, see map() 
+ *  
+ *   @param  term term to look for
+ *   @return ID of the term, or INVALID_TERM_ID if term is not in the dictionary
+ */
+    unsigned int findMapped(const string& term) const;
+
+/** 
+ *   @brief  copies terms of a mapped dictionary and builds the hash table of them, see map() 
+ *  
+ *   @return void
+ */
+    void unmap();
+
+/** 
+ *   @brief  doubles the hash table and re-inserts all terms
+ *  
+ *   @return void
+ */
+    void grow();
+
+    vector<unsigned int> m_slots;   // hash table, holds termID+1 (0 marks an empty slot)
+    vector<unsigned int> m_hashes;  // hash value of each term, indexed by termID (avoids re-hashing strings on grow)
+    vector<string>       m_terms;   // term strings, indexed by termID
+    unsigned int         m_mask;    // m_slots.size()-1, table size is always a power of 2
+
+    // terms of a mapped dictionary, see map()
+    const char*          m_mappedText;
+    const unsigned int*  m_mappedOffsets;
+    const unsigned int*  m_mappedOrder;
+    unsigned int         m_mappedCount;
+};
+
+#endif /*_TERM_DICTIONARY_H*/
@@ -30,8 +30,10 @@ enum SEARCH_TYPE{
 #define EXIT_KEY                'q'
 #define CUSTOM_QUERY_KEY        '6'
 #define TOGGLE_SEARCH_TYPE_KEY  't'
+#define DELETE_DOCUMENT_KEY     'd'
+#define UPDATE_DOCUMENT_KEY     'u'
 
-char displayIntro(){
+void displayIntro(){
     cout << "******************************************************" << endl;
     cout << "*        Welcome to the CSC 849 Search Engine!       *" << endl;
     cout << "* The following interactive program lets you execute *" << endl;
@@ -50,20 +52,22 @@ char displayMenu(SEARCH_TYPE searchType){
     
     cout << "[6] - custom query..." << endl;
     cout << "[t] - toggle search type (boolean or ranked)" << endl;
+    cout << "[d] - delete document..." << endl;
+    cout << "[u] - update document..." << endl;
     cout << "[q] - exit" << endl;
 
     cin >> selection;
     return selection;
 }
 
-void printRankedResults(string query, SCORES_LIST& scoresSet){
+void printRankedResults(string query, SCORED_DOC_LIST& scoredDocs){
     cout << "QUERY: " << "\"" << query << "\"" << endl;
     cout << "RESULT: " << endl;
 
-    if( scoresSet.size() > 0){
-        for(SCORES_LIST::reverse_iterator iter = scoresSet.rbegin(); iter != scoresSet.rend(); ++iter)
+    if( scoredDocs.size() > 0){
+        for(unsigned long i = 0; i < scoredDocs.size(); i++)
         {
-            cout << "DocID: " << iter->second << ", score=" << iter->first << endl;
+            cout << "DocID: " << scoredDocs[i].docID << ", score=" << scoredDocs[i].score << endl;
         }
 
         cout << endl << endl;
@@ -93,11 +97,28 @@ void printBooleanResults(string query, vector<unsigned long>& docIDs){
 
 int main(int argc, char *argv[])
 {
-    SearchEngine searchEngine;
+    // ranking model is fixed when the search engine is constructed, look it up before the other options
+    RANKING_MODEL rankingModel = RANKING_MODEL_TFIDF;
+    for(int i = 1; i < argc; i++){
+        if(string(argv[i]) == "-bm25")
+            rankingModel = RANKING_MODEL_BM25;
+    }
+
+    SearchEngine searchEngine(rankingModel);
     bool bIndexOnly = false;
+    bool bIndexStats = false;
+    string impactQualityQueriesPath;    // file with queries (one per line) to measure quality of impact scoring with
+    long proximityBenchmarkWnd = -1;    // proximity window to benchmark proximity checks with, -1 runs no benchmark
+    bool pairIndex = false;
+    unsigned long pairMinFrequency = 0, pairMemoryBudget = 0;
+    string pairQueryLogPath;            // file with queries (one per line) whose adjacent terms are indexed as pairs
+    unsigned long maxResults = 0;   // number of ranked search results to show, 0 shows all
     bool isSquad = false;
     string collectionPath = "collections/documents.txt";
     string squadTrainDataPath, squadDevDataPath;
+    string indexOutPath, indexInPath;   // index directories to write the built index to, or to serve from
+    unsigned long memoryBudget = 0;     // bytes of postings buffered before they are spilled to disk, 0 keeps the index in memory
+    string spillDir = SPILL_DIR;
 
     int argIndex = 1;
     while(argIndex < argc){
@@ -105,6 +126,93 @@ int main(int argc, char *argv[])
         if(nextArg == "-index"){
             bIndexOnly = true;
         }
+        else if(nextArg == "-index-stats"){
+            bIndexStats = true;
+        }
+        else if(nextArg == "-index-out" && argIndex < argc){
+            indexOutPath = argv[argIndex++];
+        }
+        else if(nextArg == "-index-in" && argIndex < argc){
+            indexInPath = argv[argIndex++];
+        }
+        else if(nextArg == "-top" && argIndex < argc){
+            maxResults = strtoul(argv[argIndex++], NULL, 10);
+        }
+        else if(nextArg == "-ranking" && argIndex < argc){
+            string algorithm = argv[argIndex++];
+            if(algorithm == "exhaustive")
+                searchEngine.setRankingAlgorithm(RANKING_EXHAUSTIVE);
+            else if(algorithm == "wand")
+                searchEngine.setRankingAlgorithm(RANKING_WAND);
+            else if(algorithm == "bmw")
+                searchEngine.setRankingAlgorithm(RANKING_BLOCK_MAX_WAND);
+            else if(algorithm == "maxscore")
+                searchEngine.setRankingAlgorithm(RANKING_MAXSCORE);
+            else if(algorithm == "taat")
+                searchEngine.setRankingAlgorithm(RANKING_TAAT);
+            else if(algorithm == "saat")
+                searchEngine.setRankingAlgorithm(RANKING_SAAT);
+            else if(algorithm == "auto")
+                searchEngine.setRankingAlgorithm(RANKING_AUTO);
+            else{
+                cout << "Invalid ranking algorithm" << endl;
+                exit(-1);
+            }
+        }
+        else if(nextArg == "-bm25"){
+            // already handled above
+        }
+        else if(nextArg == "-verify-ranking"){
+            searchEngine.setVerifyRanking(true);
+        }
+        else if(nextArg == "-phrase-stats"){
+            searchEngine.setPhraseStats(true);
+        }
+        else if(nextArg == "-explain"){
+            searchEngine.setExplain(true);
+        }
+        else if((nextArg == "-accumulator-limit-quit" || nextArg == "-accumulator-limit-continue") && argIndex < argc){
+            searchEngine.setAccumulatorLimit(strtoul(argv[argIndex++], NULL, 10), 
+                nextArg == "-accumulator-limit-quit" ? ACCUMULATOR_LIMIT_QUIT : ACCUMULATOR_LIMIT_CONTINUE);
+        }
+        else if(nextArg == "-impact-ordered"){
+            searchEngine.setImpactOrderedIndex(true);
+        }
+        else if(nextArg == "-segment-size" && argIndex < argc){
+            searchEngine.setSegmentSize(strtoul(argv[argIndex++], NULL, 10));
+        }
+        else if(nextArg == "-index-threads" && argIndex < argc){
+            searchEngine.setIndexThreads(strtoul(argv[argIndex++], NULL, 10));
+        }
+        else if(nextArg == "-memory-budget" && argIndex < argc){
+            memoryBudget = strtoul(argv[argIndex++], NULL, 10);
+        }
+        else if(nextArg == "-spill-dir" && argIndex < argc){
+            spillDir = argv[argIndex++];
+        }
+        else if(nextArg == "-postings-budget" && argIndex < argc){
+            searchEngine.setPostingsBudget(strtoul(argv[argIndex++], NULL, 10));
+        }
+        else if(nextArg == "-impact-scoring"){
+            searchEngine.setImpactScoring(true);
+        }
+        else if(nextArg == "-impact-quality" && argIndex < argc){
+            impactQualityQueriesPath = argv[argIndex++];
+        }
+        else if(nextArg == "-proximity-benchmark" && argIndex < argc){
+            proximityBenchmarkWnd = strtol(argv[argIndex++], NULL, 10);
+        }
+        else if(nextArg == "-pair-index-min-freq" && argIndex < argc){
+            pairIndex = true;
+            pairMinFrequency = strtoul(argv[argIndex++], NULL, 10);
+        }
+        else if(nextArg == "-pair-index-queries" && argIndex < argc){
+            pairIndex = true;
+            pairQueryLogPath = argv[argIndex++];
+        }
+        else if(nextArg == "-pair-index-budget" && argIndex < argc){
+            pairMemoryBudget = strtoul(argv[argIndex++], NULL, 10);
+        }
         else if(nextArg == "-squad-train-data"){
             isSquad = true;
             squadTrainDataPath = argv[argIndex++];
@@ -120,7 +228,31 @@ int main(int argc, char *argv[])
         }
     }
 
-    if(isSquad)
+    if(pairIndex){
+        vector<string> queryLog;
+
+        if(!pairQueryLogPath.empty()){
+            ifstream queryLogFile(pairQueryLogPath.c_str());
+            if(!queryLogFile.is_open()){
+                cout << "Unable to open file: " << pairQueryLogPath << endl;
+                exit(1);
+            }
+
+            string query;
+            while(getline(queryLogFile, query)){
+                if(!query.empty())
+                    queryLog.push_back(query);
+            }
+        }
+        searchEngine.setPairIndex(pairMinFrequency, pairMemoryBudget, queryLog);
+    }
+
+    if(memoryBudget > 0)
+        searchEngine.setMemoryBudget(memoryBudget, spillDir);
+
+    if(!indexInPath.empty())
+        searchEngine.loadIndex(indexInPath);
+    else if(isSquad)
     {
         searchEngine.buildFromSquadData(squadTrainDataPath, true);
         searchEngine.buildFromSquadData(squadDevDataPath, true);
@@ -128,11 +260,44 @@ int main(int argc, char *argv[])
     else
         searchEngine.buildFromFile(collectionPath);
 
+    if(!indexOutPath.empty()){
+        searchEngine.saveIndex(indexOutPath);
+        cout << "Index written to " << indexOutPath << endl;
+        return 0;
+    }
+
     if(bIndexOnly){
         searchEngine.printIndex(false);
         return 0;
     }
 
+    if(bIndexStats){
+        searchEngine.printIndexStats();
+        return 0;
+    }
+
+    if(!impactQualityQueriesPath.empty()){
+        ifstream queriesFile(impactQualityQueriesPath.c_str());
+        if(!queriesFile.is_open()){
+            cout << "Unable to open file: " << impactQualityQueriesPath << endl;
+            exit(1);
+        }
+
+        vector<string> queries;
+        string query;
+        while(getline(queriesFile, query)){
+            if(!query.empty())
+                queries.push_back(query);
+        }
+        searchEngine.printImpactQuality(queries, maxResults > 0 ? maxResults : 10);
+        return 0;
+    }
+
+    if(proximityBenchmarkWnd >= 0){
+        searchEngine.printProximityBenchmark(proximityBenchmarkWnd);
+        return 0;
+    }
+
     displayIntro();
     char selection;
     SEARCH_TYPE searchType = SEARCH_RANKED;
@@ -153,8 +318,8 @@ int main(int argc, char *argv[])
                     printBooleanResults(query, searchResults);
                 }
                 else{
-                    SCORES_LIST scoresSet = searchEngine.rankedSearch(query);
-                    printRankedResults(query, scoresSet);
+                    SCORED_DOC_LIST scoredDocs = searchEngine.rankedSearch(query, maxResults);
+                    printRankedResults(query, scoredDocs);
                 }
                 break;
             }
@@ -169,8 +334,8 @@ int main(int argc, char *argv[])
                     printBooleanResults(PREDIFINED_QUERIES[selection - '1'], searchResults);
                 }
                 else{
-                    SCORES_LIST scoresSet = searchEngine.rankedSearch(PREDIFINED_QUERIES[selection - '1']);
-                    printRankedResults(PREDIFINED_QUERIES[selection - '1'], scoresSet);
+                    SCORED_DOC_LIST scoredDocs = searchEngine.rankedSearch(PREDIFINED_QUERIES[selection - '1'], maxResults);
+                    printRankedResults(PREDIFINED_QUERIES[selection - '1'], scoredDocs);
                 }
 
                 break;
@@ -180,6 +345,31 @@ int main(int argc, char *argv[])
                 searchType = (searchType == SEARCH_BOOLEAN) ? SEARCH_RANKED : SEARCH_BOOLEAN;
                 break;
             }
+            case DELETE_DOCUMENT_KEY:
+            {
+                unsigned long docID;
+                cout << "Type the document ID and press ENTER" << endl;
+                cin >> docID;
+                if(searchEngine.deleteDocument(docID))
+                    cout << "Document " << docID << " deleted" << endl;
+                else
+                    cout << "Document " << docID << " not found" << endl;
+                break;
+            }
+            case UPDATE_DOCUMENT_KEY:
+            {
+                unsigned long docID;
+                string text;
+                cout << "Type the document ID and press ENTER, then the new text and press ENTER" << endl;
+                cin >> docID;
+                std::getline(std::cin, text); // read ENTER
+                std::getline(std::cin, text); // read actual text
+                if(searchEngine.updateDocument(docID, text))
+                    cout << "Document " << docID << " updated" << endl;
+                else
+                    cout << "Invalid document ID " << docID << endl;
+                break;
+            }
             case EXIT_KEY:
                 cout << "Good bye!" << endl;
                 break;